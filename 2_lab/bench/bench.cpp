@@ -0,0 +1,427 @@
+#include "../my_regex.hpp"
+#include "../regex_shared.hpp"
+#include <malloc.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+// regex_bench [--sizes 1K,1M,100M] [--family name] [--min-time seconds]
+//             [--std-max-bytes n] [--to-regex-max-states n]
+//
+// One JSON object per line on stdout:
+//   {"family", "op", "engine", "bytes", "iterations", "ns_per_op",
+//    "bytes_per_sec", "states", "matches", "peak_heap_bytes", "max_rss_kb"}
+// bytes is 0 for operations on the pattern alone. peak_heap_bytes is the
+// heap high-water mark of the measured operation above what was live
+// before it; max_rss_kb is the process peak so far.
+
+namespace {
+
+    std::atomic<size_t> live_bytes{ 0 };
+    std::atomic<size_t> peak_bytes{ 0 };
+
+    void noteAlloc(void* p) {
+        if (!p) return;
+        size_t now = live_bytes += malloc_usable_size(p);
+        size_t peak = peak_bytes.load(std::memory_order_relaxed);
+        while (now > peak && !peak_bytes.compare_exchange_weak(peak, now)) {}
+    }
+
+    void* allocate(size_t n) {
+        void* p = std::malloc(n ? n : 1);
+        if (!p) throw std::bad_alloc();
+        noteAlloc(p);
+        return p;
+    }
+
+    // CompiledDKA allocates its table cache-line aligned
+    void* allocate(size_t n, std::align_val_t align) {
+        const size_t a = std::max(static_cast<size_t>(align), sizeof(void*));
+        void* p = nullptr;
+        if (::posix_memalign(&p, a, n ? n : 1) != 0) throw std::bad_alloc();
+        noteAlloc(p);
+        return p;
+    }
+
+    void release(void* p) {
+        if (!p) return;
+        live_bytes -= malloc_usable_size(p);
+        std::free(p);
+    }
+
+}
+
+void* operator new(size_t n) { return allocate(n); }
+void* operator new[](size_t n) { return allocate(n); }
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void* operator new(size_t n, std::align_val_t a) { return allocate(n, a); }
+void* operator new[](size_t n, std::align_val_t a) { return allocate(n, a); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::vector<size_t> sizes{ 1 << 10, 1 << 20, 100 << 20 };
+        std::string family;
+        double min_time = 0.2;
+        size_t std_max_bytes = 64 << 10;     // std::regex recurses per byte
+        size_t to_regex_max_states = 64;     // state elimination blows up
+    };
+
+    struct Family {
+        std::string name;
+        std::string pattern;
+        // an input of about the given size that is in the language (match)
+        // and one with scattered occurrences (findAll)
+        std::function<std::string(size_t, std::mt19937&)> member, haystack;
+    };
+
+    struct Result {
+        const char* op;
+        const char* engine = "mgr";
+        size_t bytes = 0;
+        size_t iterations = 0;
+        double ns_per_op = 0;
+        size_t states = 0;
+        size_t matches = 0;
+        size_t peak_heap = 0;
+    };
+
+    std::string randomText(size_t n, std::mt19937& rng, const char* alphabet) {
+        const size_t k = std::strlen(alphabet);
+        std::string s(n, ' ');
+        for (char& c : s) c = alphabet[rng() % k];
+        return s;
+    }
+
+    // plants `word` about every `gap` bytes
+    void plant(std::string& s, const std::string& word, size_t gap, std::mt19937& rng) {
+        if (s.size() < word.size()) return;
+        for (size_t at = rng() % gap; at + word.size() <= s.size(); at += gap / 2 + rng() % gap)
+            s.replace(at, word.size(), word);
+    }
+
+    std::vector<std::string> words(size_t n) {
+        std::vector<std::string> res;
+        std::mt19937 rng(17);
+        for (size_t i = 0; i < n; ++i)
+            res.push_back(randomText(4 + rng() % 6, rng, "abcdefghijklmnopqrstuvwxyz"));
+        return res;
+    }
+
+    // concatenates pieces until the size is reached
+    template<typename F>
+    std::string repeatUntil(size_t n, F&& piece) {
+        std::string s;
+        s.reserve(n + 64);
+        while (s.size() < n) s += piece();
+        return s;
+    }
+
+    std::vector<Family> families() {
+        std::vector<Family> res;
+        const std::string lower = "abcdefghijklmnopqrstuvwxyz ";
+
+        res.push_back({ "literal", "(GET /index&.html )+",
+            [](size_t n, std::mt19937&) { return repeatUntil(n, [] { return std::string("GET /index.html "); }); },
+            [lower](size_t n, std::mt19937& rng) {
+                std::string s = randomText(n, rng, lower.c_str());
+                plant(s, "GET /index.html ", 4096, rng);
+                return s;
+            } });
+
+        std::vector<std::string> dict = words(256);
+        std::string alt = "((";
+        for (size_t i = 0; i < dict.size(); ++i) alt += (i ? "|" : "") + dict[i];
+        alt += ") )+";
+        res.push_back({ "alternation", alt,
+            [dict](size_t n, std::mt19937& rng) {
+                return repeatUntil(n, [&] { return dict[rng() % dict.size()] + ' '; });
+            },
+            [dict, lower](size_t n, std::mt19937& rng) {
+                std::string s = randomText(n, rng, lower.c_str());
+                for (size_t at = 0; at + 16 < n; at += 64 + rng() % 64) {
+                    const std::string& w = dict[rng() % dict.size()];
+                    s.replace(at, w.size() + 1, w + ' ');
+                }
+                return s;
+            } });
+
+        // blocks of (a|b)*c(a|bb)*, then d
+        auto stars = [](std::mt19937& rng, size_t len) {
+            std::string block;
+            for (size_t i = rng() % len; i > 0; --i) block += "ab"[rng() % 2];
+            block += 'c';
+            for (size_t i = rng() % len; i > 0; --i) block += rng() % 2 ? "a" : "bb";
+            return block;
+        };
+        res.push_back({ "nested_stars", "((a|b)*c(a|bb)*)*d",
+            [stars](size_t n, std::mt19937& rng) {
+                return repeatUntil(n, [&] { return stars(rng, 16); }) + 'd';
+            },
+            [stars](size_t n, std::mt19937& rng) {
+                std::string s = repeatUntil(n, [&] { return stars(rng, 4) + (rng() % 4 ? "x" : "d"); });
+                s.resize(n);
+                return s;
+            } });
+
+        auto bounded = [](std::mt19937& rng) {
+            std::string block;
+            for (size_t i = 3 + rng() % 10; i > 0; --i) block += "ab"[rng() % 2];
+            return block + std::string(2 + rng() % 39, 'c');
+        };
+        res.push_back({ "bounded_repeat", "((a|b){3,12}c{2,40})+",
+            [bounded](size_t n, std::mt19937& rng) { return repeatUntil(n, [&] { return bounded(rng); }); },
+            [bounded](size_t n, std::mt19937& rng) {
+                std::string s = repeatUntil(n, [&] { return bounded(rng) + "x" + std::string(rng() % 8, 'a'); });
+                s.resize(n);
+                return s;
+            } });
+
+        res.push_back({ "wildcard", "x.*y.?.?z",
+            [](size_t n, std::mt19937& rng) {
+                return "x" + randomText(n, rng, "abcdefghijklmnopqrstuvwxyz ") + "y12z";
+            },
+            [](size_t n, std::mt19937& rng) {
+                std::string s = randomText(n, rng, "abcdefghijklmnopqrstuvw ");
+                plant(s, "y12z", 2048, rng);
+                if (n > 8) s[n / 8] = 'x';
+                return s;
+            } });
+        return res;
+    }
+
+    // the 2_lab dialect in ECMAScript syntax
+    std::string toEcma(const std::string& pattern) {
+        std::string res;
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            char c = pattern[i];
+            if (c == '&' && i + 1 < pattern.size()) {
+                char e = pattern[++i];
+                if (std::isalnum(static_cast<unsigned char>(e))) res += e;
+                else { res += '\\'; res += e; }
+            } else if (c == '.') {
+                res += "[ -~]";
+            } else if (c == '{' && i + 1 < pattern.size() && pattern[i + 1] == ',') {
+                res += "{0";
+            } else if (c == '$' && i + 1 == pattern.size()) {
+                // regex_match anchors already
+            } else {
+                res += c;
+            }
+        }
+        return res;
+    }
+
+    size_t maxRssKb() {
+        rusage ru{};
+        getrusage(RUSAGE_SELF, &ru);
+        return static_cast<size_t>(ru.ru_maxrss);
+    }
+
+    template<typename F>
+    Result measure(const char* op, const Options& opts, F&& body) {
+        Result r{ op };
+        size_t base = live_bytes.load();
+        peak_bytes = base;
+        auto begin = Clock::now();
+        double elapsed = 0;
+        do {
+            r.matches = body();
+            ++r.iterations;
+            elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+        } while (elapsed < opts.min_time);
+        r.ns_per_op = elapsed * 1e9 / static_cast<double>(r.iterations);
+        r.peak_heap = peak_bytes.load() - base;
+        return r;
+    }
+
+    void report(const Family& f, const Result& r) {
+        double bps = r.bytes && r.ns_per_op > 0 ? static_cast<double>(r.bytes) * 1e9 / r.ns_per_op : 0;
+        std::printf("{\"family\":\"%s\",\"op\":\"%s\",\"engine\":\"%s\",\"bytes\":%zu,\"iterations\":%zu,"
+                    "\"ns_per_op\":%.1f,\"bytes_per_sec\":%.0f,\"states\":%zu,\"matches\":%zu,"
+                    "\"peak_heap_bytes\":%zu,\"max_rss_kb\":%zu}\n",
+                    f.name.c_str(), r.op, r.engine, r.bytes, r.iterations, r.ns_per_op, bps,
+                    r.states, r.matches, r.peak_heap, maxRssKb());
+        std::fflush(stdout);
+    }
+
+    void skipped(const Family& f, const char* op, const char* why) {
+        std::printf("{\"family\":\"%s\",\"op\":\"%s\",\"skipped\":\"%s\"}\n", f.name.c_str(), op, why);
+    }
+
+    void runFamily(const Family& f, const Options& opts) {
+        // pattern-only stages
+        {
+            mgr::Tokenizer tk;
+            report(f, measure("tokenize", opts, [&] { return tk.Tokenize(f.pattern + "$").size(); }));
+        }
+        mgr::regex rx(f.pattern);
+        rx.tk.Tokenize(rx.pattern());
+        report(f, measure("parse", opts, [&] { rx.TokenToTree(); return size_t(0); }));
+
+        mgr::DKA raw;
+        Result built = measure("TreeToDKA", opts, [&] { raw.TreeToDKA(rx.tr); return size_t(0); });
+        built.states = raw.states.size();
+        report(f, built);
+
+        mgr::DKA min;
+        Result minimized{ "minimize" };
+        {
+            size_t base = live_bytes.load();
+            peak_bytes = base;
+            double elapsed = 0;
+            while (elapsed < opts.min_time || minimized.iterations == 0) {
+                min = raw;
+                auto begin = Clock::now();
+                min.minimize();
+                elapsed += std::chrono::duration<double>(Clock::now() - begin).count();
+                ++minimized.iterations;
+            }
+            minimized.ns_per_op = elapsed * 1e9 / static_cast<double>(minimized.iterations);
+            minimized.peak_heap = peak_bytes.load() - base;
+            minimized.states = min.states.size();
+        }
+        report(f, minimized);
+
+        // the table is the one aligned allocation
+        Result table = measure("CompiledDKA", opts, [&] { return mgr::CompiledDKA(min).stateCount(); });
+        table.states = table.matches;
+        table.matches = 0;
+        report(f, table);
+
+        mgr::regex wild(".*");
+        wild.compile();
+        mgr::DKA product;
+        Result inter = measure("intersect", opts, [&] { product = min.intersect(wild.dka); return size_t(0); });
+        inter.states = product.states.size();
+        report(f, inter);
+
+        if (min.states.size() <= opts.to_regex_max_states) {
+            size_t len = 0;
+            Result back = measure("to_regex", opts, [&] { len = min.to_regex().size(); return size_t(0); });
+            back.states = min.states.size();
+            back.matches = len;   // length of the produced expression
+            report(f, back);
+        } else {
+            skipped(f, "to_regex", "too many states");
+        }
+
+        rx.compile();
+        const mgr::SharedRegex shared(rx);
+        std::regex std_rx(toEcma(f.pattern), std::regex::ECMAScript | std::regex::optimize);
+
+        for (size_t size : opts.sizes) {
+            std::mt19937 rng(static_cast<uint32_t>(size));
+            const std::string member = f.member(size, rng);
+            const std::string haystack = f.haystack(size, rng);
+
+            Result m = measure("match", opts, [&] { return size_t(rx.compiled.match(member)); });
+            m.bytes = member.size();
+            m.states = rx.compiled.stateCount();
+            report(f, m);
+
+            Result all = measure("findAll", opts, [&] { return rx.findAll(haystack).size(); });
+            all.bytes = haystack.size();
+            all.states = rx.compiled.stateCount();
+            report(f, all);
+
+            // the member cut into short records, checked as one batch
+            std::vector<std::string_view> records;
+            for (size_t at = 0; at < member.size(); at += 32)
+                records.push_back(std::string_view(member).substr(at, 32));
+            Result batch = measure("matchAll", opts, [&] { return shared.matchAll(records).count(); });
+            batch.bytes = member.size();
+            batch.states = rx.compiled.stateCount();
+            report(f, batch);
+
+            if (size > opts.std_max_bytes) {
+                skipped(f, "std::regex", "input larger than --std-max-bytes");
+                continue;
+            }
+            Result sm = measure("match", opts, [&] { return size_t(std::regex_match(member, std_rx)); });
+            sm.engine = "std";
+            sm.bytes = member.size();
+            report(f, sm);
+
+            Result sa = measure("findAll", opts, [&] {
+                return size_t(std::distance(std::sregex_iterator(haystack.begin(), haystack.end(), std_rx),
+                                            std::sregex_iterator()));
+            });
+            sa.engine = "std";
+            sa.bytes = haystack.size();
+            report(f, sa);
+        }
+    }
+
+    size_t parseSize(const std::string& s) {
+        size_t pos = 0;
+        size_t n = std::stoull(s, &pos);
+        std::string unit = s.substr(pos);
+        if (unit == "K" || unit == "KB") return n << 10;
+        if (unit == "M" || unit == "MB") return n << 20;
+        if (unit == "G" || unit == "GB") return n << 30;
+        if (unit.empty()) return n;
+        throw std::invalid_argument("Bad size: " + s);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+            std::string value = argv[++i];
+            if (arg == "--sizes") {
+                opts.sizes.clear();
+                for (size_t at = 0; at <= value.size();) {
+                    size_t comma = std::min(value.find(',', at), value.size());
+                    opts.sizes.push_back(parseSize(value.substr(at, comma - at)));
+                    at = comma + 1;
+                }
+            } else if (arg == "--family") {
+                opts.family = value;
+            } else if (arg == "--min-time") {
+                opts.min_time = std::stod(value);
+            } else if (arg == "--std-max-bytes") {
+                opts.std_max_bytes = parseSize(value);
+            } else if (arg == "--to-regex-max-states") {
+                opts.to_regex_max_states = std::stoull(value);
+            } else {
+                throw std::invalid_argument("Unknown option " + arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << '\n'
+                  << "usage: " << argv[0] << " [--sizes 1K,1M,100M] [--family name] [--min-time s]"
+                     " [--std-max-bytes n] [--to-regex-max-states n]\n";
+        return 2;
+    }
+
+    for (const Family& f : families())
+        if (opts.family.empty() || opts.family == f.name)
+            runFamily(f, opts);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "my_regex.hpp"
+#include "regex_compile/CodeGen.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// regex_codegen [-o out.cpp] [-f function] [-n namespace] [--computed-goto] [--utf8|--bytes] pattern
+int main(int argc, char** argv) {
+    mgr::CodeGenOptions opts;
+    mgr::CompileOptions compile{ .prefilter = false };
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!std::strcmp(arg, "-o") && has_value) output = argv[++i];
+        else if (!std::strcmp(arg, "-f") && has_value) opts.function = argv[++i];
+        else if (!std::strcmp(arg, "-n") && has_value) opts.name_space = argv[++i];
+        else if (!std::strcmp(arg, "--computed-goto")) opts.computed_goto = true;
+        else if (!std::strcmp(arg, "--utf8")) compile.encoding = mgr::Encoding::Utf8;
+        else if (!std::strcmp(arg, "--bytes")) compile.encoding = mgr::Encoding::Bytes;
+        else if (opts.pattern.empty() && arg[0] != '-') opts.pattern = arg;
+        else {
+            std::cerr << "usage: " << argv[0]
+                      << " [-o out.cpp] [-f function] [-n namespace] [--computed-goto] [--utf8|--bytes] pattern\n";
+            return 2;
+        }
+    }
+    if (opts.pattern.empty()) {
+        std::cerr << argv[0] << ": no pattern\n";
+        return 2;
+    }
+
+    try {
+        mgr::regex rx(opts.pattern);
+        rx.compile(compile);
+        std::string code = mgr::generateCpp(rx.compiled, opts);
+        if (output.empty()) {
+            std::cout << code;
+        } else {
+            std::ofstream file(output, std::ios::binary);
+            if (!(file << code)) {
+                std::cerr << argv[0] << ": cannot write " << output << '\n';
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "my_regex.hpp"
+#include "regex_compile/ThreadPool.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// regex_grep [-c] [-n] [-x] [-v] [-H|-h] [-j threads] [--mode buffer|line]
+//            [--utf8|--bytes] pattern [file...]
+//
+// Prints the lines of the files (stdin without any) that contain a match
+// of the pattern, in the mgr::regex dialect. Files are mapped read-only
+// and lines split with memchr. --mode buffer (the default) searches the
+// whole mapping at once and only looks at the lines the matches land in;
+// --mode line runs the DFA on every line, which -x and -v always use.
+// -j processes that many files at a time, output stays in file order.
+// Exit status: 0 if a line was selected, 1 if none, 2 on errors.
+
+namespace {
+
+    struct Options {
+        bool count = false, numbers = false, whole_line = false, invert = false;
+        int names = -1;               // -1: only with several files
+        size_t threads = 1;
+        bool line_mode = false;
+        mgr::CompileOptions compile;
+        std::string pattern;
+        std::vector<std::string> files;
+    };
+
+    // Read-only mapping of a whole file; stdin and other unmappable
+    // inputs are read into memory instead.
+    class Input {
+    public:
+        explicit Input(const std::string& path) {
+            int fd = path == "-" ? 0 : ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error(path + ": " + std::strerror(errno));
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+                size = static_cast<size_t>(st.st_size);
+                addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    addr = nullptr;
+                } else {
+                    ::madvise(addr, size, MADV_SEQUENTIAL);
+                }
+            }
+            if (!addr) {
+                char buf[1 << 16];
+                ssize_t n;
+                while ((n = ::read(fd, buf, sizeof buf)) > 0) owned.append(buf, static_cast<size_t>(n));
+                if (n < 0) {
+                    if (fd != 0) ::close(fd);
+                    throw std::runtime_error(path + ": " + std::strerror(errno));
+                }
+            }
+            if (fd != 0) ::close(fd);
+        }
+        ~Input() {
+            if (addr) ::munmap(addr, size);
+        }
+        Input(const Input&) = delete;
+        Input& operator=(const Input&) = delete;
+
+        std::string_view text() const {
+            return addr ? std::string_view(static_cast<const char*>(addr), size) : std::string_view(owned);
+        }
+
+    private:
+        void* addr = nullptr;
+        size_t size = 0;
+        std::string owned;
+    };
+
+    // Output of one file. With a stream it is written out in blocks,
+    // otherwise kept until the file's turn comes.
+    struct Sink {
+        std::FILE* stream = nullptr;
+        std::string buf;
+        size_t selected = 0;
+
+        void write(std::string_view s) {
+            buf.append(s);
+            if (stream && buf.size() >= (1 << 20)) flush();
+        }
+        void flush() {
+            if (stream && !buf.empty()) std::fwrite(buf.data(), 1, buf.size(), stream);
+            buf.clear();
+        }
+    };
+
+    class Grep {
+    public:
+        Grep(const Options& opts, const mgr::CompiledDKA& dka) : opts(opts), dka(dka) {}
+
+        void run(const std::string& name, std::string_view text, Sink& out) const {
+            File f{ name, text, out };
+            if (opts.line_mode || opts.whole_line || opts.invert) byLine(f);
+            else byBuffer(f);
+            if (opts.count) {
+                if (showNames()) out.write(name + ":");
+                out.write(std::to_string(out.selected) + "\n");
+            }
+        }
+
+        inline bool showNames() const {
+            return opts.names == 1 || (opts.names == -1 && opts.files.size() > 1);
+        }
+
+    private:
+        const Options& opts;
+        const mgr::CompiledDKA& dka;
+
+        struct File {
+            const std::string& name;
+            std::string_view text;
+            Sink& out;
+            size_t line_no = 1;       // of the line starting at counted_to
+            size_t counted_to = 0;
+        };
+
+        // end of the line starting at pos, the '\n' excluded
+        static size_t lineEnd(std::string_view text, size_t pos) {
+            const void* nl = std::memchr(text.data() + pos, '\n', text.size() - pos);
+            return nl ? static_cast<size_t>(static_cast<const char*>(nl) - text.data()) : text.size();
+        }
+
+        bool selects(std::string_view line) const {
+            bool hit = opts.whole_line ? dka.match(line) : dka.find(line).has_value();
+            return hit != opts.invert;
+        }
+
+        void emit(File& f, size_t begin, size_t end) const {
+            ++f.out.selected;
+            if (opts.count) return;
+            if (showNames()) {
+                f.out.write(f.name);
+                f.out.write(":");
+            }
+            if (opts.numbers) {
+                f.line_no += static_cast<size_t>(
+                    std::count(f.text.begin() + f.counted_to, f.text.begin() + begin, '\n'));
+                f.counted_to = begin;
+                f.out.write(std::to_string(f.line_no) + ":");
+            }
+            f.out.write(f.text.substr(begin, end - begin));
+            f.out.write("\n");
+        }
+
+        void byLine(File& f) const {
+            for (size_t pos = 0; pos < f.text.size();) {
+                size_t end = lineEnd(f.text, pos);
+                if (selects(f.text.substr(pos, end - pos))) emit(f, pos, end);
+                pos = end + 1;
+            }
+        }
+
+        // A match may run across a newline (&s, an escaped '\n'): then
+        // its first line is checked on its own. No match begins before
+        // the one found, so no earlier line can hold one.
+        void byBuffer(File& f) const {
+            // one backward pass over the file instead of one per find
+            std::optional<mgr::StartIndex> starts;
+            if (dka.scansBackwards()) starts.emplace(dka, f.text);
+            for (size_t pos = 0; pos < f.text.size();) {
+                auto m = starts ? dka.find(f.text, pos, *starts) : dka.find(f.text, pos);
+                if (!m || m->begin >= f.text.size()) return;
+                const void* prev = m->begin == pos ? nullptr
+                    : ::memrchr(f.text.data() + pos, '\n', m->begin - pos);
+                size_t begin = prev ? static_cast<size_t>(static_cast<const char*>(prev) - f.text.data()) + 1 : pos;
+                size_t end = lineEnd(f.text, m->begin);
+                if (m->end <= end || selects(f.text.substr(begin, end - begin))) emit(f, begin, end);
+                pos = end + 1;
+            }
+        }
+    };
+
+    [[noreturn]] void usage(const char* self) {
+        std::cerr << "usage: " << self
+                  << " [-c] [-n] [-x] [-v] [-H|-h] [-j threads] [--mode buffer|line] [--utf8|--bytes]"
+                     " pattern [file...]\n";
+        std::exit(2);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    bool have_pattern = false;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!std::strcmp(arg, "-c")) opts.count = true;
+        else if (!std::strcmp(arg, "-n")) opts.numbers = true;
+        else if (!std::strcmp(arg, "-x")) opts.whole_line = true;
+        else if (!std::strcmp(arg, "-v")) opts.invert = true;
+        else if (!std::strcmp(arg, "-H")) opts.names = 1;
+        else if (!std::strcmp(arg, "-h")) opts.names = 0;
+        else if (!std::strcmp(arg, "-j") && has_value) opts.threads = std::max(1, std::atoi(argv[++i]));
+        else if (!std::strcmp(arg, "--mode") && has_value) {
+            std::string mode = argv[++i];
+            if (mode != "buffer" && mode != "line") usage(argv[0]);
+            opts.line_mode = mode == "line";
+        }
+        else if (!std::strcmp(arg, "--utf8")) opts.compile.encoding = mgr::Encoding::Utf8;
+        else if (!std::strcmp(arg, "--bytes")) opts.compile.encoding = mgr::Encoding::Bytes;
+        else if (!have_pattern && (arg[0] != '-' || arg[1] == '\0')) {
+            opts.pattern = arg;
+            have_pattern = true;
+        }
+        else if (have_pattern && (arg[0] != '-' || arg[1] == '\0')) opts.files.push_back(arg);
+        else usage(argv[0]);
+    }
+    if (!have_pattern || opts.pattern.empty()) usage(argv[0]);
+    if (opts.files.empty()) opts.files.push_back("-");
+
+    mgr::regex rx(opts.pattern);
+    try {
+        rx.compile(opts.compile);
+    } catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 2;
+    }
+    const Grep grep(opts, rx.compiled);
+
+    std::vector<Sink> sinks(opts.files.size());
+    std::vector<std::string> errors(opts.files.size());
+    auto work = [&](size_t i) {
+        try {
+            Input in(opts.files[i]);
+            grep.run(opts.files[i] == "-" ? "(standard input)" : opts.files[i], in.text(), sinks[i]);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
+    };
+
+    if (opts.threads == 1 || opts.files.size() == 1) {
+        for (size_t i = 0; i < opts.files.size(); ++i) {
+            sinks[i].stream = stdout;
+            work(i);
+            sinks[i].flush();
+            if (!errors[i].empty()) std::cerr << argv[0] << ": " << errors[i] << '\n';
+        }
+    } else {
+        mgr::ThreadPool pool(std::min(opts.threads, opts.files.size()) - 1);
+        pool.parallelFor(opts.files.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) work(i);
+        });
+        for (size_t i = 0; i < opts.files.size(); ++i) {
+            sinks[i].stream = stdout;
+            sinks[i].flush();
+            if (!errors[i].empty()) std::cerr << argv[0] << ": " << errors[i] << '\n';
+        }
+    }
+
+    bool failed = false, selected = false;
+    for (size_t i = 0; i < opts.files.size(); ++i) {
+        failed |= !errors[i].empty();
+        selected |= sinks[i].selected != 0;
+    }
+    std::fflush(stdout);
+    return failed ? 2 : selected ? 0 : 1;
+}
@@ -1,134 +1,198 @@
 #include "my_regex.hpp"
+#include "regex_cache.hpp"
 #include "regex_compile/regex_tree.hpp"
 #include "regex_compile/token.hpp"
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 
 namespace mgr {
-    NodePtr regex::ParseExpr() {
+    void regex::TokenToTree() {
+        if (tv.empty())
+            throw std::logic_error("Token list is empty");
+        // reuse the previous arena unless someone still holds it
+        tr.attach(nullptr, 0);
+        if (nodes && nodes.use_count() == 1) nodes->clear();
+        else nodes = std::make_shared<RegexArena>();
+        scratch.clear();
+        group_names.clear();
+        cur = 0;
+
+        NodeId root = ParseExpr();
+        if (!atEnd())
+            fail("Unexpected ')'");
+        tr.attach(nodes, root);
+    }
+
+    NodeId regex::ParseExpr() {
         auto root = ParseAlternation();
         return root;
     }
 
-    NodePtr regex::ParseAlternation() {
+    NodeId regex::ParseAlternation() {
         auto left = ParseConcat();
-        while (!tv.empty() && GetTokenType(tv.front()) == TokenType::Pipe) {
-            tv.pop_front();
+        while (accept(TokenType::Pipe)) {
             auto right = ParseConcat();
-            Alternation alt;
-            alt.children.push_back(left);
-            alt.children.push_back(right);
-            left = std::make_shared<Node>(std::move(alt));
+            const NodeId pair[] = { left, right };
+            left = nodes->alternation(pair);
         }
         return left;
     }
 
-    NodePtr regex::ParseConcat() {
-        std::vector<NodePtr> nodes;
+    NodeId regex::ParseConcat() {
+        // children are collected on a stack shared by nested calls
+        const size_t base = scratch.size();
 
-        while (!tv.empty()) {
-            TokenType type = GetTokenType(tv.front());
+        while (!atEnd()) {
+            TokenType type = peek();
             if (type == TokenType::Pipe || type == TokenType::RParen || type == TokenType::End)
                 break;
 
-            nodes.push_back(ParseRepeat());
+            NodeId child = ParseRepeat();
+            scratch.push_back(child);
         }
 
-        if (nodes.empty())
-            throw std::logic_error("Error: Empty concat");
+        if (scratch.size() == base)
+            fail("Error: Empty concat");
 
-        if (!tv.empty() && GetTokenType(tv.front()) == TokenType::End) {
-            tv.pop_front();
-            nodes.push_back(std::make_shared<Node>(End{}));
-        }
+        if (accept(TokenType::End))
+            scratch.push_back(nodes->end());
+
+        NodeId res = nodes->concat(std::span<const NodeId>(scratch.data() + base, scratch.size() - base));
+        scratch.resize(base);
+        return res;
+    }
 
-        Concat c;
-        c.children = std::move(nodes);
-        return std::make_shared<Node>(std::move(c));
+    int regex::expectNumber(const char* what) {
+        if (atEnd() || !std::holds_alternative<TokenNumber>(tv[cur]))
+            fail(what);
+        return std::get<TokenNumber>(tv[cur++]).number;
     }
 
-    NodePtr regex::ParseRepeat() {
+    NodeId regex::ParseRepeat() {
         auto node = ParseAtom();
-        if (tv.empty()) return node;
+        if (atEnd()) return node;
 
-        TokenType type = GetTokenType(tv.front());
+        const size_t at = cur;
         int min = 0, max = INFINITY;
 
-        if (type == TokenType::Plus) {
+        if (accept(TokenType::Plus)) {
             min = 1; max = INFINITY;
-            tv.pop_front();
-        } else if (type == TokenType::Star) {
+        } else if (accept(TokenType::Star)) {
             min = 0; max = INFINITY;
-            tv.pop_front();
-        } else if (type == TokenType::Question) {
+        } else if (accept(TokenType::Question)) {
             min = 0; max = 1;
-            tv.pop_front();
-        } else if (type == TokenType::LCurly) {
-            tv.pop_front();
-
-            if (GetTokenType(tv.front()) == TokenType::Comma) {
-                tv.pop_front();
+        } else if (accept(TokenType::LCurly)) {
+            if (accept(TokenType::Comma)) {
                 min = 0;
-                if (!std::holds_alternative<TokenNumber>(tv.front()))
-                    throw std::logic_error("Expected upper bound after ','");
-                max = std::get<TokenNumber>(tv.front()).number;
-                tv.pop_front();
-            } else if (std::holds_alternative<TokenNumber>(tv.front())) {
-                min = std::get<TokenNumber>(tv.front()).number;
-                tv.pop_front();
-
-                if (GetTokenType(tv.front()) == TokenType::Comma) {
-                    tv.pop_front();
-                    if (std::holds_alternative<TokenNumber>(tv.front())) {
-                        max = std::get<TokenNumber>(tv.front()).number;
-                        tv.pop_front();
-                    } else {
-                        max = INFINITY;
-                    }
-                } else {
+                max = expectNumber("Expected upper bound after ','");
+            } else if (!atEnd() && peek() == TokenType::Number) {
+                min = expectNumber("Expected number after '{'");
+                if (accept(TokenType::Comma))
+                    max = !atEnd() && peek() == TokenType::Number ? expectNumber("Expected upper bound after ','") : INFINITY;
+                else
                     max = min;
-                }
             } else {
-                throw std::logic_error("Expected number or ',' after '{'");
+                fail("Expected number or ',' after '{'");
             }
 
-            if (GetTokenType(tv.front()) != TokenType::RCurly)
-                throw std::logic_error("Expected '}' after repeat bounds");
-            tv.pop_front();
+            if (!accept(TokenType::RCurly))
+                fail("Expected '}' after repeat bounds");
         } else {
             return node;
         }
 
-        auto repeat = std::make_shared<Node>(Repeat{min, max});
-        tr.addKid(node, repeat);
-        return repeat;
+        if (min > max)
+            throw ParseError("Invalid repeat bounds", tk.Offsets[at]);
+        return nodes->repeat(node, min, max);
     }
 
-    NodePtr regex::ParseAtom() {
-        if (tv.empty())
-            throw std::logic_error("Unexpected end in ParseAtom");
-
-        auto tok = tv.front();
-        tv.pop_front();
+    NodeId regex::ParseAtom() {
+        if (atEnd())
+            fail("Unexpected end in ParseAtom");
 
+        const TokenVariant& tok = tv[cur++];
         switch (GetTokenType(tok)) {
-            case TokenType::Literal:
+            case TokenType::Literal: {
+                // a multibyte character is one atom, so é+ repeats all of it
+                std::string bytes(1, std::get<TokenSymbol>(tok).symbol);
+                for (size_t i = cur; bytes.size() < 4 && i < tv.size() && GetTokenType(tv[i]) == TokenType::Literal; ++i)
+                    bytes.push_back(std::get<TokenSymbol>(tv[i]).symbol);
+                const size_t n = utf8Length(bytes);
+                if (n <= 1)
+                    return nodes->literal(bytes[0]);
+                NodeId seq[4];
+                for (size_t i = 0; i < n; ++i)
+                    seq[i] = nodes->literal(bytes[i]);
+                cur += n - 1;
+                return nodes->concat(std::span<const NodeId>(seq, n));
+            }
             case TokenType::Escape:
-                return std::make_shared<Node>(Literal{std::get<TokenSymbol>(tok).symbol});
+                return nodes->literal(std::get<TokenSymbol>(tok).symbol);
             case TokenType::Dot:
-                return std::make_shared<Node>(Wildcard{});
+                return nodes->wildcard();
+            case TokenType::Class: {
+                const TokenClass& cls = std::get<TokenClass>(tok);
+                return nodes->charClass(cls.ranges, cls.negated);
+            }
             case TokenType::End:
-                return std::make_shared<Node>(End{});
+                return nodes->end();
             case TokenType::LParen: {
+                int group = 0;
+                if (!atEnd() && peek() == TokenType::GroupCreate) {
+                    const std::string& name = std::get<TokenName>(tv[cur]).name;
+                    if (std::find(group_names.begin(), group_names.end(), name) != group_names.end())
+                        fail("Duplicate group name");
+                    group_names.push_back(name);
+                    group = static_cast<int>(group_names.size());
+                    ++cur;
+                }
                 auto inner = ParseExpr();
-                if (tv.empty() || GetTokenType(tv.front()) != TokenType::RParen)
-                    throw std::logic_error("Expected closing ')'");
-                tv.pop_front();
-                return inner;
+                if (!accept(TokenType::RParen))
+                    fail("Expected closing ')'");
+                return group ? nodes->group(inner, group) : inner;
             }
             default:
-                throw std::logic_error("Unexpected token in ParseAtom");
+                --cur;
+                fail("Unexpected token in ParseAtom");
         }
     }
 
+    std::vector<std::pair<size_t, size_t>> regex::findAll(const string& str) {
+        std::vector<std::pair<size_t, size_t>> res;
+        compiled.forEachMatch(str, [&res](const Match& m) {
+            res.emplace_back(m.begin, m.end);
+        });
+        return res;
+    }
+
+    std::vector<std::vector<size_t>> regex::captures(std::string_view text) const {
+        std::vector<std::vector<size_t>> res;
+        forEachCapture(text, [&res](std::span<const size_t> groups) {
+            res.emplace_back(groups.begin(), groups.end());
+        });
+        return res;
+    }
+
+    const TaggedDKA* CaptureAutomaton::get() const {
+        std::call_once(built, [this] {
+            NFA nfa = NFA::fromTree(tree, opts.unroll_limit, opts.encoding);
+            if (!nfa.counters.empty()) return;
+            try {
+                dka = std::make_unique<const TaggedDKA>(nfa);
+            } catch (const std::length_error&) {
+            }
+        });
+        return dka.get();
+    }
+
+    void regex::compile(RegexCache& cache, const CompileOptions& opts) {
+        compiled = *cache.get(prompt, opts);
+        // nothing of an earlier compile() may answer for this automaton
+        tr = RegexTree();
+        dka = DKA();
+        group_names.clear();
+        capture_dka.reset();
+    }
+
 }
\ No newline at end of file
@@ -2,23 +2,64 @@
 #define MY_REGEX_HPP_
 
 #include "regex_compile/regex_tree.hpp"
+#include "regex_compile/RegexArena.hpp"
 #include "regex_compile/token.hpp"
 #include "regex_compile/DKA.hpp"
+#include "regex_compile/CompiledDKA.hpp"
+#include "regex_compile/LazyDKA.hpp"
+#include "regex_compile/Prefilter.hpp"
+#include "regex_compile/Matcher.hpp"
+#include "regex_compile/TaggedDKA.hpp"
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
-#include <list>
 
 #define tv tk.Tokens
 
 using std::string;
 using std::get;
-using iter = std::list<mgr::TokenVariant>::iterator;
 
 class RegexParserTest;
 
 namespace mgr {
 
+class RegexCache;
+
+struct CompileOptions {
+    MinimizeAlgo minimize = MinimizeAlgo::Hopcroft;
+    bool prefilter = true;
+    size_t unroll_limit = NFA::DEFAULT_UNROLL_LIMIT;
+    // what '.' matches, see Encoding
+    Encoding encoding = Encoding::Ascii;
+
+    bool operator==(const CompileOptions&) const = default;
+};
+
+// Tagged automaton for the groups of a parsed pattern, built by the
+// first get() (once, thread-safe) with the options the pattern was
+// compiled with. Null for patterns a tagged DFA cannot take: a repeat
+// over the unroll limit (counters carry no tags) or more than
+// TaggedDKA::MAX_STATES states.
+class CaptureAutomaton {
+public:
+    CaptureAutomaton(RegexTree tree, const CompileOptions& opts) : tree(std::move(tree)), opts(opts) {}
+    const TaggedDKA* get() const;
+
+private:
+    RegexTree tree;
+    CompileOptions opts;
+    mutable std::once_flag built;
+    mutable std::unique_ptr<const TaggedDKA> dka;
+};
+
+// Parser, automata and matchers of one pattern. Matching is const, but
+// the parse state is not; to match from several threads share a
+// SharedRegex (regex_shared.hpp) instead of copying this.
 class regex {
 public:
     RegexTree tr;
@@ -26,47 +67,121 @@ public:
 private:
     string prompt;
 
-    TokenType GetTokenType(const TokenVariant& v) {
+    static TokenType GetTokenType(const TokenVariant& v) {
         TokenType res;
         std::visit([&res](const auto& tok) { res = tok.type; }, v);
         return res;
     }
 
+    // cursor into tk.Tokens
+    size_t cur = 0;
+
+    inline bool atEnd() const { return cur >= tv.size(); }
+    inline TokenType peek() const { return GetTokenType(tv[cur]); }
+    inline bool accept(TokenType type) {
+        if (atEnd() || peek() != type) return false;
+        ++cur;
+        return true;
+    }
+    [[noreturn]] inline void fail(const char* what) const {
+        throw ParseError(what, cur < tk.Offsets.size() ? tk.Offsets[cur] : prompt.size());
+    }
+    int expectNumber(const char* what);
+
     NodeType GetNodeTypeFromToken(const TokenType& tok);
 
-    NodePtr ParseExpr();
-    NodePtr ParseAlternation();
-    NodePtr ParseConcat();
-    NodePtr ParseRepeat();
-    NodePtr ParseAtom();
+    // the parser builds into an arena, tr is a view of it
+    std::shared_ptr<RegexArena> nodes;
+    std::vector<NodeId> scratch;
+    // names of the (<name>...) groups, group i + 1 is group_names[i]
+    std::vector<std::string> group_names;
+    // set by compile() when there are groups, shared by copies
+    std::shared_ptr<const CaptureAutomaton> capture_dka;
+
+    NodeId ParseExpr();
+    NodeId ParseAlternation();
+    NodeId ParseConcat();
+    NodeId ParseRepeat();
+    NodeId ParseAtom();
 
 
 
 public:
     DKA dka;
+    CompiledDKA compiled;
     Tokenizer tk;
-    void TokenToTree() {
-        if (tv.begin() == tv.end())
-            throw std::logic_error("Token list is empty");
-        tr.makeRoot<NodePtr>(ParseExpr());
-    }
+    // Builds tr from tk.Tokens. Errors are ParseError with the offset of
+    // the offending token. Buffers are reused by the next parse. Unescaped
+    // UTF-8 characters are single atoms; &-escaped bytes stay bytes.
+    void TokenToTree();
     inline regex(string str) : prompt(std::move(str)) {
         if (prompt.back() != '$')
             prompt.push_back('$');
     }
 
-    inline void compile() {
+    // Tokenize and build tr only
+    inline void parse() {
         tk.Tokenize(prompt);
         TokenToTree();
-        dka.TreeToDKA(tr);
-        dka.minimize();
     }
 
+    inline void compile(const CompileOptions& opts = {}) {
+        parse();
+        dka.TreeToDKA(tr, opts.unroll_limit, opts.encoding);
+        dka.minimize(opts.minimize);
+        compiled = CompiledDKA(dka, opts.prefilter ? Prefilter(requiredLiteral(tr, opts.encoding)) : Prefilter());
+        capture_dka = group_names.empty() ? nullptr : std::make_shared<const CaptureAutomaton>(tr, opts);
+    }
+
+    // Takes the automaton from the cache, compiling it only on a miss.
+    // tr, dka and the groups are cleared, only match/findAll are usable
+    // afterwards.
+    void compile(RegexCache& cache, const CompileOptions& opts = {});
+
+    inline const string& pattern() const { return prompt; }
+
     inline bool match(const string &str){
-        return dka.match(str);
+        return compiled.match(str);
     }
 
+    // [begin, end) offsets of every non-overlapping leftmost-longest match
     std::vector<std::pair<size_t, size_t>> findAll(const string&);
+
+    inline const std::vector<std::string>& groupNames() const { return group_names; }
+    inline size_t groupCount() const { return group_names.size(); }
+
+    // Tagged automaton of the groups, built on first use; null without
+    // groups or when the pattern is out of its reach (see CaptureAutomaton).
+    inline const TaggedDKA* tagged() const { return capture_dka ? capture_dka->get() : nullptr; }
+    inline const std::shared_ptr<const CaptureAutomaton>& captureAutomaton() const { return capture_dka; }
+
+    // Calls f(groups) for every match findAll reports; groups[2i],
+    // groups[2i + 1] bound group i as in TaggedDKA::extract, group 0 being
+    // the match. The span is only valid during the call. Returns the
+    // number of matches. Groups need compile(), the cache path has none;
+    // std::runtime_error for groups a tagged DFA cannot take.
+    template <typename F>
+    size_t forEachCapture(std::string_view text, F&& f) const {
+        if (!group_names.empty() && !capture_dka)
+            throw std::logic_error("regex: groups are not compiled");
+        const TaggedDKA* tags = tagged();
+        if (!group_names.empty() && !tags)
+            throw std::runtime_error("regex: captures unsupported for this pattern");
+        std::vector<size_t> groups(2 * (group_names.size() + 1), TaggedDKA::NPOS);
+        TaggedDKA::Workspace ws;
+        return compiled.forEachMatch(text, [&](const Match& m) {
+            if (!tags) {
+                groups[0] = m.begin;
+                groups[1] = m.end;
+            } else if (!tags->extract(text, m.begin, m.end, groups, ws)) {
+                throw std::logic_error("regex: match without a parse");
+            }
+            f(std::span<const size_t>(groups));
+        });
+    }
+
+    // Group bounds of every match, flattened as in forEachCapture.
+    std::vector<std::vector<size_t>> captures(std::string_view text) const;
 };
 
 } // namespace mgr
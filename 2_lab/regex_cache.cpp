@@ -0,0 +1,74 @@
+#include "regex_cache.hpp"
+
+namespace mgr {
+
+    RegexCache::RegexCache(size_t capacity) : cap(capacity == 0 ? 1 : capacity) {}
+
+    string RegexCache::makeKey(const string& pattern, const CompileOptions& opts) {
+        string key = pattern;
+        if (key.empty() || key.back() != '$')
+            key.push_back('$');
+        key.push_back('\0');
+        key.push_back(static_cast<char>(opts.minimize));
+        key.push_back(opts.prefilter ? 1 : 0);
+        key.push_back(static_cast<char>(opts.encoding));
+        key += std::to_string(opts.unroll_limit);
+        return key;
+    }
+
+    std::shared_ptr<const CompiledDKA> RegexCache::get(const string& pattern, const CompileOptions& opts) {
+        const string key = makeKey(pattern, opts);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = index.find(key);
+            if (it != index.end()) {
+                ++counters.hits;
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->second;
+            }
+            ++counters.misses;
+        }
+
+        // compile outside the lock so other patterns are not held up
+        regex r(pattern);
+        r.compile(opts);
+        auto compiled = std::make_shared<const CompiledDKA>(std::move(r.compiled));
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+        lru.emplace_front(key, compiled);
+        index.emplace(key, lru.begin());
+        while (lru.size() > cap) {
+            index.erase(lru.back().first);
+            lru.pop_back();
+            ++counters.evictions;
+        }
+        return compiled;
+    }
+
+    RegexCache::Stats RegexCache::stats() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return counters;
+    }
+
+    size_t RegexCache::size() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return lru.size();
+    }
+
+    void RegexCache::clear() {
+        std::lock_guard<std::mutex> lock(mtx);
+        lru.clear();
+        index.clear();
+    }
+
+    RegexCache& RegexCache::global() {
+        static RegexCache cache;
+        return cache;
+    }
+
+}
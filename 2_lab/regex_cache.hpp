@@ -0,0 +1,53 @@
+#ifndef REGEX_CACHE_HPP_
+#define REGEX_CACHE_HPP_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "my_regex.hpp"
+
+namespace mgr {
+
+// Thread-safe LRU cache of compiled automata keyed by pattern and options.
+// Entries are immutable and shared: a handed out automaton stays valid
+// after it is evicted, for as long as someone holds it.
+class RegexCache {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 512;
+
+    struct Stats {
+        size_t hits = 0, misses = 0, evictions = 0;
+    };
+
+    explicit RegexCache(size_t capacity = DEFAULT_CAPACITY);
+
+    // Compiles on a miss; a pattern that fails to parse throws and is not
+    // cached. Concurrent misses on one key may compile twice, the first
+    // inserted result wins.
+    std::shared_ptr<const CompiledDKA> get(const string& pattern, const CompileOptions& opts = {});
+
+    Stats stats() const;
+    size_t size() const;
+    inline size_t capacity() const { return cap; }
+    void clear();
+
+    // Process-wide instance
+    static RegexCache& global();
+
+private:
+    using Entry = std::pair<string, std::shared_ptr<const CompiledDKA>>;
+
+    mutable std::mutex mtx;
+    size_t cap;
+    std::list<Entry> lru;  // most recently used first
+    std::unordered_map<string, std::list<Entry>::iterator> index;
+    Stats counters;
+
+    static string makeKey(const string& pattern, const CompileOptions& opts);
+};
+
+} // namespace mgr
+
+#endif
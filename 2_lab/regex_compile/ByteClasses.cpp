@@ -0,0 +1,54 @@
+#include "ByteClasses.hpp"
+#include <stdexcept>
+
+namespace mgr {
+
+    void ByteClasses::split(unsigned char from, unsigned char to) {
+        if (from > to) return;
+
+        // bytes inside the range move to fresh ids, one per old class
+        std::array<uint16_t, 256> ids;
+        std::array<int16_t, 512> remap;
+        remap.fill(-1);
+        uint16_t next = static_cast<uint16_t>(classes);
+        for (int b = 0; b < 256; ++b)
+            ids[b] = map[b];
+        for (int b = from; b <= to; ++b) {
+            uint16_t old = ids[b];
+            if (remap[old] < 0)
+                remap[old] = static_cast<int16_t>(next++);
+            ids[b] = static_cast<uint16_t>(remap[old]);
+        }
+
+        // renumber densely in order of first occurrence
+        std::array<int16_t, 512> order;
+        order.fill(-1);
+        size_t k = 0;
+        for (int b = 0; b < 256; ++b) {
+            if (order[ids[b]] < 0)
+                order[ids[b]] = static_cast<int16_t>(k++);
+            map[b] = static_cast<uint8_t>(order[ids[b]]);
+        }
+        classes = k;
+    }
+
+    unsigned char ByteClasses::representative(size_t cls) const {
+        for (int b = 0; b < 256; ++b)
+            if (map[b] == cls)
+                return static_cast<unsigned char>(b);
+        throw std::out_of_range("ByteClasses: no such class");
+    }
+
+    std::vector<ByteClasses::Range> ByteClasses::runs(size_t cls) const {
+        std::vector<Range> res;
+        for (int b = 0; b < 256; ++b) {
+            if (map[b] != cls) continue;
+            if (!res.empty() && res.back().second + 1 == b)
+                res.back().second = static_cast<unsigned char>(b);
+            else
+                res.emplace_back(static_cast<unsigned char>(b), static_cast<unsigned char>(b));
+        }
+        return res;
+    }
+
+}
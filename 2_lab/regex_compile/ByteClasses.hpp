@@ -0,0 +1,38 @@
+#ifndef BYTE_CLASSES_HPP_
+#define BYTE_CLASSES_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace mgr {
+
+    // Partition of the 256 byte values into equivalence classes.
+    // Two bytes share a class iff every range passed to split() contains
+    // either both of them or neither, so an automaton built from those
+    // ranges cannot tell them apart.
+    class ByteClasses {
+    public:
+        using Range = std::pair<unsigned char, unsigned char>;
+
+        ByteClasses() { map.fill(0); }
+
+        void split(unsigned char from, unsigned char to);
+
+        inline uint8_t operator[](unsigned char b) const { return map[b]; }
+        inline size_t count() const { return classes; }
+        inline const uint8_t* data() const { return map.data(); }
+
+        unsigned char representative(size_t cls) const;
+        std::vector<Range> runs(size_t cls) const;
+
+    private:
+        std::array<uint8_t, 256> map;
+        size_t classes = 1;
+    };
+
+}
+
+#endif
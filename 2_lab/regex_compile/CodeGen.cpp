@@ -0,0 +1,190 @@
+#include "CodeGen.hpp"
+#include <stdexcept>
+#include <vector>
+
+namespace mgr {
+
+    namespace {
+
+        constexpr size_t MAX_RANGE_TESTS = 4;   // more runs than this: switch
+
+        struct Run {
+            unsigned lo, hi;
+            CompiledDKA::StateId target;
+        };
+
+        bool isIdentifier(const std::string& s, bool qualified) {
+            if (s.empty()) return false;
+            bool start = true;
+            for (size_t i = 0; i < s.size(); ++i) {
+                char c = s[i];
+                if (qualified && c == ':' && i + 1 < s.size() && s[i + 1] == ':' && !start) {
+                    ++i;
+                    start = true;
+                    continue;
+                }
+                bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+                if (!alpha && (start || c < '0' || c > '9')) return false;
+                start = false;
+            }
+            return !start;
+        }
+
+        std::string quoted(const std::string& s) {
+            static const char HEX[] = "0123456789abcdef";
+            std::string out;
+            for (unsigned char c : s) {
+                if (c >= ' ' && c <= '~' && c != '\\') {
+                    out.push_back(static_cast<char>(c));
+                } else {
+                    out += "\\x";
+                    out.push_back(HEX[c >> 4]);
+                    out.push_back(HEX[c & 15]);
+                }
+            }
+            return out;
+        }
+
+        std::vector<Run> runsOf(const CompiledDKA& dka, CompiledDKA::StateId s) {
+            std::vector<Run> runs;
+            for (unsigned c = 0; c < 256; ++c) {
+                CompiledDKA::StateId t = dka.step(s, static_cast<unsigned char>(c));
+                if (!runs.empty() && runs.back().target == t && runs.back().hi + 1 == c)
+                    runs.back().hi = c;
+                else
+                    runs.push_back(Run{ c, c, t });
+            }
+            return runs;
+        }
+
+        class Emitter {
+        public:
+            Emitter(const CompiledDKA& dka, const CodeGenOptions& opts) : dka(dka), opts(opts) {
+                // the start state first, so the function falls into it
+                order.push_back(dka.start());
+                for (size_t row = 1; row < dka.stateCount(); ++row) {
+                    auto s = static_cast<CompiledDKA::StateId>(row * dka.stride());
+                    if (s != dka.start()) order.push_back(s);
+                }
+                // only these get a label, an unused one is a warning
+                targeted.assign(dka.stateCount(), opts.computed_goto);
+                for (CompiledDKA::StateId s : order)
+                    for (unsigned c = 0; c < 256; ++c) {
+                        CompiledDKA::StateId t = dka.step(s, static_cast<unsigned char>(c));
+                        if (!dka.is_dead(t)) targeted[t / dka.stride()] = true;
+                    }
+            }
+
+            std::string run() {
+                out += "// Generated by regex_codegen";
+                if (!opts.pattern.empty()) out += " from \"" + quoted(opts.pattern) + "\"";
+                out += ". Do not edit.\n#include <string_view>\n\n";
+                if (!opts.name_space.empty()) out += "namespace " + opts.name_space + " {\n\n";
+                out += "bool " + opts.function + "(std::string_view text) noexcept {\n";
+
+                if (dka.empty()) {
+                    out += "    (void)text;\n    return false;\n}\n";
+                } else {
+                    out += "    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());\n";
+                    out += "    const unsigned char* const end = p + text.size();\n";
+                    if (opts.computed_goto) labelTables();
+                    for (CompiledDKA::StateId s : order) state(s);
+                    out += "}\n";
+                }
+                if (!opts.name_space.empty()) out += "\n}\n";
+                return out;
+            }
+
+        private:
+            const CompiledDKA& dka;
+            const CodeGenOptions& opts;
+            std::vector<CompiledDKA::StateId> order;
+            std::vector<bool> targeted;
+            std::string out;
+
+            std::string label(CompiledDKA::StateId s) const {
+                return "s" + std::to_string(s / dka.stride());
+            }
+
+            std::string jump(CompiledDKA::StateId t) const {
+                return dka.is_dead(t) ? "return false;" : "goto " + label(t) + ";";
+            }
+
+            void labelTables() {
+                for (CompiledDKA::StateId s : order) {
+                    out += "    static void* const " + label(s) + "_next[256] = {";
+                    for (unsigned c = 0; c < 256; ++c) {
+                        out += c % 8 == 0 ? "\n        " : " ";
+                        CompiledDKA::StateId t = dka.step(s, static_cast<unsigned char>(c));
+                        out += dka.is_dead(t) ? "&&dead" : "&&" + label(t);
+                        if (c != 255) out += ",";
+                    }
+                    out += "\n    };\n";
+                }
+                out += "    goto " + label(dka.start()) + ";\n";
+                out += "dead:\n    return false;\n";
+            }
+
+            void state(CompiledDKA::StateId s) {
+                if (targeted[s / dka.stride()]) out += label(s) + ":\n";
+                out += std::string("    if (p == end) return ") + (dka.is_final(s) ? "true" : "false") + ";\n";
+                if (opts.computed_goto) {
+                    out += "    goto *" + label(s) + "_next[*p++];\n";
+                    return;
+                }
+
+                std::vector<Run> runs = runsOf(dka, s);
+                size_t live = 0;
+                for (const Run& r : runs) live += !dka.is_dead(r.target);
+
+                if (live == 0) {
+                    out += "    return false;\n";
+                    return;
+                }
+                if (live <= MAX_RANGE_TESTS) {
+                    out += "    {\n        const unsigned c = *p++;\n";
+                    for (const Run& r : runs) {
+                        if (dka.is_dead(r.target)) continue;
+                        if (r.lo == r.hi)
+                            out += "        if (c == " + std::to_string(r.lo) + ") " + jump(r.target) + "\n";
+                        else
+                            out += "        if (c - " + std::to_string(r.lo) + "u <= " + std::to_string(r.hi - r.lo) +
+                                   "u) " + jump(r.target) + "\n";
+                    }
+                    out += "        return false;\n    }\n";
+                    return;
+                }
+
+                // one case list per target, the compiler turns it into a jump table
+                out += "    switch (*p++) {\n";
+                std::vector<bool> done(runs.size(), false);
+                for (size_t i = 0; i < runs.size(); ++i) {
+                    if (done[i] || dka.is_dead(runs[i].target)) continue;
+                    std::string cases;
+                    size_t on_line = 0;
+                    for (size_t j = i; j < runs.size(); ++j) {
+                        if (runs[j].target != runs[i].target) continue;
+                        done[j] = true;
+                        for (unsigned c = runs[j].lo; c <= runs[j].hi; ++c) {
+                            if (on_line++ % 8 == 0) cases += on_line == 1 ? "        " : "\n        ";
+                            else cases += ' ';
+                            cases += "case " + std::to_string(c) + ":";
+                        }
+                    }
+                    out += cases + "\n            " + jump(runs[i].target) + "\n";
+                }
+                out += "        default:\n            return false;\n    }\n";
+            }
+        };
+
+    }
+
+    std::string generateCpp(const CompiledDKA& dka, const CodeGenOptions& opts) {
+        if (!isIdentifier(opts.function, false))
+            throw std::invalid_argument("Function name is not an identifier: " + opts.function);
+        if (!opts.name_space.empty() && !isIdentifier(opts.name_space, true))
+            throw std::invalid_argument("Namespace is not a qualified identifier: " + opts.name_space);
+        return Emitter(dka, opts).run();
+    }
+
+}
@@ -0,0 +1,28 @@
+#ifndef CODE_GEN_HPP_
+#define CODE_GEN_HPP_
+
+#include <string>
+#include "CompiledDKA.hpp"
+
+namespace mgr {
+
+    struct CodeGenOptions {
+        std::string function = "match";
+        std::string name_space{};        // empty: global namespace
+        std::string pattern{};           // only quoted in the header comment
+        // Dispatch through per-state label tables (GCC/Clang extension)
+        // instead of a switch.
+        bool computed_goto = false;
+    };
+
+    // Emits a standalone C++ source defining
+    //     bool <function>(std::string_view) noexcept;
+    // with the same answers as dka.match(). Every state is a label, input
+    // bytes with the same target are coalesced into ranges, sparse states
+    // compare ranges and dense ones switch on the byte, so the compiler
+    // builds a jump table. The output needs only the standard library.
+    std::string generateCpp(const CompiledDKA& dka, const CodeGenOptions& opts = {});
+
+}
+
+#endif
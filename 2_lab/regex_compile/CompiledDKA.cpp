@@ -0,0 +1,612 @@
+#include "CompiledDKA.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mgr {
+
+    // class map (256 bytes) followed by the transition table
+    static constexpr size_t TABLE_OFFSET = 256;
+
+    static std::shared_ptr<uint8_t> allocateBlock(size_t bytes) {
+        auto* raw = static_cast<uint8_t*>(::operator new[](
+            bytes, std::align_val_t{CompiledDKA::ALIGNMENT}));
+        std::fill(raw, raw + bytes, 0);
+        return std::shared_ptr<uint8_t>(raw, [](uint8_t* p) {
+            ::operator delete[](p, std::align_val_t{CompiledDKA::ALIGNMENT});
+        });
+    }
+
+    CompiledDKA::CompiledDKA(const DKA& dka, Prefilter prefilter) : pf(std::move(prefilter)) {
+        build(dka);
+        rev = std::make_shared<ReverseSlot>();
+    }
+
+    void CompiledDKA::build(const DKA& dka) {
+        const size_t n = dka.states.size();
+        constexpr size_t UNSET = SIZE_MAX;
+
+        // only the part reachable from the start state ends up in the table
+        std::vector<bool> reachable(n, false);
+        if (n != 0) {
+            std::queue<size_t> q;
+            q.push(dka.start_state);
+            reachable[dka.start_state] = true;
+            while (!q.empty()) {
+                size_t s = q.front(); q.pop();
+                for (const auto& tr : dka.states[s].transitions)
+                    if (!reachable[tr.target]) {
+                        reachable[tr.target] = true;
+                        q.push(tr.target);
+                    }
+            }
+        }
+
+        // row 0 is dead, then non-final states, then final ones
+        std::vector<size_t> row(n, UNSET);
+        size_t rows = 1;
+        for (size_t i = 0; i < n; ++i)
+            if (reachable[i] && !dka.states[i].is_final)
+                row[i] = rows++;
+        const size_t first_final = rows;
+        for (size_t i = 0; i < n; ++i)
+            if (reachable[i] && dka.states[i].is_final)
+                row[i] = rows++;
+
+        const ByteClasses classes = dka.byteClasses();
+        const size_t k = classes.count();
+        if (rows * k > UINT32_MAX)
+            throw std::length_error("CompiledDKA: automaton is too large");
+
+        // pattern ids of the final rows in CSR form, stored after the table
+        std::vector<uint32_t> tag_offsets{ 0 }, tag_ids;
+        for (size_t i = 0; i < n; ++i)
+            if (reachable[i] && dka.states[i].is_final) {
+                const auto& ids = dka.states[i].patterns;
+                tag_ids.insert(tag_ids.end(), ids.begin(), ids.end());
+                tag_offsets.push_back(static_cast<uint32_t>(tag_ids.size()));
+            }
+
+        const size_t table_bytes = rows * k * sizeof(StateId);
+        auto block = allocateBlock(TABLE_OFFSET + table_bytes +
+                                   (tag_offsets.size() + tag_ids.size()) * sizeof(uint32_t));
+        std::copy(classes.data(), classes.data() + 256, block.get());
+        StateId* out = reinterpret_cast<StateId*>(block.get() + TABLE_OFFSET);
+        uint32_t* tag_block = reinterpret_cast<uint32_t*>(block.get() + TABLE_OFFSET + table_bytes);
+        std::copy(tag_offsets.begin(), tag_offsets.end(), tag_block);
+        std::copy(tag_ids.begin(), tag_ids.end(), tag_block + tag_offsets.size());
+
+        std::vector<bool> assigned(k);
+        for (size_t i = 0; i < n; ++i) {
+            if (row[i] == UNSET) continue;
+            StateId* dst = out + row[i] * k;
+            std::fill(assigned.begin(), assigned.end(), false);
+            // the first transition covering a class wins, as in DKA::match
+            for (const auto& tr : dka.states[i].transitions) {
+                for (int c = tr.from; c <= tr.to; ++c) {
+                    uint8_t cls = classes[static_cast<unsigned char>(c)];
+                    if (assigned[cls]) continue;
+                    assigned[cls] = true;
+                    dst[cls] = static_cast<StateId>(row[tr.target] * k);
+                }
+            }
+        }
+
+        num_states = rows;
+        num_classes = k;
+        accept_from = static_cast<StateId>(first_final * k);
+        start_state = n == 0 ? DEAD : static_cast<StateId>(row[dka.start_state] * k);
+        classmap = block.get();
+        table = out;
+        tags = tag_block;
+        storage = std::move(block);
+    }
+
+    bool CompiledDKA::match(std::string_view str) const {
+        if (empty()) return false;
+        StateId s = start_state;
+        for (unsigned char ch : str) {
+            s = table[s + classmap[ch]];
+            if (s == DEAD) return false;
+        }
+        return is_final(s);
+    }
+
+    const CompiledDKA* CompiledDKA::reverse() const {
+        if (!rev || empty()) return nullptr;
+        std::call_once(rev->built, [this] { rev->dka = buildReverse(); });
+        return rev->dka.get();
+    }
+
+    // reads the table back as a DKA; the dead row keeps no transitions
+    std::shared_ptr<const CompiledDKA> CompiledDKA::buildReverse() const {
+        const size_t k = num_classes;
+        DKA fwd;
+        for (size_t r = 0; r < num_states; ++r)
+            fwd.addState(r * k >= accept_from);
+        for (size_t r = 1; r < num_states; ++r) {
+            const StateId* cells = table + r * k;
+            for (unsigned b = 0; b < 256;) {
+                StateId t = cells[classmap[b]];
+                unsigned e = b;
+                while (e + 1 < 256 && cells[classmap[e + 1]] == t) ++e;
+                if (t != DEAD)
+                    fwd.addTransition(r, static_cast<unsigned char>(b), static_cast<unsigned char>(e), t / k);
+                b = e + 1;
+            }
+        }
+        fwd.start_state = start_state / k;
+
+        std::optional<DKA> back = fwd.reversed(true, REVERSE_MAX_STATES, REVERSE_MAX_WORK);
+        if (!back) return nullptr;
+        auto r = std::make_shared<CompiledDKA>();
+        r->build(*back);
+        return r;
+    }
+
+    // end of the longest match starting at begin, SIZE_MAX if none
+    size_t CompiledDKA::longestFrom(std::string_view text, size_t begin) const {
+        size_t last = is_final(start_state) ? begin : SIZE_MAX;
+        StateId s = start_state;
+        for (size_t i = begin; i < text.size(); ++i) {
+            s = table[s + classmap[static_cast<unsigned char>(text[i])]];
+            if (s == DEAD) break;
+            if (s >= accept_from) last = i + 1;
+        }
+        return last;
+    }
+
+    // As longestFrom, but once the scan stands in the same state at a
+    // trail position as the furthest scan so far, both take the same steps
+    // from there on: that scan's last accepting position, if it lies
+    // further, is the answer.
+    size_t CompiledDKA::longestFrom(std::string_view text, size_t begin, StartIndex& starts) const {
+        constexpr size_t STEP = StartIndex::TRAIL_STEP;
+        const size_t theirs_end = starts.trail_first + starts.trail.size() * STEP;
+        const size_t first = (begin / STEP + 1) * STEP;
+        std::vector<StateId>& mine = starts.scratch;
+        mine.clear();
+        size_t last = is_final(start_state) ? begin : SIZE_MAX;
+        StateId s = start_state;
+        for (size_t i = begin; i < text.size(); ++i) {
+            s = table[s + classmap[static_cast<unsigned char>(text[i])]];
+            if (s == DEAD) break;
+            if (s >= accept_from) last = i + 1;
+            if ((i + 1) % STEP != 0) continue;
+            const size_t p = i + 1;
+            if (p >= starts.trail_first && p < theirs_end &&
+                starts.trail[(p - starts.trail_first) / STEP] == s)
+                return starts.trail_last != SIZE_MAX && starts.trail_last > p ? starts.trail_last : last;
+            mine.push_back(s);
+        }
+        if (first + mine.size() * STEP > theirs_end) {
+            starts.trail.swap(mine);
+            starts.trail_first = first;
+            starts.trail_last = last;
+        }
+        return last;
+    }
+
+    std::optional<Match> CompiledDKA::find(std::string_view text, size_t from) const {
+        if (!scansBackwards())
+            return findStarting(text, from, text.size());
+        if (is_final(start_state))
+            return from <= text.size() ? std::optional<Match>(Match{from, longestFrom(text, from)})
+                                       : std::nullopt;
+        if (pf.active() && pf.find(text, from) == std::string::npos)
+            return std::nullopt;
+        // the last final state on the way back is the leftmost start
+        const CompiledDKA& back = *reverse();
+        size_t begin = SIZE_MAX;
+        StateId s = back.start();
+        for (size_t i = text.size(); i-- > from;) {
+            s = back.step(s, static_cast<unsigned char>(text[i]));
+            if (back.is_final(s)) begin = i;
+        }
+        if (begin == SIZE_MAX) return std::nullopt;
+        return Match{begin, longestFrom(text, begin)};
+    }
+
+    std::optional<Match> CompiledDKA::find(std::string_view text, size_t from, StartIndex& starts) const {
+        if (!scansBackwards())
+            return find(text, from);
+        size_t begin = starts.next(from);
+        if (begin == std::string::npos) return std::nullopt;
+        return Match{begin, longestFrom(text, begin, starts)};
+    }
+
+    std::optional<Match> CompiledDKA::findStarting(std::string_view text, size_t from,
+                                                   size_t last_begin) const {
+        if (empty()) return std::nullopt;
+        const bool empty_ok = is_final(start_state);
+        const bool filtered = pf.active() && !empty_ok;
+        const size_t max_off = pf.maxOffset();
+        size_t lit = 0;
+        bool lit_known = false;
+
+        for (size_t begin = from; begin <= last_begin; ++begin) {
+            if (filtered) {
+                // every match starting at begin holds the literal somewhere
+                // in [begin, begin + max_off]
+                if (!lit_known || lit < begin) {
+                    lit = pf.find(text, begin);
+                    lit_known = true;
+                }
+                if (lit == std::string::npos) break;
+                if (max_off != std::string::npos && lit - begin > max_off)
+                    begin = lit - max_off;
+                if (begin > last_begin) break;
+            }
+            size_t last = longestFrom(text, begin);
+            if (last != SIZE_MAX)
+                return Match{begin, last};
+        }
+        return std::nullopt;
+    }
+
+    StartIndex::StartIndex(const CompiledDKA& dka, std::string_view text)
+        : rev(dka.is_final(dka.start()) ? nullptr : dka.reverse()), text(text) {
+        if (!rev) return;
+        checkpoints.resize((text.size() + BLOCK - 1) / BLOCK);
+        CompiledDKA::StateId s = rev->start();
+        for (size_t b = checkpoints.size(); b-- > 0;) {
+            checkpoints[b] = s;
+            for (size_t i = std::min(text.size(), (b + 1) * BLOCK); i-- > b * BLOCK;)
+                s = rev->step(s, static_cast<unsigned char>(text[i]));
+        }
+    }
+
+    size_t StartIndex::next(size_t from) {
+        if (!rev) return from <= text.size() ? from : std::string::npos;
+        for (size_t b = from / BLOCK; b < checkpoints.size(); ++b) {
+            const size_t first = b * BLOCK, end = std::min(text.size(), first + BLOCK);
+            if (loaded != b) {
+                CompiledDKA::StateId s = checkpoints[b];
+                for (size_t i = end; i-- > first;) {
+                    s = rev->step(s, static_cast<unsigned char>(text[i]));
+                    starts[i - first] = rev->is_final(s);
+                }
+                loaded = b;
+            }
+            for (size_t i = std::max(from, first); i < end; ++i)
+                if (starts[i - first]) return i;
+        }
+        return std::string::npos;
+    }
+
+    size_t CompiledDKA::count(std::string_view text) const {
+        return forEachMatch(text, [](const Match&) {});
+    }
+
+    size_t CompiledDKA::chunkCount(size_t bytes, size_t threads) {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        return std::max<size_t>(1, std::min(threads, bytes / MIN_PARALLEL_CHUNK));
+    }
+
+    // Runs every state of the table over chunk at once. Paths that meet
+    // are merged, so after a few bytes usually only a handful remain and
+    // once a single one is left the rest is a plain walk.
+    // out[row] receives the state reached from that row; backwards reads
+    // the chunk from its end, as the reverse automaton does.
+    void CompiledDKA::mapChunk(std::string_view chunk, std::vector<StateId>& out, bool backwards) const {
+        auto at = [&](size_t i) {
+            return static_cast<unsigned char>(chunk[backwards ? chunk.size() - 1 - i : i]);
+        };
+        const StateId k = static_cast<StateId>(num_classes);
+        std::vector<StateId> active(num_states), next;
+        std::vector<uint32_t> path(num_states);     // row -> index into active
+        std::vector<uint32_t> moved;                // old index -> new index
+        std::vector<size_t> seen(num_states, SIZE_MAX);
+        std::vector<uint32_t> where(num_states);
+        for (size_t r = 0; r < num_states; ++r) {
+            active[r] = static_cast<StateId>(r * k);
+            path[r] = static_cast<uint32_t>(r);
+        }
+
+        size_t i = 0;
+        for (; i < chunk.size() && active.size() > 1; ++i) {
+            const uint8_t cls = classmap[at(i)];
+            next.clear();
+            moved.resize(active.size());
+            for (size_t a = 0; a < active.size(); ++a) {
+                StateId t = table[active[a] + cls];
+                StateId row = t / k;
+                if (seen[row] != i) {
+                    seen[row] = i;
+                    where[row] = static_cast<uint32_t>(next.size());
+                    next.push_back(t);
+                }
+                moved[a] = where[row];
+            }
+            // without a merge the numbering is unchanged
+            if (next.size() < active.size())
+                for (auto& p : path)
+                    p = moved[p];
+            active.swap(next);
+        }
+
+        StateId s = active.front();
+        for (; i < chunk.size() && s != DEAD; ++i)
+            s = table[s + classmap[at(i)]];
+        active.front() = s;
+
+        out.resize(num_states);
+        for (size_t r = 0; r < num_states; ++r)
+            out[r] = active[path[r]];
+    }
+
+    bool CompiledDKA::matchParallel(std::string_view str, size_t threads) const {
+        if (empty()) return false;
+        const size_t chunks = chunkCount(str.size(), threads);
+        if (chunks == 1) return match(str);
+
+        // chunk 0 starts from the known start state, the others from every state
+        const size_t len = str.size() / chunks;
+        std::vector<std::vector<StateId>> maps(chunks);
+        StateId head = start_state;
+        {
+            std::vector<std::thread> pool;
+            for (size_t c = 1; c < chunks; ++c) {
+                size_t begin = c * len, end = c + 1 == chunks ? str.size() : begin + len;
+                pool.emplace_back([this, &maps, c, chunk = str.substr(begin, end - begin)] {
+                    mapChunk(chunk, maps[c]);
+                });
+            }
+            for (unsigned char ch : str.substr(0, len)) {
+                head = table[head + classmap[ch]];
+                if (head == DEAD) break;
+            }
+            for (auto& t : pool) t.join();
+        }
+
+        StateId s = head;
+        for (size_t c = 1; c < chunks && s != DEAD; ++c)
+            s = maps[c][s / num_classes];
+        return is_final(s);
+    }
+
+    std::optional<Match> CompiledDKA::findParallel(std::string_view text, size_t threads) const {
+        if (empty()) return std::nullopt;
+        const size_t chunks = chunkCount(text.size(), threads);
+        // a nullable pattern matches at 0, without a reverse automaton
+        // there is nothing to split
+        if (chunks == 1 || is_final(start_state) || !scansBackwards()) return find(text);
+
+        // The reverse automaton reads the text from its end. Every chunk
+        // but the first maps all reverse states through itself; composed
+        // from the end the maps give the state each chunk is entered in,
+        // and a second pass finds each chunk's leftmost start from it.
+        // leftmost-longest only depends on the begin, the first chunk
+        // holding a start has it.
+        const CompiledDKA& back = *reverse();
+        const size_t len = text.size() / chunks;
+        auto chunk = [&](size_t c) {
+            return text.substr(c * len, c + 1 == chunks ? std::string::npos : len);
+        };
+        auto parallel = [chunks](auto&& f) {
+            std::vector<std::thread> pool;
+            for (size_t c = 1; c < chunks; ++c)
+                pool.emplace_back([&f, c] { f(c); });
+            f(0);
+            for (auto& t : pool) t.join();
+        };
+
+        std::vector<std::vector<StateId>> maps(chunks);
+        parallel([&](size_t c) {
+            if (c != 0) back.mapChunk(chunk(c), maps[c], true);
+        });
+        std::vector<StateId> entry(chunks);
+        entry[chunks - 1] = back.start();
+        for (size_t c = chunks - 1; c-- > 0;)
+            entry[c] = maps[c + 1][entry[c + 1] / back.num_classes];
+
+        std::vector<size_t> first(chunks, SIZE_MAX);
+        parallel([&](size_t c) {
+            const size_t offset = c * len;
+            std::string_view part = chunk(c);
+            StateId s = entry[c];
+            for (size_t i = part.size(); i-- > 0;) {
+                s = back.step(s, static_cast<unsigned char>(part[i]));
+                if (back.is_final(s)) first[c] = offset + i;
+            }
+        });
+        for (size_t begin : first)
+            if (begin != SIZE_MAX) return Match{begin, longestFrom(text, begin)};
+        return std::nullopt;
+    }
+
+    namespace {
+
+        constexpr char MAGIC[8] = { 'M', 'G', 'R', 'D', 'K', 'A', 0, 0 };
+        constexpr uint32_t ORDER_MARK = 0x01020304;
+
+        struct ImageHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t byte_order;
+            uint64_t num_states;
+            uint32_t num_classes;
+            uint32_t start_state;
+            uint32_t accept_from;
+            uint32_t literal_size;
+            uint64_t literal_max_offset;
+            uint64_t table_offset;
+            uint64_t image_size;
+            uint64_t reverse_offset;      // 0: no reverse automaton
+            uint64_t reverse_size;
+        };
+        static_assert(sizeof(ImageHeader) == 80);
+
+        constexpr size_t CLASSMAP_OFFSET = sizeof(ImageHeader);
+        constexpr size_t LITERAL_OFFSET = CLASSMAP_OFFSET + 256;
+
+        size_t alignUp(size_t n) {
+            return (n + CompiledDKA::ALIGNMENT - 1) / CompiledDKA::ALIGNMENT * CompiledDKA::ALIGNMENT;
+        }
+
+        [[noreturn]] void badImage(const char* why) {
+            throw std::runtime_error(std::string("CompiledDKA: bad image: ") + why);
+        }
+
+    }
+
+    size_t CompiledDKA::tagWords() const {
+        if (!tags) return 0;
+        const size_t finals = num_states - accept_from / num_classes;
+        return finals + 1 + tags[finals];
+    }
+
+    std::string CompiledDKA::serialize() const {
+        const std::string& lit = pf.literal();
+        const size_t table_offset = alignUp(LITERAL_OFFSET + lit.size());
+        const size_t table_bytes = num_states * num_classes * sizeof(StateId);
+        const size_t tag_bytes = tagWords() * sizeof(uint32_t);
+        const CompiledDKA* back = reverse();
+        const std::string back_image = back ? back->serialize() : std::string();
+
+        ImageHeader h{};
+        std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+        h.version = FORMAT_VERSION;
+        h.byte_order = ORDER_MARK;
+        h.num_states = num_states;
+        h.num_classes = static_cast<uint32_t>(num_classes);
+        h.start_state = start_state;
+        h.accept_from = accept_from;
+        h.literal_size = static_cast<uint32_t>(lit.size());
+        h.literal_max_offset = pf.maxOffset();
+        h.table_offset = table_offset;
+        h.image_size = table_offset + table_bytes + tag_bytes;
+        if (back) {
+            h.reverse_offset = alignUp(h.image_size);
+            h.reverse_size = back_image.size();
+            h.image_size = h.reverse_offset + h.reverse_size;
+        }
+
+        std::string out(h.image_size, '\0');
+        std::memcpy(out.data(), &h, sizeof h);
+        if (classmap)
+            std::memcpy(out.data() + CLASSMAP_OFFSET, classmap, 256);
+        std::memcpy(out.data() + LITERAL_OFFSET, lit.data(), lit.size());
+        if (table) {
+            std::memcpy(out.data() + table_offset, table, table_bytes);
+            std::memcpy(out.data() + table_offset + table_bytes, tags, tag_bytes);
+        }
+        std::memcpy(out.data() + h.reverse_offset, back_image.data(), back_image.size());
+        return out;
+    }
+
+    void CompiledDKA::save(const std::string& path) const {
+        std::string image = serialize();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.write(image.data(), static_cast<std::streamsize>(image.size())))
+            throw std::runtime_error("CompiledDKA: cannot write " + path);
+    }
+
+    CompiledDKA CompiledDKA::fromImage(const void* data, size_t size,
+                                       std::shared_ptr<const void> owner) {
+        if (size < LITERAL_OFFSET) badImage("truncated header");
+        ImageHeader h;
+        std::memcpy(&h, data, sizeof h);
+        if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0) badImage("wrong magic");
+        if (h.version != FORMAT_VERSION) badImage("unsupported version");
+        if (h.byte_order != ORDER_MARK) badImage("foreign byte order");
+        if (h.image_size > size) badImage("truncated");
+
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        CompiledDKA res;
+        if (h.num_states == 0)
+            return res;
+
+        const uint64_t cells = h.num_states * h.num_classes;
+        if (h.num_classes == 0 || h.num_classes > 256 || cells / h.num_classes != h.num_states ||
+            cells > UINT32_MAX)
+            badImage("bad dimensions");
+        if (h.table_offset < LITERAL_OFFSET + h.literal_size ||
+            h.table_offset + cells * sizeof(StateId) > h.image_size)
+            badImage("table out of bounds");
+        if (h.start_state >= cells || h.accept_from > cells ||
+            h.start_state % h.num_classes != 0 || h.accept_from % h.num_classes != 0)
+            badImage("bad start or accepting row");
+        if (reinterpret_cast<uintptr_t>(bytes + h.table_offset) % alignof(StateId) != 0)
+            badImage("misaligned table");
+        // every step stays inside the table: one pass over classes and cells
+        const uint8_t* cmap = bytes + CLASSMAP_OFFSET;
+        for (size_t b = 0; b < 256; ++b)
+            if (cmap[b] >= h.num_classes) badImage("bad class map");
+        const auto* cell = reinterpret_cast<const StateId*>(bytes + h.table_offset);
+        for (uint64_t i = 0; i < cells; ++i)
+            if (cell[i] >= cells || cell[i] % h.num_classes != 0) badImage("bad transition");
+
+        // pattern ids of the final rows follow the table
+        const uint64_t finals = h.num_states - h.accept_from / h.num_classes;
+        const uint64_t tag_offset = h.table_offset + cells * sizeof(StateId);
+        if (tag_offset + (finals + 1) * sizeof(uint32_t) > h.image_size)
+            badImage("pattern ids out of bounds");
+        const auto* tag_block = reinterpret_cast<const uint32_t*>(bytes + tag_offset);
+        for (uint64_t f = 0; f < finals; ++f)
+            if (tag_block[f] > tag_block[f + 1]) badImage("bad pattern ids");
+        const uint64_t tag_end = tag_offset + (finals + 1 + tag_block[finals]) * sizeof(uint32_t);
+        if (tag_end > h.image_size)
+            badImage("pattern ids out of bounds");
+
+        // the reverse automaton is an image of its own, without a reverse
+        std::shared_ptr<const CompiledDKA> back;
+        if (h.reverse_offset != 0) {
+            if (h.reverse_offset < tag_end || h.reverse_offset % ALIGNMENT != 0 ||
+                h.reverse_size < sizeof(ImageHeader) || h.reverse_size > h.image_size - h.reverse_offset)
+                badImage("reverse automaton out of bounds");
+            ImageHeader inner;
+            std::memcpy(&inner, bytes + h.reverse_offset, sizeof inner);
+            if (inner.reverse_offset != 0) badImage("nested reverse automaton");
+            back = std::make_shared<const CompiledDKA>(
+                fromImage(bytes + h.reverse_offset, h.reverse_size, owner));
+        }
+
+        res.num_states = h.num_states;
+        res.num_classes = h.num_classes;
+        res.start_state = h.start_state;
+        res.accept_from = h.accept_from;
+        res.classmap = cmap;
+        res.table = cell;
+        res.tags = tag_block;
+        if (h.literal_size != 0)
+            res.pf = Prefilter(RequiredLiteral{
+                std::string(reinterpret_cast<const char*>(bytes + LITERAL_OFFSET), h.literal_size),
+                static_cast<size_t>(h.literal_max_offset) });
+        res.storage = std::move(owner);
+        res.rev = std::make_shared<ReverseSlot>();
+        std::call_once(res.rev->built, [&] { res.rev->dka = std::move(back); });
+        return res;
+    }
+
+    CompiledDKA CompiledDKA::load(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("CompiledDKA: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            throw std::runtime_error("CompiledDKA: cannot read " + path);
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("CompiledDKA: cannot map " + path);
+
+        std::shared_ptr<const void> mapping(addr, [size](const void* p) {
+            ::munmap(const_cast<void*>(p), size);
+        });
+        return fromImage(addr, size, std::move(mapping));
+    }
+
+}
\ No newline at end of file
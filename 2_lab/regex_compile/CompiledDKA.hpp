@@ -0,0 +1,291 @@
+#ifndef COMPILED_DKA_HPP_
+#define COMPILED_DKA_HPP_
+
+#include <bitset>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "DKA.hpp"
+#include "Prefilter.hpp"
+
+namespace mgr {
+
+    // Half-open byte range [begin, end) of a match inside the scanned text.
+    struct Match {
+        size_t begin, end;
+        bool operator==(const Match&) const = default;
+    };
+
+    class MatchRange;
+    class StartIndex;
+
+    // Immutable, table-driven form of a DKA.
+    // Input bytes are first mapped to their equivalence class, rows are laid
+    // out contiguously (state x class) in one cache-line aligned block, and
+    // every cell holds the premultiplied row offset of the target state.
+    // Row 0 is the explicit dead state, accepting states occupy the tail of
+    // the table, so acceptance is one comparison against accept_from.
+    class CompiledDKA {
+    public:
+        using StateId = uint32_t;
+
+        static constexpr size_t ALIGNMENT = 64;
+        static constexpr StateId DEAD = 0;
+
+        CompiledDKA() = default;
+        // With an active prefilter find() skips to candidate positions near
+        // an occurrence of the required literal instead of trying every byte.
+        explicit CompiledDKA(const DKA& dka, Prefilter prefilter = {});
+
+        // Binary image: an 80 byte header, the class map, the prefilter
+        // literal, the table (64 byte aligned), the pattern ids of the
+        // accepting states and, 64 byte aligned again, the image of the
+        // reverse automaton, stored exactly as they are laid out in
+        // memory. Cells are row offsets, so the image is position
+        // independent and a mapped file is used in place. Saving builds
+        // the reverse automaton if no search has done so yet.
+        static constexpr uint32_t FORMAT_VERSION = 3;
+
+        void save(const std::string& path) const;
+        std::string serialize() const;
+        // Maps the file read-only; the mapping lives as long as any copy.
+        static CompiledDKA load(const std::string& path);
+        // Uses data in place without copying the table. owner keeps the
+        // buffer alive; the table must be 4 byte aligned. Every class and
+        // cell is checked once, so a damaged image throws here instead of
+        // sending match() out of the table.
+        static CompiledDKA fromImage(const void* data, size_t size,
+                                     std::shared_ptr<const void> owner = {});
+
+        bool match(std::string_view str) const;
+
+        // Unanchored leftmost-longest search. Matches are reported in order
+        // and never overlap; after an empty match the scan resumes one byte
+        // further.
+        //
+        // With a reverse automaton the leftmost start is found by one
+        // backward scan over the text and the end by one anchored forward
+        // scan from it, so one find is linear in the text. The backward
+        // scan always starts at the end of the text, so calling find in a
+        // loop over one text is quadratic: loops take the StartIndex
+        // overload, as count, matches and forEachMatch do. A nullable
+        // pattern needs no backward scan: every position starts a match,
+        // if only an empty one. find does not allocate. A StartIndex reads
+        // the text backwards only once, and a forward scan that falls in
+        // step with an earlier, longer one stops there, so a run of short
+        // matches inside one long partial match does not read it again for
+        // each of them.
+        // Without a reverse automaton (too many reverse states, or a
+        // prefilter with a bounded offset, which already limits where
+        // matches can begin) every begin position is tried in turn.
+        std::optional<Match> find(std::string_view text, size_t from = 0) const;
+        // starts must have been built for this text; repeated calls with
+        // growing from are linear in the text altogether.
+        std::optional<Match> find(std::string_view text, size_t from, StartIndex& starts) const;
+        size_t count(std::string_view text) const;
+        MatchRange matches(std::string_view text) const;
+
+        // Same answers as match/find, computed on up to `threads` cores
+        // (0: all of them). match splits the input into chunks and maps
+        // every state through each chunk, then composes the maps; find
+        // does the same with the reverse automaton from the end of the
+        // text, then scans every chunk backwards from its entry state for
+        // the leftmost start. find runs sequentially when find() would
+        // not scan backwards, and so do inputs under MIN_PARALLEL_CHUNK
+        // per thread.
+        static constexpr size_t MIN_PARALLEL_CHUNK = 1 << 16;
+        bool matchParallel(std::string_view str, size_t threads = 0) const;
+        std::optional<Match> findParallel(std::string_view text, size_t threads = 0) const;
+
+        // f(const Match&) may return bool; false stops the scan early.
+        // Returns the number of matches passed to f.
+        template<typename F>
+        size_t forEachMatch(std::string_view text, F&& f) const;
+
+        inline StateId start() const { return start_state; }
+        inline StateId step(StateId s, unsigned char ch) const {
+            return table[s + classmap[ch]];
+        }
+        inline bool is_final(StateId s) const { return s >= accept_from; }
+        inline bool is_dead(StateId s) const { return s == DEAD; }
+        // Sorted ids of the patterns accepted in s (see NFA::fromTrees),
+        // empty for non-accepting states.
+        inline std::span<const uint32_t> patterns(StateId s) const {
+            if (!is_final(s)) return {};
+            size_t f = (s - accept_from) / num_classes;
+            const uint32_t* ids = tags + (num_states - accept_from / num_classes) + 1;
+            return { ids + tags[f], ids + tags[f + 1] };
+        }
+
+        inline size_t stateCount() const { return num_states; }
+        inline size_t stride() const { return num_classes; }
+        inline uint8_t classOf(unsigned char ch) const { return classmap[ch]; }
+        inline bool empty() const { return table == nullptr; }
+        inline const Prefilter& prefilter() const { return pf; }
+
+        // .* followed by the reversed language, minimized. Built by the
+        // first call, once for all copies, so match() alone never pays for
+        // it; null when its determinization went over REVERSE_MAX_STATES
+        // or REVERSE_MAX_WORK (see DKA::reversed).
+        static constexpr size_t REVERSE_MAX_STATES = 1 << 14;
+        static constexpr size_t REVERSE_MAX_WORK = 1 << 22;
+        const CompiledDKA* reverse() const;
+        // Whether find() knows the starts without trying every begin: by
+        // the reverse automaton, or because the pattern is nullable.
+        inline bool scansBackwards() const {
+            if (empty()) return false;
+            if (is_final(start_state)) return true;
+            return !(pf.active() && pf.maxOffset() != std::string::npos) && reverse() != nullptr;
+        }
+
+    private:
+        void build(const DKA& dka);
+        std::shared_ptr<const CompiledDKA> buildReverse() const;
+        size_t longestFrom(std::string_view text, size_t begin) const;
+        size_t longestFrom(std::string_view text, size_t begin, StartIndex& starts) const;
+        std::optional<Match> findStarting(std::string_view text, size_t from, size_t last_begin) const;
+        void mapChunk(std::string_view chunk, std::vector<StateId>& out, bool backwards = false) const;
+        static size_t chunkCount(size_t bytes, size_t threads);
+        size_t tagWords() const;
+
+        std::shared_ptr<const void> storage;
+        const uint8_t* classmap = nullptr;
+        const StateId* table = nullptr;
+        const uint32_t* tags = nullptr;     // offsets per final row, then ids
+        size_t num_states = 0;
+        size_t num_classes = 0;
+        StateId start_state = DEAD;
+        StateId accept_from = 0;
+        Prefilter pf;
+
+        struct ReverseSlot {
+            std::once_flag built;
+            std::shared_ptr<const CompiledDKA> dka;
+        };
+        // shared by copies; null in the reverse automaton itself
+        std::shared_ptr<ReverseSlot> rev;
+    };
+
+    // Where the matches of one text may start, from a single backward
+    // scan with the reverse automaton (none for a nullable pattern). One
+    // state is kept every BLOCK bytes; the starts inside a block are
+    // recomputed from it when the search gets there. It also keeps the
+    // trail of the forward scan that went furthest, one state every
+    // TRAIL_STEP bytes, for later scans to join.
+    class StartIndex {
+    public:
+        StartIndex(const CompiledDKA& dka, std::string_view text);
+
+        // Smallest match start at or after from, npos if there is none.
+        size_t next(size_t from);
+
+    private:
+        friend class CompiledDKA;
+        static constexpr size_t BLOCK = 4096;
+        static constexpr size_t TRAIL_STEP = 64;
+
+        const CompiledDKA* rev;
+        std::string_view text;
+        std::vector<CompiledDKA::StateId> checkpoints;   // state at each block's end
+        size_t loaded = SIZE_MAX;
+        std::bitset<BLOCK> starts;
+
+        // trail[j]: state at position trail_first + j * TRAIL_STEP
+        std::vector<CompiledDKA::StateId> trail, scratch;
+        size_t trail_first = 0;
+        size_t trail_last = SIZE_MAX;    // its last accepting position
+    };
+
+    template<typename F>
+    size_t CompiledDKA::forEachMatch(std::string_view text, F&& f) const {
+        std::optional<StartIndex> starts;
+        if (scansBackwards()) starts.emplace(*this, text);
+        size_t n = 0;
+        for (size_t pos = 0; pos <= text.size();) {
+            auto m = starts ? find(text, pos, *starts) : find(text, pos);
+            if (!m) break;
+            ++n;
+            if constexpr (std::is_same_v<std::invoke_result_t<F&, const Match&>, bool>) {
+                if (!f(*m)) break;
+            } else {
+                f(*m);
+            }
+            pos = m->end == m->begin ? m->end + 1 : m->end;
+        }
+        return n;
+    }
+
+    // Pull-style iteration over CompiledDKA::find results.
+    class MatchIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Match;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Match*;
+        using reference = const Match&;
+
+        MatchIterator() = default;
+        MatchIterator(const CompiledDKA* dka, std::string_view text)
+            : dka(dka), text(text) {
+            if (dka->scansBackwards())
+                starts = std::make_shared<StartIndex>(*dka, text);
+            advance(0);
+        }
+
+        inline reference operator*() const { return current; }
+        inline pointer operator->() const { return &current; }
+
+        inline MatchIterator& operator++() {
+            advance(current.end == current.begin ? current.end + 1 : current.end);
+            return *this;
+        }
+        inline MatchIterator operator++(int) {
+            MatchIterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        inline bool operator==(const MatchIterator& other) const {
+            return dka == other.dka && (dka == nullptr || current == other.current);
+        }
+
+    private:
+        const CompiledDKA* dka = nullptr;
+        std::string_view text;
+        Match current{0, 0};
+        std::shared_ptr<StartIndex> starts;   // shared by copies
+
+        inline void advance(size_t from) {
+            std::optional<Match> m;
+            if (from <= text.size())
+                m = starts ? dka->find(text, from, *starts) : dka->find(text, from);
+            if (m) current = *m;
+            else dka = nullptr;
+        }
+    };
+
+    class MatchRange {
+    public:
+        MatchRange(const CompiledDKA* dka, std::string_view text) : dka(dka), text(text) {}
+        inline MatchIterator begin() const { return MatchIterator(dka, text); }
+        inline MatchIterator end() const { return MatchIterator(); }
+
+    private:
+        const CompiledDKA* dka;
+        std::string_view text;
+    };
+
+    inline MatchRange CompiledDKA::matches(std::string_view text) const {
+        return MatchRange(this, text);
+    }
+
+}
+
+#endif
@@ -1,17 +1,18 @@
 #include "DKA.hpp"
 #include "regex_tree.hpp"
+#include "StateElimination.hpp"
 #include <stdexcept>
-#include <unordered_set>
+#include <unordered_map>
 #include <variant>
 #include <set>
 #include <map>
-#include <queue>
+#include <algorithm>
 
 namespace mgr {
     bool DKA::match(const std::string& str) const {
         size_t current = start_state;
         size_t counter = 0;
-        for (char ch : str) {
+        for (unsigned char ch : str) {
             bool advanced = false;
             for (const auto& tr : states[current].transitions) {
                 // std::cerr << tr.from << ':' << tr.to << '\n' << counter++ << '\n';
@@ -26,160 +27,302 @@ namespace mgr {
         return states[current].is_final;
     }
 
-    using Frontier = std::unordered_set<size_t>;
-
-    DKA::Frontier DKA::addOnce(const NodePtr& node, Frontier from) {
-        NodeType type = getType(node);
-
-        switch (type) {
-            case NodeType::Literal:
-            case NodeType::Wildcard: {
-                Frontier next;
-                for (size_t s : from) {
-                    size_t t = addState();
-                    if (auto* lit = std::get_if<Literal>(node.get()))
-                        addTransition(s, lit->value, lit->value, t);
-                    else
-                        addTransition(s, ' ', '~', t);
-                    next.insert(t);
-                }
-                return next;
-            }
+    void DKA::TreeToDKA(const RegexTree& rt, size_t unroll_limit, Encoding encoding) {
+        *this = fromNFA(NFA::fromTree(rt, unroll_limit, encoding));
+    }
 
-            case NodeType::Repeat:
-                return addRepeat(std::get<Repeat>(*node), from);
+    // Subset construction over byte classes; empty sets become missing
+    // transitions, adjacent bytes with the same target are merged.
+    DKA DKA::fromNFA(const NFA& nfa) {
+        DKA res;
+        const ByteClasses classes = nfa.byteClasses();
+        const size_t k = classes.count();
+        std::vector<unsigned char> reps(k);
+        for (size_t c = 0; c < k; ++c)
+            reps[c] = classes.representative(c);
+
+        NFA::Workspace ws;
+        std::unordered_map<std::vector<uint32_t>, size_t, NFA::SetHash> index;
+        std::vector<std::vector<uint32_t>> sets;
+
+        auto intern = [&](std::vector<uint32_t>& set) -> size_t {
+            auto it = index.find(set);
+            if (it != index.end()) return it->second;
+            size_t id = res.addState(nfa.accepts(set));
+            nfa.patterns(set, res.states[id].patterns);
+            index.emplace(set, id);
+            sets.push_back(set);
+            return id;
+        };
 
-            case NodeType::Alternation:
-                return addAlternation(std::get<Alternation>(*node), from);
+        std::vector<uint32_t> set;
+        nfa.initial(set, ws);
+        res.start_state = intern(set);
 
-            case NodeType::Concat: {
-                Frontier cur = from;
-                for (const auto& child : std::get<Concat>(*node).children)
-                    cur = addOnce(child, cur);
-                return cur;
+        std::vector<size_t> target(k);
+        std::vector<uint32_t> next;
+        for (size_t i = 0; i < sets.size(); ++i) {
+            for (size_t c = 0; c < k; ++c) {
+                nfa.step(sets[i], reps[c], next, ws);
+                target[c] = next.empty() ? SIZE_MAX : intern(next);
             }
+            int b = 0;
+            while (b < 256) {
+                size_t t = target[classes[static_cast<unsigned char>(b)]];
+                int e = b;
+                while (e + 1 < 256 && target[classes[static_cast<unsigned char>(e + 1)]] == t)
+                    ++e;
+                if (t != SIZE_MAX)
+                    res.addTransition(i, static_cast<char>(b), static_cast<char>(e), t);
+                b = e + 1;
+            }
+        }
+        return res;
+    }
 
-            case NodeType::End:
-            case NodeType::Epsilon:
-                return from;
+    ByteClasses DKA::byteClasses() const {
+        std::vector<ByteClasses::Range> ranges;
+        for (const auto& st : states)
+            for (const auto& tr : st.transitions)
+                ranges.emplace_back(tr.from, tr.to);
+        std::sort(ranges.begin(), ranges.end());
+        ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+
+        ByteClasses classes;
+        for (auto [from, to] : ranges)
+            classes.split(from, to);
+        return classes;
+    }
 
-            default:
-                throw std::logic_error("Unsupported node type in addOnce");
-        }
+    void DKA::minimize(MinimizeAlgo algo) {
+        if (algo == MinimizeAlgo::Moore)
+            minimizeMoore();
+        else
+            minimizeHopcroft();
     }
 
-    DKA::Frontier DKA::addRepeat(const Repeat& rep, Frontier from)
-    {
-        Frontier entry = from;
-        for (int i = 0; i < rep.min; ++i)
-            entry = addOnce(rep.child, entry);
+    // Hopcroft partition refinement over flat arrays. The automaton is read
+    // deterministically (first matching transition wins, as in match) and
+    // completed with an implicit sink; the sink's block and everything
+    // unreachable from the start are dropped from the result.
+    void DKA::minimizeHopcroft() {
+        const size_t n = states.size();
+        if (n == 0) return;
+
+        const ByteClasses classes = byteClasses();
+        const size_t k = classes.count();
+        const size_t N = n + 1;
+        const uint32_t sink = static_cast<uint32_t>(n);
+
+        std::vector<unsigned char> reps(k);
+        for (size_t c = 0; c < k; ++c)
+            reps[c] = classes.representative(c);
+
+        std::vector<uint32_t> delta(N * k, sink);
+        for (size_t s = 0; s < n; ++s)
+            for (size_t c = 0; c < k; ++c)
+                for (const auto& tr : states[s].transitions)
+                    if (reps[c] >= tr.from && reps[c] <= tr.to) {
+                        delta[s * k + c] = static_cast<uint32_t>(tr.target);
+                        break;
+                    }
 
-        Frontier exits = addOnce(rep.child, entry);
+        // inverse transitions per class in CSR form: inv_begin[c * (N + 1) + t]
+        std::vector<uint32_t> inv_begin(k * (N + 1), 0);
+        std::vector<uint32_t> inv(N * k);
+        for (size_t s = 0; s < N; ++s)
+            for (size_t c = 0; c < k; ++c)
+                ++inv_begin[c * (N + 1) + delta[s * k + c] + 1];
+        for (size_t c = 0; c < k; ++c) {
+            uint32_t* row = &inv_begin[c * (N + 1)];
+            row[0] += static_cast<uint32_t>(c * N);
+            for (size_t t = 1; t <= N; ++t)
+                row[t] += row[t - 1];
+        }
+        {
+            std::vector<uint32_t> fill(inv_begin);
+            for (size_t s = 0; s < N; ++s)
+                for (size_t c = 0; c < k; ++c)
+                    inv[fill[c * (N + 1) + delta[s * k + c]]++] = static_cast<uint32_t>(s);
+        }
 
-        if (rep.max == INFINITY) {
-            for (size_t src : exits) {
-                for (size_t e : entry) {
-                    for (const auto& tr : states[e].transitions)
-                        addTransition(src, tr.from, tr.to, tr.target);
+        // refinable partition: blocks are contiguous slices of elems; the
+        // initial blocks are the non-final states and one block per
+        // distinct pattern set of the final ones
+        std::vector<uint32_t> elems(N), loc(N), block_of(N);
+        std::vector<uint32_t> first, end, marked;
+        {
+            std::map<std::vector<uint32_t>, uint32_t> group_of;
+            std::vector<uint32_t> group(N, 0), group_size(1, 0);
+            for (size_t s = 0; s < n; ++s) {
+                if (!states[s].is_final) continue;
+                auto [it, added] = group_of.emplace(states[s].patterns,
+                                                    static_cast<uint32_t>(group_size.size()));
+                if (added) group_size.push_back(0);
+                group[s] = it->second;
+            }
+            for (size_t s = 0; s < N; ++s)
+                ++group_size[group[s]];
+
+            std::vector<uint32_t> fill(group_size.size());
+            uint32_t pos = 0;
+            for (size_t g = 0; g < group_size.size(); ++g) {
+                fill[g] = pos;
+                if (group_size[g] != 0) {
+                    first.push_back(pos);
+                    end.push_back(pos + group_size[g]);
+                    marked.push_back(0);
                 }
+                pos += group_size[g];
+            }
+            std::vector<uint32_t> block_index(group_size.size(), 0);
+            for (size_t g = 0, b = 0; g < group_size.size(); ++g)
+                if (group_size[g] != 0) block_index[g] = static_cast<uint32_t>(b++);
+            for (size_t s = 0; s < N; ++s) {
+                uint32_t g = group[s];
+                elems[fill[g]] = static_cast<uint32_t>(s);
+                loc[s] = fill[g]++;
+                block_of[s] = block_index[g];
             }
-            exits.insert(entry.begin(), entry.end());
-            return exits;
         }
 
-        for (int i = 0; i < rep.max - rep.min - 1; ++i) {
-            exits = addOnce(rep.child, exits);
-        }
-        exits.insert(entry.begin(), entry.end());
-        return exits;
-    }
+        std::vector<uint32_t> work;           // pending splitters, block * k + c
+        std::vector<uint8_t> in_work;
+        auto push = [&](uint32_t b, size_t c) {
+            size_t key = b * k + c;
+            if (in_work.size() <= key) in_work.resize((b + 1) * k, 0);
+            if (in_work[key]) return;
+            in_work[key] = 1;
+            work.push_back(static_cast<uint32_t>(key));
+        };
 
-    DKA::Frontier DKA::addAlternation(const Alternation& alt, Frontier from)
-    {
-        Frontier merged;
-        for (const auto& branch : alt.children) {
-            Frontier copy = from;
-            merged.merge(addOnce(branch, copy));
+        {
+            // every initial block but the largest one is a splitter
+            uint32_t largest = 0;
+            for (uint32_t b = 1; b < first.size(); ++b)
+                if (end[b] - first[b] > end[largest] - first[largest])
+                    largest = b;
+            for (uint32_t b = 0; b < first.size(); ++b)
+                if (b != largest || first.size() == 1)
+                    for (size_t c = 0; c < k; ++c)
+                        push(b, c);
         }
-        return merged;
-    }
-
-
-
-    Frontier DKA::TreeToDKA_Helper(const NodePtr& node, Frontier from) {
-        NodeType type = getType(node);
-
-        switch (type) {
-            case NodeType::Literal:
-            case NodeType::Wildcard:
-                return addOnce(node, from);
 
-            case NodeType::Repeat:
-                return addRepeat(std::get<Repeat>(*node), from);
-
-            case NodeType::Alternation: {
-                Frontier result;
-                for (auto& child : std::get<Alternation>(*node).children) {
-                    Frontier copy = from;
-                    result.merge(TreeToDKA_Helper(child, copy));
+        std::vector<uint32_t> splitter, touched;
+        while (!work.empty()) {
+            const uint32_t key = work.back();
+            work.pop_back();
+            in_work[key] = 0;
+            const uint32_t b = key / k;
+            const size_t c = key % k;
+
+            splitter.assign(elems.begin() + first[b], elems.begin() + end[b]);
+            const uint32_t* row = &inv_begin[c * (N + 1)];
+            for (uint32_t q : splitter)
+                for (uint32_t i = row[q]; i < row[q + 1]; ++i) {
+                    uint32_t p = inv[i];
+                    uint32_t x = block_of[p];
+                    uint32_t slot = first[x] + marked[x];
+                    if (loc[p] < slot) continue;   // already marked
+                    if (marked[x] == 0) touched.push_back(x);
+                    uint32_t other = elems[slot];
+                    std::swap(elems[loc[p]], elems[slot]);
+                    loc[other] = loc[p];
+                    loc[p] = slot;
+                    ++marked[x];
                 }
-                return result;
-            }
 
-            case NodeType::Concat: {
-                Frontier cur = from;
-                for (auto& child : std::get<Concat>(*node).children) {
-                    cur = TreeToDKA_Helper(child, cur);
+            for (uint32_t x : touched) {
+                const uint32_t m = marked[x];
+                marked[x] = 0;
+                if (m == end[x] - first[x]) continue;
+
+                // the marked prefix becomes a new block y
+                const uint32_t y = static_cast<uint32_t>(first.size());
+                first.push_back(first[x]);
+                end.push_back(first[x] + m);
+                marked.push_back(0);
+                first[x] += m;
+                for (uint32_t i = first[y]; i < end[y]; ++i)
+                    block_of[elems[i]] = y;
+
+                const uint32_t size_x = end[x] - first[x];
+                for (size_t a = 0; a < k; ++a) {
+                    size_t kx = x * k + a;
+                    if (kx < in_work.size() && in_work[kx])
+                        push(y, a);
+                    else
+                        push(size_x < m ? x : y, a);
                 }
-                return cur;
             }
+            touched.clear();
+        }
 
-            case NodeType::End: {
-                for (size_t s : from)
-                    states[s].is_final = true;
-                return from;
+        // rebuild from block representatives, coalescing bytes into ranges
+        const uint32_t dead = block_of[sink];
+        const uint32_t start_block = block_of[start_state];
+        std::vector<State> new_states;
+        std::vector<size_t> block_id(first.size(), SIZE_MAX);
+        std::vector<uint32_t> order;
+        if (start_block != dead) {
+            block_id[start_block] = 0;
+            order.push_back(start_block);
+        }
+        for (size_t i = 0; i < order.size(); ++i) {
+            const uint32_t rep = elems[first[order[i]]];
+            for (size_t c = 0; c < k; ++c) {
+                uint32_t t = block_of[delta[rep * k + c]];
+                if (t == dead || block_id[t] != SIZE_MAX) continue;
+                block_id[t] = order.size();
+                order.push_back(t);
             }
-
-            case NodeType::Epsilon:
-                return from;
-
-            case NodeType::EmptySet:
-                return {};
-
-            default:
-                throw std::logic_error("Unknown node type in TreeToDKA_Helper");
         }
-    }
-
 
-    void DKA::TreeToDKA(const RegexTree& rt) {
-        if (!rt.root)
-            throw std::logic_error("Regex tree is empty");
+        new_states.resize(std::max<size_t>(order.size(), 1));
+        for (size_t i = 0; i < order.size(); ++i) {
+            const uint32_t rep = elems[first[order[i]]];
+            new_states[i].is_final = rep < n && states[rep].is_final;
+            if (new_states[i].is_final)
+                new_states[i].patterns = states[rep].patterns;
+            auto& out = new_states[i].transitions;
+            int b = 0;
+            while (b < 256) {
+                uint32_t t = block_of[delta[rep * k + classes[static_cast<unsigned char>(b)]]];
+                int e = b;
+                while (e + 1 < 256 &&
+                       block_of[delta[rep * k + classes[static_cast<unsigned char>(e + 1)]]] == t)
+                    ++e;
+                if (t != dead)
+                    out.push_front(Transition{ static_cast<unsigned char>(b), static_cast<unsigned char>(e), block_id[t] });
+                b = e + 1;
+            }
+        }
 
-        addState();
-        Frontier start{ start_state };
-        TreeToDKA_Helper(rt.root, start);
+        start_state = 0;
+        states = std::move(new_states);
     }
 
-
-    void DKA::minimize() {
+    // Moore-style refinement, kept for cross-checking the Hopcroft result.
+    void DKA::minimizeMoore() {
         size_t n = states.size();
         if (n <= 1) return;
 
-        std::set<char> alphabet;
-        for (const auto& st : states)
-            for (const auto& tr : st.transitions)
-                for (char c = tr.from; c <= tr.to; ++c)
-                    alphabet.insert(c);
+        // one representative byte per equivalence class is enough
+        ByteClasses classes = byteClasses();
+        std::vector<unsigned char> alphabet(classes.count());
+        for (size_t k = 0; k < classes.count(); ++k)
+            alphabet[k] = classes.representative(k);
 
         std::vector<std::set<size_t>> partitions;
         std::map<size_t, size_t> state_to_class;
 
-        std::set<size_t> final, non_final;
+        std::map<std::vector<uint32_t>, std::set<size_t>> finals;
+        std::set<size_t> non_final;
         for (size_t i = 0; i < n; ++i)
-            (states[i].is_final ? final : non_final).insert(i);
+            if (states[i].is_final) finals[states[i].patterns].insert(i);
+            else non_final.insert(i);
 
-        if (!final.empty()) partitions.push_back(final);
+        for (auto& [_, group] : finals) partitions.push_back(std::move(group));
         if (!non_final.empty()) partitions.push_back(non_final);
 
         for (size_t i = 0; i < partitions.size(); ++i)
@@ -196,7 +339,7 @@ namespace mgr {
 
                 for (size_t s : cls) {
                     std::vector<size_t> signature;
-                    for (char c : alphabet) {
+                    for (unsigned char c : alphabet) {
                         size_t next = n + 1;
                         for (const auto& tr : states[s].transitions)
                             if (c >= tr.from && c <= tr.to) {
@@ -229,8 +372,11 @@ namespace mgr {
         for (size_t i = 0; i < partitions.size(); ++i) {
             size_t repr = *partitions[i].begin(); // representative
             new_states[i].is_final = states[repr].is_final;
+            new_states[i].patterns = states[repr].patterns;
+            // keep the list order: the first matching transition wins
+            auto pos = new_states[i].transitions.before_begin();
             for (const auto& tr : states[repr].transitions)
-                new_states[i].transitions.push_front(Transition{
+                pos = new_states[i].transitions.insert_after(pos, Transition{
                     tr.from, tr.to, state_to_class[tr.target]
                 });
         }
@@ -239,178 +385,225 @@ namespace mgr {
         states = std::move(new_states);
     }
 
-        static std::string concat(const std::string& a, const std::string& b) {
-        if (a.empty()) return b;
-        if (b.empty()) return a;
-        return a + b;
-    }
-
-    static std::string alt(const std::string& a, const std::string& b) {
-        if (a.empty()) return b;
-        if (b.empty()) return a;
-        if (a == b) return a;
-        return "(" + a + "|" + b + ")";
-    }
-
-    static std::string star(const std::string& a) {
-        if (a.empty()) return "";
-        return "(" + a + ")*";
-    }
-
     std::string DKA::to_regex() const
     {
-        std::vector<bool> reachable(states.size(), false);
-        std::queue<size_t> q;
-        q.push(start_state);
-        reachable[start_state] = true;
-        while (!q.empty()) {
-            size_t s = q.front(); q.pop();
-            for (auto& tr : states[s].transitions)
-                if (!reachable[tr.target]) {
-                    reachable[tr.target] = true;
-                    q.push(tr.target);
-                }
-        }
-
-        std::vector<size_t> mapOld2New(states.size(), SIZE_MAX);
-        std::vector<State>  compact;
-        for (size_t i = 0; i < states.size(); ++i)
-            if (reachable[i]) {
-                mapOld2New[i] = compact.size();
-                compact.push_back(states[i]);
-            }
-
-        DKA tmp;
-        tmp.states      = std::move(compact);
-        tmp.start_state = mapOld2New[start_state];
+        DKA tmp = *this;
         tmp.minimize();
-
-        const size_t N = tmp.states.size();
-        if (N == 0) return "";
-
-        size_t start = tmp.start_state;
-        size_t final = 0;
-        for (size_t i = 0; i < N; ++i)
-            if (tmp.states[i].is_final) { final = i; break; }
-
-        std::vector<std::vector<std::string>> R(N, std::vector<std::string>(N, ""));
-        auto capped = [](std::string s) {
-            const size_t LIM = 2048;
-            return (s.size() > LIM) ? std::string("#LONG#") : s;
-        };
-
-        for (size_t i = 0; i < N; ++i)
-            for (auto& tr : tmp.states[i].transitions) {
-                std::string lbl = (tr.from == tr.to) ? std::string(1, tr.from) : ".";
-                R[i][tr.target] = lbl;
-            }
-
-        auto alt = [](const std::string& a,const std::string& b){
-            if (a.empty()) return b;
-            if (b.empty()||a==b) return a;
-            return "(" + a + "|" + b + ")";
-        };
-        auto concat = [](const std::string& a,const std::string& b){
-            if (a.empty()) return b;
-            if (b.empty()) return a;
-            return a + b;
-        };
-        auto star = [](const std::string& a){
-            if (a.empty() || a == "#LONG#") return a;
-            return "(" + a + ")*";
-        };
-
-        for (size_t k = 0; k < N; ++k)
-            for (size_t i = 0; i < N; ++i)
-                for (size_t j = 0; j < N; ++j) {
-                    std::string part = concat(R[i][k], concat(star(R[k][k]), R[k][j]));
-                    R[i][j] = capped(alt(R[i][j], part));
-                }
-
-        return R[start][final];
+        return eliminateStates(tmp);
     }
 
-
     void DKA::complete() {
         size_t N = states.size();
 
-        const int ALPHABET_SIZE = '~' - ' ' + 1;
-        std::vector<std::vector<bool>> covered(N, std::vector<bool>(ALPHABET_SIZE, false));
-
-        for (size_t i = 0; i < N; ++i) {
-            for (const auto& tr : states[i].transitions) {
-                for (char c = tr.from; c <= tr.to; ++c) {
-                    covered[i][c - ' '] = true;
-                }
-            }
-        }
+        // a class is either fully covered by a state's transitions or not at all
+        ByteClasses classes = byteClasses();
+        std::vector<unsigned char> reps(classes.count());
+        for (size_t k = 0; k < classes.count(); ++k)
+            reps[k] = classes.representative(k);
 
         size_t sink = addState(false);
-        N = states.size();
 
-        for (size_t i = 0; i < N - 1; ++i) {
-            for (char c = ' '; c <= '~'; ++c) {
-                if (!covered[i][c - ' ']) {
-                    addTransition(i, c, c, sink);
-                }
+        for (size_t i = 0; i < N; ++i) {
+            std::vector<bool> covered(classes.count(), false);
+            for (const auto& tr : states[i].transitions)
+                for (size_t k = 0; k < classes.count(); ++k)
+                    if (reps[k] >= tr.from && reps[k] <= tr.to)
+                        covered[k] = true;
+
+            // adjacent runs of different classes share one transition
+            std::vector<ByteClasses::Range> missing;
+            for (size_t k = 0; k < classes.count(); ++k)
+                if (!covered[k])
+                    for (auto run : classes.runs(k))
+                        missing.push_back(run);
+            std::sort(missing.begin(), missing.end());
+            for (size_t j = 0; j < missing.size();) {
+                auto [from, to] = missing[j];
+                while (++j < missing.size() && missing[j].first == to + 1)
+                    to = missing[j].second;
+                addTransition(i, from, to, sink);
             }
         }
 
-        for (char c = ' '; c <= '~'; ++c) {
-            addTransition(sink, c, c, sink);
-        }
+        addTransition(sink, 0, 0xFF, sink);
     }
 
-
-
-
     DKA DKA::complement() const {
         DKA result = *this;
         result.complete();
-        for (auto& state : result.states)
+        for (auto& state : result.states) {
             state.is_final = !state.is_final;
+            state.patterns.clear();
+        }
         return result;
     }
 
-    DKA DKA::intersect(const DKA& other) const {
-        DKA result;
-        using Pair = std::pair<size_t, size_t>;
-        std::map<Pair, size_t> state_map;
-        std::queue<Pair> q;
-
-        auto get_state = [&](Pair p) -> size_t {
-            if (state_map.count(p)) return state_map[p];
-            bool final = states[p.first].is_final && other.states[p.second].is_final;
-            size_t id = result.addState(final);
-            state_map[p] = id;
-            q.push(p);
-            return id;
+    size_t DKA::next(size_t state, unsigned char ch) const {
+        for (const auto& tr : states[state].transitions)
+            if (ch >= tr.from && ch <= tr.to)
+                return tr.target;
+        return NO_STATE;
+    }
+
+    namespace {
+
+        struct Range {
+            unsigned char from, to;
+            size_t target;
         };
 
-        result.start_state = get_state({start_state, other.start_state});
+        std::vector<Range> sortedRanges(const DKA::State& st) {
+            std::vector<Range> res;
+            for (const auto& tr : st.transitions)
+                res.push_back(Range{ tr.from, tr.to, tr.target });
+            std::sort(res.begin(), res.end(), [](const Range& a, const Range& b) { return a.from < b.from; });
+            return res;
+        }
 
-        while (!q.empty()) {
-            auto [s1, s2] = q.front(); q.pop();
-            size_t id = state_map[{s1, s2}];
+    }
 
-            for (const auto& tr1 : states[s1].transitions) {
-                for (const auto& tr2 : other.states[s2].transitions) {
-                    char from = std::max(tr1.from, tr2.from);
-                    char to   = std::min(tr1.to, tr2.to);
-                    if (from <= to) {
-                        size_t tgt = get_state({tr1.target, tr2.target});
-                        result.addTransition(id, from, to, tgt);
-                    }
+    DKA DKA::product(const DKA& other, bool difference) const {
+        // other's side of a pair is one of its states or, for differences,
+        // the sink of its complement
+        const size_t sink = other.states.size();
+        DKA result;
+        std::unordered_map<uint64_t, size_t> ids;
+        std::vector<std::pair<size_t, size_t>> pairs;   // by result state
+        std::vector<std::vector<Range>> ranges_a(states.size()), ranges_b(other.states.size());
+        std::vector<bool> sorted_a(states.size(), false), sorted_b(other.states.size(), false);
+
+        auto id = [&](size_t a, size_t b) -> size_t {
+            uint64_t key = static_cast<uint64_t>(a) * (sink + 1) + b;
+            auto [it, inserted] = ids.try_emplace(key, result.states.size());
+            if (inserted) {
+                bool b_final = b != sink && other.states[b].is_final;
+                result.addState(states[a].is_final && (difference ? !b_final : b_final));
+                pairs.emplace_back(a, b);
+            }
+            return it->second;
+        };
+        auto link = [&](size_t from, unsigned from_ch, unsigned to_ch, size_t a, size_t b) {
+            if (from_ch <= to_ch)
+                result.addTransition(from, static_cast<unsigned char>(from_ch),
+                                     static_cast<unsigned char>(to_ch), id(a, b));
+        };
+
+        result.start_state = id(start_state, other.start_state);
+        for (size_t cur = 0; cur < pairs.size(); ++cur) {
+            auto [a, b] = pairs[cur];
+            if (!sorted_a[a]) { ranges_a[a] = sortedRanges(states[a]); sorted_a[a] = true; }
+            const std::vector<Range>& ra = ranges_a[a];
+
+            if (b == sink) {
+                for (const Range& x : ra)
+                    link(cur, x.from, x.to, x.target, sink);
+                continue;
+            }
+            if (!sorted_b[b]) { ranges_b[b] = sortedRanges(other.states[b]); sorted_b[b] = true; }
+            const std::vector<Range>& rb = ranges_b[b];
+
+            // both lists are sorted and disjoint: one merge pass
+            size_t j = 0;
+            for (const Range& x : ra) {
+                unsigned pos = x.from;
+                while (j < rb.size() && rb[j].to < x.from) ++j;
+                for (size_t k = j; k < rb.size() && rb[k].from <= x.to; ++k) {
+                    const Range& y = rb[k];
+                    if (difference && pos < y.from)
+                        link(cur, pos, y.from - 1u, x.target, sink);
+                    link(cur, std::max(x.from, y.from), std::min(x.to, y.to), x.target, y.target);
+                    pos = static_cast<unsigned>(y.to) + 1;
                 }
+                if (difference && pos <= x.to)
+                    link(cur, pos, x.to, x.target, sink);
             }
         }
-
         return result;
     }
 
+    DKA DKA::intersect(const DKA& other) const {
+        return product(other, false);
+    }
+
     DKA DKA::operator-(const DKA& other) const {
-        return this->intersect(other.complement());
+        return product(other, true);
     }
 
+    bool DKA::matchIntersection(const DKA& other, const std::string& str) const {
+        size_t a = start_state, b = other.start_state;
+        for (unsigned char ch : str) {
+            a = next(a, ch);
+            if (a == NO_STATE) return false;
+            b = other.next(b, ch);
+            if (b == NO_STATE) return false;
+        }
+        return states[a].is_final && other.states[b].is_final;
+    }
+
+    bool DKA::matchDifference(const DKA& other, const std::string& str) const {
+        size_t a = start_state, b = other.start_state;
+        for (unsigned char ch : str) {
+            a = next(a, ch);
+            if (a == NO_STATE) return false;
+            // out of other: its complement's sink, which reads every byte
+            if (b != NO_STATE) b = other.next(b, ch);
+        }
+        return states[a].is_final && (b == NO_STATE || !other.states[b].is_final);
+    }
+
+    std::optional<DKA> DKA::reversed(bool unanchored, size_t max_states, size_t max_work) const {
+        const ByteClasses classes = byteClasses();
+        const size_t k = classes.count(), n = states.size();
+
+        // pred[c * n + t]: states reaching t on class c
+        std::vector<std::vector<uint32_t>> pred(k * n);
+        for (size_t p = 0; p < n; ++p)
+            for (size_t c = 0; c < k; ++c) {
+                size_t t = next(p, classes.representative(c));
+                if (t != NO_STATE) pred[c * n + t].push_back(static_cast<uint32_t>(p));
+            }
+        std::vector<uint32_t> finals;
+        for (size_t p = 0; p < n; ++p)
+            if (states[p].is_final) finals.push_back(static_cast<uint32_t>(p));
+
+        DKA res;
+        std::unordered_map<std::vector<uint32_t>, size_t, NFA::SetHash> index;
+        std::vector<std::vector<uint32_t>> sets;
+        auto intern = [&](std::vector<uint32_t>& set) -> size_t {
+            auto it = index.find(set);
+            if (it != index.end()) return it->second;
+            size_t id = res.addState(std::binary_search(set.begin(), set.end(), start_state));
+            index.emplace(set, id);
+            sets.push_back(set);
+            return id;
+        };
+
+        std::vector<uint32_t> set = finals;
+        res.start_state = intern(set);
+        std::vector<size_t> target(k);
+        size_t work = 0;
+        for (size_t i = 0; i < sets.size(); ++i) {
+            if (sets.size() > max_states) return std::nullopt;
+            for (size_t c = 0; c < k; ++c) {
+                set.clear();
+                if (unanchored) set = finals;
+                for (uint32_t t : sets[i])
+                    set.insert(set.end(), pred[c * n + t].begin(), pred[c * n + t].end());
+                // sets of a long chain grow with it, the count of sets alone
+                // does not bound the time
+                work += set.size();
+                if (work > max_work) return std::nullopt;
+                std::sort(set.begin(), set.end());
+                set.erase(std::unique(set.begin(), set.end()), set.end());
+                target[c] = set.empty() ? SIZE_MAX : intern(set);
+            }
+            for (size_t c = 0; c < k; ++c)
+                if (target[c] != SIZE_MAX)
+                    for (auto [from, to] : classes.runs(c))
+                        res.addTransition(i, from, to, target[c]);
+        }
+        res.minimize();
+        return res;
+    }
 
-}
\ No newline at end of file
+}
@@ -2,54 +2,85 @@
 #define DKA_HPP_
 
 #include <forward_list>
+#include <optional>
 #include <vector>
-#include <unordered_set>
 #include <string>
 #include "regex_tree.hpp"
+#include "ByteClasses.hpp"
+#include "NFA.hpp"
 
 namespace mgr {
 
+    enum class MinimizeAlgo {
+        Hopcroft,
+        Moore
+    };
+
     class DKA {
     public:
 
         struct Transition{
-            char from = ' ', to = '~';
+            unsigned char from = 0, to = 0xFF;
             size_t target;
         };
 
         struct State{
-            std::forward_list<Transition> transitions;
+            std::forward_list<Transition> transitions{};
             bool is_final = false;
+            // ids of the accepted patterns (sorted), see NFA::fromTrees
+            std::vector<uint32_t> patterns{};
         };
 
         std::vector<State> states;
         size_t start_state = 0;
 
         inline size_t addState(bool is_final = false) {
-            states.push_back(State{ {}, is_final });
+            states.push_back(State{ .is_final = is_final });
             return states.size() - 1;
         }
 
-        inline void addTransition(size_t from, char c1, char c2, size_t to) {
+        inline void addTransition(size_t from, unsigned char c1, unsigned char c2, size_t to) {
             // std::cerr << from << "->" << to << '\n';
             states[from].transitions.push_front(Transition{ c1, c2, to });
         }
 
-        void TreeToDKA(const RegexTree &rt);
-        void minimize();
+        void TreeToDKA(const RegexTree &rt, size_t unroll_limit = NFA::DEFAULT_UNROLL_LIMIT,
+                       Encoding encoding = Encoding::Ascii);
+        static DKA fromNFA(const NFA& nfa);
+        ByteClasses byteClasses() const;
+        // Final states with different pattern sets are never merged.
+        void minimize(MinimizeAlgo algo = MinimizeAlgo::Hopcroft);
         bool match(const std::string& str) const;
+        // Expression for the language, see eliminateStates; byte ranges
+        // other than '.' come out as [a-z] classes. Empty language: "".
         std::string to_regex()const;
+        // The sink and the complement take all 256 bytes.
         void complete();
         DKA complement() const;
+        // Both build only the reachable part of the product; pairs are
+        // hashed and each pair's transitions come from one merge of the
+        // two sorted range lists. operator- treats missing transitions of
+        // other as its complement's sink instead of completing it.
         DKA intersect(const DKA& other) const;
         DKA operator-(const DKA& other) const;
+        // The same languages without building anything: both automata
+        // are walked together over str.
+        bool matchIntersection(const DKA& other, const std::string& str) const;
+        bool matchDifference(const DKA& other, const std::string& str) const;
+        // Minimal automaton of the reversed language, determinized from
+        // predecessor sets. unanchored puts .* (any byte) in front, so
+        // reading a text backwards it is final right after the first byte
+        // of any match. nullopt once more than max_states sets come up, or
+        // once the sets built add up to more than max_work entries.
+        std::optional<DKA> reversed(bool unanchored = false, size_t max_states = SIZE_MAX,
+                                    size_t max_work = SIZE_MAX) const;
 
         private:
-        using Frontier = std::unordered_set<size_t>;
-        Frontier TreeToDKA_Helper(const NodePtr& node, Frontier from);
-        Frontier addOnce(const NodePtr& leaf, Frontier from);
-        Frontier addRepeat(const Repeat& rep, Frontier from);
-        Frontier addAlternation(const Alternation& alt, Frontier from);
+        static constexpr size_t NO_STATE = static_cast<size_t>(-1);
+        size_t next(size_t state, unsigned char ch) const;
+        DKA product(const DKA& other, bool difference) const;
+        void minimizeHopcroft();
+        void minimizeMoore();
     };
 
 }
@@ -0,0 +1,77 @@
+#include "LazyDKA.hpp"
+#include <stdexcept>
+
+namespace mgr {
+
+    LazyDKA::LazyDKA(std::shared_ptr<const NFA> nfa, size_t max_states)
+        : nfa(std::move(nfa)), max_states(max_states < 2 ? 2 : max_states) {
+        if (!this->nfa || this->nfa->start == NFA::NONE)
+            throw std::logic_error("LazyDKA: empty NFA");
+        classes = this->nfa->byteClasses();
+        num_classes = classes.count();
+        reps.resize(num_classes);
+        for (size_t c = 0; c < num_classes; ++c)
+            reps[c] = classes.representative(c);
+    }
+
+    void LazyDKA::flush() {
+        trans.clear();
+        sets.clear();
+        final.clear();
+        index.clear();
+        start_id = UNKNOWN;
+        ++flush_count;
+    }
+
+    LazyDKA::StateId LazyDKA::intern(const std::vector<uint32_t>& set) {
+        if (set.empty()) return DEAD;
+        auto it = index.find(set);
+        if (it != index.end()) return it->second;
+
+        if (sets.size() >= max_states) {
+            // set may alias a cached entry, keep a copy across the flush
+            std::vector<uint32_t> keep = set;
+            flush();
+            return intern(keep);
+        }
+
+        StateId id = static_cast<StateId>(sets.size());
+        sets.push_back(set);
+        final.push_back(nfa->accepts(set));
+        trans.resize(trans.size() + num_classes, UNKNOWN);
+        index.emplace(set, id);
+        return id;
+    }
+
+    LazyDKA::StateId LazyDKA::start() {
+        if (start_id == UNKNOWN) {
+            nfa->initial(scratch, ws);
+            start_id = intern(scratch);
+        }
+        return start_id;
+    }
+
+    LazyDKA::StateId LazyDKA::next(StateId s, uint8_t cls) {
+        StateId t = trans[s * num_classes + cls];
+        if (t != UNKNOWN) return t;
+
+        nfa->step(sets[s], reps[cls], scratch, ws);
+        size_t flushes_before = flush_count;
+        t = intern(scratch);
+        // after a flush s no longer names a cached state
+        if (flush_count == flushes_before)
+            trans[s * num_classes + cls] = t;
+        return t;
+    }
+
+    bool LazyDKA::match(std::string_view str) {
+        StateId s = start();
+        if (s == DEAD) return false;
+        for (unsigned char ch : str) {
+            s = next(s, classes[ch]);
+            if (s == DEAD) return false;
+        }
+        return final[s];
+    }
+
+}
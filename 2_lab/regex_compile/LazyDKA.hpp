@@ -0,0 +1,61 @@
+#ifndef LAZY_DKA_HPP_
+#define LAZY_DKA_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "NFA.hpp"
+
+namespace mgr {
+
+    // DFA determinized on demand from an NFA. A state is created the first
+    // time matching reaches it and its transitions are filled in as they
+    // are taken. Once max_states is reached the cache is flushed and
+    // rebuilt from the current position, so memory stays bounded even for
+    // patterns whose full DFA would explode.
+    // The cache is mutable: use one LazyDKA per thread, sharing the NFA.
+    class LazyDKA {
+    public:
+        using StateId = uint32_t;
+
+        static constexpr size_t DEFAULT_MAX_STATES = 4096;
+
+        explicit LazyDKA(std::shared_ptr<const NFA> nfa,
+                         size_t max_states = DEFAULT_MAX_STATES);
+
+        bool match(std::string_view str);
+
+        inline size_t cachedStates() const { return sets.size(); }
+        inline size_t flushes() const { return flush_count; }
+
+    private:
+        static constexpr StateId UNKNOWN = UINT32_MAX;
+        static constexpr StateId DEAD = UINT32_MAX - 1;
+
+        std::shared_ptr<const NFA> nfa;
+        ByteClasses classes;
+        std::vector<unsigned char> reps;
+        size_t num_classes;
+        size_t max_states;
+        size_t flush_count = 0;
+
+        std::vector<StateId> trans;      // cached states x classes
+        std::vector<std::vector<uint32_t>> sets;
+        std::vector<bool> final;
+        std::unordered_map<std::vector<uint32_t>, StateId, NFA::SetHash> index;
+        StateId start_id = UNKNOWN;
+
+        NFA::Workspace ws;
+        std::vector<uint32_t> scratch;
+
+        StateId start();
+        StateId next(StateId s, uint8_t cls);
+        StateId intern(const std::vector<uint32_t>& set);
+        void flush();
+    };
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include "Matcher.hpp"
+#include <algorithm>
+
+namespace mgr {
+
+    Matcher::Matcher(CompiledDKA dka)
+        : dka(std::move(dka)), anchored(this->dka.start()),
+          owner(this->dka.stateCount(), UINT32_MAX) {}
+
+    void Matcher::reset() {
+        anchored = dka.start();
+        off = pos = 0;
+        for (Group& g : groups) recycle(g);
+        groups.clear();
+        ready.clear();
+        prune_at = MIN_PRUNE;
+    }
+
+    size_t Matcher::retained() const {
+        size_t n = 0;
+        for (const Group& g : groups) n += g.begins.size() - g.head;
+        return n;
+    }
+
+    // a begin list from a dropped group if there is one, so a new run
+    // every byte does not mean an allocation every byte
+    void Matcher::open(CompiledDKA::StateId state, size_t last, size_t begin, bool dead) {
+        std::vector<size_t> begins;
+        if (!spare.empty()) {
+            begins = std::move(spare.back());
+            spare.pop_back();
+            begins.clear();
+        }
+        begins.push_back(begin);
+        groups.push_back(Group{ state, last, std::move(begins), 0, dead });
+    }
+
+    void Matcher::recycle(Group& g) {
+        if (g.begins.capacity() != 0) spare.push_back(std::move(g.begins));
+    }
+
+    Matcher::Snapshot Matcher::snapshot() const {
+        return Snapshot{ anchored, off, pos, groups };
+    }
+
+    void Matcher::restore(const Snapshot& s) {
+        anchored = s.anchored;
+        off = s.off;
+        pos = s.pos;
+        for (Group& g : groups) recycle(g);
+        groups = s.groups;
+        ready.clear();
+    }
+
+    size_t Matcher::front() const {
+        size_t best = NONE;
+        for (size_t g = 0; g < groups.size(); ++g)
+            if (best == NONE || groups[g].first() < groups[best].first())
+                best = g;
+        return best;
+    }
+
+    void Matcher::process(std::string_view chunk) {
+        if (dka.empty()) {
+            off += chunk.size();
+            return;
+        }
+        const CompiledDKA::StateId start = dka.start();
+        const bool start_final = dka.is_final(start);
+
+        for (unsigned char ch : chunk) {
+            const size_t i = off++;
+            anchored = dka.step(anchored, ch);
+
+            // a run beginning here, unless it dies on its first byte
+            if (i >= pos && (start_final || !dka.is_dead(dka.step(start, ch))))
+                open(start, start_final ? i : NONE, i);
+
+            for (Group& g : groups) {
+                if (g.dead) continue;
+                g.state = dka.step(g.state, ch);
+                if (dka.is_dead(g.state)) g.dead = true;
+                else if (dka.is_final(g.state)) g.last = i + 1;
+            }
+            compact();
+            resolve();
+        }
+    }
+
+    void Matcher::close() {
+        for (Group& g : groups) g.dead = true;
+        // the empty match at the very end
+        if (!dka.empty() && dka.is_final(dka.start()) && off >= pos)
+            open(dka.start(), off, off, true);
+        resolve();
+    }
+
+    // Runs in the same state have the same future. A later one is useless
+    // next to the earliest pending run unless it already holds a match
+    // that run would not cover; runs that have not accepted yet can share
+    // an entry, the earliest usable begin is picked when it matches.
+    void Matcher::compact() {
+        const size_t f = front();
+        if (f == NONE) return;
+        const CompiledDKA::StateId lead_state = groups[f].state;
+        const size_t lead_last = groups[f].last;
+        const bool lead_live = !groups[f].dead;
+        const size_t k = dka.stride();
+
+        size_t out = 0;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            Group& h = groups[g];
+            // a finished run without a match can never report anything
+            bool drop = h.dead && h.last == NONE;
+            if (g != f && !h.dead && lead_live && h.state == lead_state)
+                drop = h.last == NONE || (lead_last != NONE && lead_last > h.lastBegin());
+            if (!drop && g != f && !h.dead && h.last == NONE) {
+                uint32_t& o = owner[h.state / k];
+                if (o != UINT32_MAX && o < out) {
+                    Group& into = groups[o];
+                    if (into.lastBegin() < h.first()) {
+                        into.begins.insert(into.begins.end(), h.begins.begin() + h.head, h.begins.end());
+                    } else {
+                        merged.clear();
+                        std::merge(into.begins.begin() + into.head, into.begins.end(),
+                                   h.begins.begin() + h.head, h.begins.end(),
+                                   std::back_inserter(merged));
+                        into.begins.assign(merged.begin(), merged.end());
+                        into.head = 0;
+                    }
+                    drop = true;
+                } else {
+                    o = static_cast<uint32_t>(out);
+                }
+            }
+            if (drop) {
+                recycle(h);
+            } else {
+                if (out != g) groups[out] = std::move(h);
+                ++out;
+            }
+        }
+        groups.resize(out);
+        size_t longest = 0;
+        for (const Group& g : groups) {
+            if (!g.dead) owner[g.state / k] = UINT32_MAX;
+            longest = std::max(longest, g.begins.size() - g.head);
+        }
+        if (longest > prune_at) prune();
+    }
+
+    // pos only ever moves to the end of a reported match, or one past it.
+    // A match still to come either ends at the current last of some group
+    // or past the current byte, and then no begin held now is left. So of
+    // a group's begins only the first at or after pos, and the first at or
+    // after each last (and last + 1), can ever be picked.
+    void Matcher::prune() {
+        cuts.assign(1, pos);
+        for (const Group& g : groups)
+            if (g.last != NONE) {
+                cuts.push_back(g.last);
+                cuts.push_back(g.last + 1);
+            }
+        std::sort(cuts.begin(), cuts.end());
+        cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+        for (Group& g : groups) {
+            merged.clear();
+            auto from = g.begins.begin() + static_cast<std::ptrdiff_t>(g.head);
+            for (size_t c : cuts) {
+                from = std::lower_bound(from, g.begins.end(), c);
+                if (from == g.begins.end()) break;
+                if (merged.empty() || merged.back() != *from) merged.push_back(*from);
+            }
+            g.begins.assign(merged.begin(), merged.end());
+            g.head = 0;
+        }
+        prune_at = std::max(MIN_PRUNE, 2 * cuts.size());
+    }
+
+    // Reports the earliest pending run for as long as it is decided.
+    void Matcher::resolve() {
+        for (;;) {
+            size_t f = front();
+            if (f == NONE || !groups[f].dead) return;
+
+            Group g = std::move(groups[f]);
+            groups.erase(groups.begin() + static_cast<std::ptrdiff_t>(f));
+            const size_t begin = g.first(), last = g.last;
+            recycle(g);
+            if (last == NONE) continue;
+
+            ready.push_back(Match{ begin, last });
+            pos = last == begin ? last + 1 : last;
+
+            // runs that began inside the match are gone
+            size_t out = 0;
+            for (size_t h = 0; h < groups.size(); ++h) {
+                Group& x = groups[h];
+                while (x.head < x.begins.size() && x.begins[x.head] < pos) ++x.head;
+                if (x.head == x.begins.size()) {
+                    recycle(x);
+                    continue;
+                }
+                if (x.head > 32 && x.head * 2 > x.begins.size()) {
+                    x.begins.erase(x.begins.begin(), x.begins.begin() + static_cast<std::ptrdiff_t>(x.head));
+                    x.head = 0;
+                }
+                if (out != h) groups[out] = std::move(x);
+                ++out;
+            }
+            groups.resize(out);
+        }
+    }
+
+}
@@ -0,0 +1,110 @@
+#ifndef MATCHER_HPP_
+#define MATCHER_HPP_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "CompiledDKA.hpp"
+
+namespace mgr {
+
+    // Resumable search over a stream fed in arbitrary chunks. Reports the
+    // same leftmost-longest, non-overlapping matches as
+    // CompiledDKA::forEachMatch would on the concatenated input, with
+    // absolute offsets, without keeping any of the input: it tracks the
+    // DFA runs started at every still undecided position instead. Runs in
+    // the same state share one entry, so the work per byte is bounded by
+    // the number of distinct states. Of the begins an entry holds only
+    // those a later match could still start at are kept (see prune), at
+    // most two per entry that has accepted, so memory and snapshots stay
+    // small however long a match stays pending.
+    //
+    // A match is reported as soon as it can no longer grow; the rest come
+    // out of finish(). Copies are independent, snapshot() is a copy.
+    class Matcher {
+    public:
+        explicit Matcher(CompiledDKA dka);
+
+        // f(const Match&) for every match decided by this chunk
+        template<typename F>
+        void feed(std::string_view chunk, F&& f) {
+            process(chunk);
+            deliver(f);
+        }
+
+        // End of stream: decides the pending matches and resets.
+        template<typename F>
+        void finish(F&& f) {
+            close();
+            deliver(f);
+            reset();
+        }
+
+        // Whether everything fed so far, as a whole, is in the language.
+        inline bool fullMatch() const { return dka.is_final(anchored); }
+        inline size_t offset() const { return off; }
+        inline size_t pending() const { return groups.size(); }
+        // begin positions held by the pending runs
+        size_t retained() const;
+
+        void reset();
+
+        struct Snapshot;
+        Snapshot snapshot() const;
+        void restore(const Snapshot& s);
+
+    private:
+        static constexpr size_t NONE = SIZE_MAX;
+
+        // Runs from several begins that are in the same state and have
+        // not accepted yet, or a single run that has.
+        struct Group {
+            CompiledDKA::StateId state;
+            size_t last;                  // end of the longest match, NONE if none
+            std::vector<size_t> begins;   // sorted, from head on
+            size_t head = 0;
+            bool dead = false;
+
+            inline size_t first() const { return begins[head]; }
+            inline size_t lastBegin() const { return begins.back(); }
+        };
+
+        CompiledDKA dka;
+        CompiledDKA::StateId anchored;
+        size_t off = 0;       // absolute offset of the next byte
+        size_t pos = 0;       // matches may begin here or later
+        std::vector<Group> groups;
+        std::vector<Match> ready;
+        std::vector<uint32_t> owner;   // per table row, for merging
+        std::vector<size_t> merged, cuts;
+        std::vector<std::vector<size_t>> spare;   // begin lists of dropped groups
+        size_t prune_at = MIN_PRUNE;
+
+        static constexpr size_t MIN_PRUNE = 64;
+
+        void process(std::string_view chunk);
+        void close();
+        void compact();
+        void prune();
+        void resolve();
+        size_t front() const;
+        void open(CompiledDKA::StateId state, size_t last, size_t begin, bool dead = false);
+        void recycle(Group& g);
+
+        template<typename F>
+        void deliver(F& f) {
+            for (const Match& m : ready) f(m);
+            ready.clear();
+        }
+
+    public:
+        struct Snapshot {
+            CompiledDKA::StateId anchored;
+            size_t off, pos;
+            std::vector<Group> groups;
+        };
+    };
+
+}
+
+#endif
@@ -0,0 +1,395 @@
+#include "NFA.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mgr {
+
+    uint32_t NFA::add(State st) {
+        states.push_back(st);
+        return static_cast<uint32_t>(states.size() - 1);
+    }
+
+    void NFA::patch(const std::vector<Hole>& holes, uint32_t target) {
+        for (const Hole& h : holes)
+            (h.second ? states[h.state].out1 : states[h.state].out) = target;
+    }
+
+    NFA::Fragment NFA::epsilon() {
+        uint32_t s = add(State{ Kind::Epsilon });
+        return Fragment{ s, { Hole{ s, false } } };
+    }
+
+    // one chain of Range states per sequence, alternatives tried in order
+    NFA::Fragment NFA::sequences(const std::vector<Utf8Sequence>& seqs) {
+        Fragment res{ NONE, {} };
+        for (size_t i = seqs.size(); i-- > 0;) {
+            const Utf8Sequence& seq = seqs[i];
+            uint32_t head = add(State{ Kind::Range, seq.bytes[0].first, seq.bytes[0].second });
+            uint32_t tail = head;
+            for (size_t k = 1; k < seq.length; ++k) {
+                uint32_t s = add(State{ Kind::Range, seq.bytes[k].first, seq.bytes[k].second });
+                states[tail].out = s;
+                tail = s;
+            }
+            res.holes.push_back(Hole{ tail, false });
+            res.start = res.start == NONE ? head : add(State{ Kind::Split, 0, 0, head, res.start });
+        }
+        return res;
+    }
+
+    NFA::Fragment NFA::build(const RegexArena& ast, NodeId id) {
+        const RegexArena::Node& node = ast[id];
+        switch (node.type) {
+            case NodeType::Literal: {
+                unsigned char c = static_cast<unsigned char>(node.value);
+                uint32_t s = add(State{ Kind::Range, c, c });
+                return Fragment{ s, { Hole{ s, false } } };
+            }
+
+            case NodeType::Wildcard:
+                return sequences(dot);
+
+            case NodeType::Concat: {
+                auto kids = ast.children(id);
+                if (kids.empty()) return epsilon();
+                Fragment res = build(ast, kids.front());
+                for (size_t i = 1; i < kids.size(); ++i) {
+                    Fragment next = build(ast, kids[i]);
+                    patch(res.holes, next.start);
+                    res.holes = std::move(next.holes);
+                }
+                return res;
+            }
+
+            case NodeType::Alternation: {
+                // the parser nests a|b|c as ((a|b)|c); walk the left spine
+                // instead of recursing once per branch
+                std::vector<NodeId> branches;
+                NodeId cur = id;
+                while (ast[cur].type == NodeType::Alternation && ast[cur].count != 0) {
+                    auto kids = ast.children(cur);
+                    for (size_t i = kids.size(); i-- > 1;)
+                        branches.push_back(kids[i]);
+                    cur = kids.front();
+                }
+                if (cur == id) return epsilon();   // no alternatives at all
+                branches.push_back(cur);
+                // branches holds the alternatives right to left
+                Fragment res = build(ast, branches.front());
+                for (size_t i = 1; i < branches.size(); ++i) {
+                    Fragment branch = build(ast, branches[i]);
+                    uint32_t split = add(State{ Kind::Split, 0, 0, branch.start, res.start });
+                    branch.holes.insert(branch.holes.end(), res.holes.begin(), res.holes.end());
+                    res = Fragment{ split, std::move(branch.holes) };
+                }
+                return res;
+            }
+
+            case NodeType::Repeat:
+                return buildRepeat(ast, id);
+
+            case NodeType::Class: {
+                auto list = ast.classRanges(id);
+                std::vector<Utf8Sequence> seqs = classSequences({ list.begin(), list.end() }, node.value != 0, encoding);
+                if (seqs.empty()) return Fragment{ add(State{ Kind::Fail }), {} };
+                return sequences(seqs);
+            }
+
+            case NodeType::Group: {
+                const uint32_t tag = 2 * static_cast<uint32_t>(node.min - 1);
+                tag_count = std::max<size_t>(tag_count, tag + 2);
+                uint32_t open = add(State{ Kind::Tag });
+                uint32_t close = add(State{ Kind::Tag });
+                states[open].counter = tag;
+                states[close].counter = tag + 1;
+                Fragment body = build(ast, ast.child(id));
+                states[open].out = body.start;
+                patch(body.holes, close);
+                return Fragment{ open, { Hole{ close, false } } };
+            }
+
+            case NodeType::End: {
+                // End is always the last node of the pattern
+                uint32_t s = add(State{ Kind::Match });
+                return Fragment{ s, {} };
+            }
+
+            case NodeType::Epsilon:
+                return epsilon();
+
+            case NodeType::EmptySet: {
+                uint32_t s = add(State{ Kind::Fail });
+                return Fragment{ s, {} };
+            }
+
+            default:
+                throw std::logic_error("Unknown node type in NFA::build");
+        }
+    }
+
+    NFA::Fragment NFA::buildRepeat(const RegexArena& ast, NodeId id) {
+        const RegexArena::Node& rep = ast[id];
+        const NodeId child = ast.child(id);
+        if (rep.max == 0)
+            return epsilon();
+        size_t bound = static_cast<size_t>(rep.max == INFINITY ? rep.min : rep.max);
+        if (bound > unroll_limit)
+            return buildCounted(ast, id);
+
+        Fragment res{ NONE, {} };
+        auto append = [&](Fragment next) {
+            if (res.start == NONE) {
+                res = std::move(next);
+            } else {
+                patch(res.holes, next.start);
+                res.holes = std::move(next.holes);
+            }
+        };
+
+        for (int i = 0; i < rep.min; ++i)
+            append(build(ast, child));
+
+        if (rep.max == INFINITY) {
+            // x*: split -> x -> split, exit through the split's second edge
+            Fragment body = build(ast, child);
+            uint32_t split = add(State{ Kind::Split, 0, 0, body.start });
+            patch(body.holes, split);
+            append(Fragment{ split, { Hole{ split, true } } });
+            return res;
+        }
+
+        // (x(x(x)?)?)? for the optional part, exits collected on the way
+        std::vector<Hole> skips;
+        for (int i = rep.min; i < rep.max; ++i) {
+            Fragment body = build(ast, child);
+            uint32_t split = add(State{ Kind::Split, 0, 0, body.start });
+            append(Fragment{ split, std::move(body.holes) });
+            skips.push_back(Hole{ split, true });
+        }
+        res.holes.insert(res.holes.end(), skips.begin(), skips.end());
+        return res;
+    }
+
+    // enter -> loop -> body -> incr -> loop, leaving through the loop's
+    // second edge; the body is built once whatever the bounds
+    NFA::Fragment NFA::buildCounted(const RegexArena& ast, NodeId id) {
+        const uint32_t counter = static_cast<uint32_t>(counters.size());
+        counters.push_back(Counter{ ast[id].min, ast[id].max });
+
+        Fragment body = build(ast, ast.child(id));
+        uint32_t loop = add(State{ Kind::CounterLoop, 0, 0, body.start });
+        uint32_t incr = add(State{ Kind::CounterIncr, 0, 0, loop });
+        uint32_t enter = add(State{ Kind::CounterEnter, 0, 0, loop });
+        for (uint32_t s : { loop, incr, enter })
+            states[s].counter = counter;
+        patch(body.holes, incr);
+        return Fragment{ enter, { Hole{ loop, true } } };
+    }
+
+    NFA NFA::fromTree(const RegexTree& rt, size_t unroll_limit, Encoding encoding) {
+        return fromTrees({ &rt }, unroll_limit, encoding);
+    }
+
+    NFA NFA::fromTrees(const std::vector<const RegexTree*>& trees, size_t unroll_limit,
+                       Encoding encoding) {
+        if (trees.empty())
+            throw std::logic_error("No patterns to combine");
+        NFA nfa;
+        nfa.unroll_limit = unroll_limit;
+        nfa.encoding = encoding;
+        nfa.dot = dotSequences(encoding);
+        std::vector<uint32_t> starts;
+        std::vector<Hole> holes;
+        for (size_t i = 0; i < trees.size(); ++i) {
+            if (!trees[i])
+                throw std::logic_error("Regex tree is empty");
+            ArenaRef ast = arenaOf(*trees[i]);
+            size_t first = nfa.states.size();
+            Fragment f = nfa.build(*ast.arena, ast.root);
+            for (size_t s = first; s < nfa.states.size(); ++s)
+                if (nfa.states[s].kind == Kind::Match)
+                    nfa.states[s].pattern = static_cast<uint32_t>(i);
+            starts.push_back(f.start);
+            holes.insert(holes.end(), f.holes.begin(), f.holes.end());
+        }
+        // exits that never reached End lead nowhere
+        uint32_t fail = nfa.add(State{ Kind::Fail });
+        nfa.patch(holes, fail);
+
+        uint32_t start = starts.back();
+        for (size_t i = starts.size() - 1; i-- > 0;)
+            start = nfa.add(State{ Kind::Split, 0, 0, starts[i], start });
+        nfa.start = start;
+        return nfa;
+    }
+
+    ByteClasses NFA::byteClasses() const {
+        std::vector<ByteClasses::Range> ranges;
+        for (const auto& st : states)
+            if (st.kind == Kind::Range)
+                ranges.emplace_back(st.from, st.to);
+        std::sort(ranges.begin(), ranges.end());
+        ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+
+        ByteClasses classes;
+        for (auto [from, to] : ranges)
+            classes.split(from, to);
+        return classes;
+    }
+
+    void NFA::initial(std::vector<uint32_t>& set, Workspace& ws) const {
+        set.assign(width(), 0);
+        set[0] = start;
+        closure(set, ws);
+    }
+
+    void NFA::closure(std::vector<uint32_t>& set, Workspace& ws) const {
+        if (!counters.empty()) {
+            closureCounted(set, ws);
+            return;
+        }
+        if (ws.mark.size() != states.size()) {
+            ws.mark.assign(states.size(), 0);
+            ws.generation = 0;
+        }
+        if (++ws.generation == 0) {
+            std::fill(ws.mark.begin(), ws.mark.end(), 0);
+            ws.generation = 1;
+        }
+
+        ws.stack.assign(set.begin(), set.end());
+        set.clear();
+        while (!ws.stack.empty()) {
+            uint32_t s = ws.stack.back();
+            ws.stack.pop_back();
+            if (s == NONE || ws.mark[s] == ws.generation) continue;
+            ws.mark[s] = ws.generation;
+
+            const State& st = states[s];
+            switch (st.kind) {
+                case Kind::Range:
+                case Kind::Match:
+                    set.push_back(s);
+                    break;
+                case Kind::Split:
+                    ws.stack.push_back(st.out1);
+                    ws.stack.push_back(st.out);
+                    break;
+                case Kind::Epsilon:
+                case Kind::Tag:
+                    ws.stack.push_back(st.out);
+                    break;
+                default:
+                    break;
+            }
+        }
+        std::sort(set.begin(), set.end());
+    }
+
+    // Same walk over (state, counters) configurations. Counter values are
+    // bounded (unbounded repeats saturate at min), so this terminates.
+    void NFA::closureCounted(std::vector<uint32_t>& set, Workspace& ws) const {
+        const size_t w = width();
+        ws.seen.clear();
+        ws.stack.assign(set.begin(), set.end());
+        set.clear();
+
+        auto push = [&](uint32_t state, const std::vector<uint32_t>& cfg) {
+            if (state == NONE) return;
+            ws.stack.push_back(state);
+            ws.stack.insert(ws.stack.end(), cfg.begin() + 1, cfg.end());
+        };
+
+        while (!ws.stack.empty()) {
+            ws.config.assign(ws.stack.end() - w, ws.stack.end());
+            ws.stack.resize(ws.stack.size() - w);
+            if (!ws.seen.insert(ws.config).second) continue;
+
+            const State& st = states[ws.config[0]];
+            // counter is a tag index on Tag states, so c is only bound below
+            switch (st.kind) {
+                case Kind::Range:
+                case Kind::Match:
+                    set.insert(set.end(), ws.config.begin(), ws.config.end());
+                    break;
+                case Kind::Split:
+                    push(st.out1, ws.config);
+                    push(st.out, ws.config);
+                    break;
+                case Kind::Epsilon:
+                case Kind::Tag:
+                    push(st.out, ws.config);
+                    break;
+                case Kind::Fail:
+                    break;
+                case Kind::CounterEnter:
+                    ws.config[1 + st.counter] = 0;
+                    push(st.out, ws.config);
+                    break;
+                case Kind::CounterLoop: {
+                    uint32_t& c = ws.config[1 + st.counter];
+                    const Counter& k = counters[st.counter];
+                    if (c < static_cast<uint32_t>(k.max))
+                        push(st.out, ws.config);
+                    if (c >= static_cast<uint32_t>(k.min)) {
+                        c = 0;
+                        push(st.out1, ws.config);
+                    }
+                    break;
+                }
+                case Kind::CounterIncr: {
+                    uint32_t& c = ws.config[1 + st.counter];
+                    const Counter& k = counters[st.counter];
+                    if (k.max != INFINITY || c < static_cast<uint32_t>(k.min))
+                        ++c;
+                    push(st.out, ws.config);
+                    break;
+                }
+            }
+        }
+
+        // sort whole configurations so equal sets compare equal
+        const size_t n = set.size() / w;
+        ws.order.resize(n);
+        for (size_t i = 0; i < n; ++i) ws.order[i] = static_cast<uint32_t>(i);
+        std::sort(ws.order.begin(), ws.order.end(), [&](uint32_t a, uint32_t b) {
+            return std::lexicographical_compare(set.begin() + a * w, set.begin() + (a + 1) * w,
+                                                set.begin() + b * w, set.begin() + (b + 1) * w);
+        });
+        ws.stack.clear();
+        for (uint32_t i : ws.order)
+            ws.stack.insert(ws.stack.end(), set.begin() + i * w, set.begin() + (i + 1) * w);
+        set.swap(ws.stack);
+    }
+
+    void NFA::step(const std::vector<uint32_t>& from, unsigned char ch,
+                   std::vector<uint32_t>& to, Workspace& ws) const {
+        const size_t w = width();
+        to.clear();
+        for (size_t i = 0; i < from.size(); i += w) {
+            const State& st = states[from[i]];
+            if (st.kind == Kind::Range && st.from <= ch && ch <= st.to) {
+                to.push_back(st.out);
+                to.insert(to.end(), from.begin() + i + 1, from.begin() + i + w);
+            }
+        }
+        closure(to, ws);
+    }
+
+    bool NFA::accepts(const std::vector<uint32_t>& set) const {
+        for (size_t i = 0; i < set.size(); i += width())
+            if (states[set[i]].kind == Kind::Match)
+                return true;
+        return false;
+    }
+
+    void NFA::patterns(const std::vector<uint32_t>& set, std::vector<uint32_t>& out) const {
+        out.clear();
+        for (size_t i = 0; i < set.size(); i += width())
+            if (states[set[i]].kind == Kind::Match)
+                out.push_back(states[set[i]].pattern);
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+}
@@ -0,0 +1,140 @@
+#ifndef NFA_HPP_
+#define NFA_HPP_
+
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include "RegexArena.hpp"
+#include "ByteClasses.hpp"
+#include "Utf8.hpp"
+
+namespace mgr {
+
+    // Thompson NFA over bytes. Range states consume one byte in [from, to],
+    // Split and Epsilon states are epsilon moves, Match accepts and Fail
+    // never leads anywhere. Tag states are epsilon moves that record the
+    // position of a capture group bound (see TaggedDKA). Match states carry
+    // the id of the pattern they belong to when several patterns are
+    // combined.
+    //
+    // Repeats with bounds above the unroll limit are not copied out but
+    // use a counter: CounterEnter zeroes it, CounterLoop enters the body
+    // while it is below max and leaves (zeroing it again) once it reached
+    // min, CounterIncr bumps it after each pass. Sets handled by closure
+    // and step then hold configurations, a state followed by the value of
+    // every counter (width() words each); without counters a
+    // configuration is just the state.
+    //
+    // '.' becomes the byte sequences of dotSequences(encoding), so in
+    // Utf8 one wildcard reads a whole encoded code point; a bracket class
+    // becomes those of classSequences, one Range state per byte range.
+    class NFA {
+    public:
+        enum class Kind : uint8_t {
+            Range,
+            Split,
+            Epsilon,
+            Match,
+            Fail,
+            CounterEnter,
+            CounterLoop,
+            CounterIncr,
+            Tag
+        };
+
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        struct State {
+            Kind kind;
+            unsigned char from = 0, to = 0;
+            uint32_t out = NONE, out1 = NONE;
+            uint32_t pattern = 0;
+            uint32_t counter = 0;      // Tag: 2 * (group - 1), + 1 for the closing bound
+        };
+
+        struct Counter {
+            int min, max;   // max is INFINITY for unbounded repeats
+        };
+
+        // Repeats whose upper bound (lower bound when unbounded) is at most
+        // this are unrolled.
+        static constexpr size_t DEFAULT_UNROLL_LIMIT = 64;
+
+        std::vector<State> states;
+        std::vector<Counter> counters;
+        uint32_t start = NONE;
+        size_t tag_count = 0;
+
+        inline size_t width() const { return counters.size() + 1; }
+
+        // Hash for closed state sets used as keys by determinizers.
+        struct SetHash {
+            size_t operator()(const std::vector<uint32_t>& v) const {
+                size_t h = v.size();
+                for (uint32_t x : v)
+                    h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+                return h;
+            }
+        };
+
+        // Scratch space for closure computations, owned by the caller so a
+        // const NFA can be shared between threads.
+        struct Workspace {
+            std::vector<uint32_t> stack;
+            std::vector<uint32_t> mark;
+            uint32_t generation = 0;
+            std::unordered_set<std::vector<uint32_t>, SetHash> seen;   // with counters
+            std::vector<uint32_t> config, order;
+        };
+
+        static NFA fromTree(const RegexTree& rt, size_t unroll_limit = DEFAULT_UNROLL_LIMIT,
+                            Encoding encoding = Encoding::Ascii);
+        // Union of the trees; matches of trees[i] are tagged with pattern i.
+        static NFA fromTrees(const std::vector<const RegexTree*>& trees,
+                             size_t unroll_limit = DEFAULT_UNROLL_LIMIT,
+                             Encoding encoding = Encoding::Ascii);
+
+        ByteClasses byteClasses() const;
+
+        // Closed set of configurations the automaton starts in.
+        void initial(std::vector<uint32_t>& set, Workspace& ws) const;
+
+        // Replaces set by its epsilon closure, keeping only the states that
+        // matter for subset construction (Range and Match), sorted.
+        void closure(std::vector<uint32_t>& set, Workspace& ws) const;
+
+        // Byte step from a closed set, followed by closure.
+        void step(const std::vector<uint32_t>& from, unsigned char ch,
+                  std::vector<uint32_t>& to, Workspace& ws) const;
+
+        bool accepts(const std::vector<uint32_t>& set) const;
+        // Sorted ids of the patterns accepted by a closed set.
+        void patterns(const std::vector<uint32_t>& set, std::vector<uint32_t>& out) const;
+
+    private:
+        struct Hole {
+            uint32_t state;
+            bool second;
+        };
+        struct Fragment {
+            uint32_t start;
+            std::vector<Hole> holes;
+        };
+
+        size_t unroll_limit = DEFAULT_UNROLL_LIMIT;
+        Encoding encoding = Encoding::Ascii;
+        std::vector<Utf8Sequence> dot;
+
+        uint32_t add(State st);
+        void patch(const std::vector<Hole>& holes, uint32_t target);
+        Fragment build(const RegexArena& ast, NodeId id);
+        Fragment buildRepeat(const RegexArena& ast, NodeId id);
+        Fragment buildCounted(const RegexArena& ast, NodeId id);
+        void closureCounted(std::vector<uint32_t>& set, Workspace& ws) const;
+        Fragment epsilon();
+        Fragment sequences(const std::vector<Utf8Sequence>& seqs);
+    };
+
+}
+
+#endif
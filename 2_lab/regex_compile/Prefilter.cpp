@@ -0,0 +1,305 @@
+#include "Prefilter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define MGR_PREFILTER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace mgr {
+
+    namespace {
+
+        constexpr size_t NPOS = std::string::npos;
+        constexpr size_t LIMIT = 256;   // longest literal kept per node
+
+        struct Info {
+            size_t min_len = 0, max_len = 0;   // max_len == NPOS: unbounded
+            bool exact = true;                 // every match equals str
+            std::string str, pre, suf, best;
+            size_t best_off = 0;
+        };
+
+        size_t addLen(size_t a, size_t b) {
+            return (a == NPOS || b == NPOS || a + b < a) ? NPOS : a + b;
+        }
+
+        size_t mulLen(size_t a, size_t n) {
+            if (a == 0 || n == 0) return 0;
+            return (a == NPOS || n == NPOS || a > NPOS / n - 1) ? NPOS : a * n;
+        }
+
+        // prefer longer literals, then smaller (bounded) offsets
+        void consider(Info& info, std::string s, size_t off) {
+            if (s.size() > LIMIT) s.resize(LIMIT);
+            if (s.size() > info.best.size() ||
+                (s.size() == info.best.size() && off < info.best_off)) {
+                info.best = std::move(s);
+                info.best_off = off;
+            }
+        }
+
+        Info makeExact(std::string s, size_t len) {
+            Info info;
+            info.min_len = info.max_len = len;
+            if (s.size() > LIMIT) {
+                info.exact = false;
+                info.pre = s.substr(0, LIMIT);
+                info.suf = s.substr(s.size() - LIMIT);
+                consider(info, info.pre, 0);
+                return info;
+            }
+            info.str = info.pre = info.suf = info.best = s;
+            return info;
+        }
+
+        Info anything(size_t min_len, size_t max_len) {
+            Info info;
+            info.exact = false;
+            info.min_len = min_len;
+            info.max_len = max_len;
+            return info;
+        }
+
+        Info concat(const Info& a, const Info& x) {
+            if (a.exact && x.exact)
+                return makeExact(a.str + x.str, a.min_len + x.min_len);
+
+            Info r = anything(a.min_len + x.min_len, addLen(a.max_len, x.max_len));
+            r.pre = a.exact ? a.str + x.pre : a.pre;
+            r.suf = x.exact ? a.suf + x.str : x.suf;
+            if (r.pre.size() > LIMIT) r.pre.resize(LIMIT);
+            if (r.suf.size() > LIMIT) r.suf.erase(0, r.suf.size() - LIMIT);
+
+            consider(r, a.best, a.best_off);
+            consider(r, x.best, addLen(a.max_len, x.best_off));
+            size_t junction = a.max_len == NPOS ? NPOS : a.max_len - a.suf.size();
+            consider(r, a.suf + x.pre, junction);
+            return r;
+        }
+
+        Info alternative(const Info& a, const Info& b) {
+            if (a.exact && b.exact && a.str == b.str)
+                return a;
+
+            Info r = anything(std::min(a.min_len, b.min_len),
+                              (a.max_len == NPOS || b.max_len == NPOS) ? NPOS
+                                                                       : std::max(a.max_len, b.max_len));
+            size_t p = 0;
+            while (p < a.pre.size() && p < b.pre.size() && a.pre[p] == b.pre[p]) ++p;
+            r.pre = a.pre.substr(0, p);
+            size_t q = 0;
+            while (q < a.suf.size() && q < b.suf.size() &&
+                   a.suf[a.suf.size() - 1 - q] == b.suf[b.suf.size() - 1 - q]) ++q;
+            r.suf = a.suf.substr(a.suf.size() - q);
+
+            consider(r, r.pre, 0);
+            consider(r, r.suf, r.max_len == NPOS ? NPOS : r.max_len - r.suf.size());
+            if (a.best == b.best)
+                consider(r, a.best, std::max(a.best_off, b.best_off));
+            return r;
+        }
+
+        // Hash-consed subtrees are analyzed once.
+        struct Analyzer {
+            const RegexArena& ast;
+            std::vector<Info> memo;
+            std::vector<bool> done;
+            size_t dot_min = 1, dot_max = 1;   // bytes read by '.'
+            Encoding encoding;
+
+            Analyzer(const RegexArena& ast, Encoding encoding)
+                : ast(ast), memo(ast.size()), done(ast.size(), false), encoding(encoding) {
+                std::vector<Utf8Sequence> dot = dotSequences(encoding);
+                dot_min = dot_max = dot.front().length;
+                for (const Utf8Sequence& seq : dot) {
+                    dot_min = std::min<size_t>(dot_min, seq.length);
+                    dot_max = std::max<size_t>(dot_max, seq.length);
+                }
+            }
+
+            const Info& operator()(NodeId id) {
+                if (!done[id]) {
+                    memo[id] = analyze(id);
+                    done[id] = true;
+                }
+                return memo[id];
+            }
+
+            Info analyze(NodeId id) {
+                const RegexArena::Node& node = ast[id];
+                switch (node.type) {
+                    case NodeType::Literal:
+                        return makeExact(std::string(1, node.value), 1);
+
+                    case NodeType::Wildcard:
+                        return anything(dot_min, dot_max);
+
+                    case NodeType::End:
+                    case NodeType::Epsilon:
+                    case NodeType::EmptySet:
+                        return makeExact("", 0);
+
+                    case NodeType::Concat: {
+                        Info acc = makeExact("", 0);
+                        for (NodeId child : ast.children(id))
+                            acc = concat(acc, (*this)(child));
+                        return acc;
+                    }
+
+                    case NodeType::Alternation: {
+                        // ((a|b)|c): fold along the left spine, not recursively
+                        std::vector<NodeId> right;
+                        NodeId cur = id;
+                        while (ast[cur].type == NodeType::Alternation && ast[cur].count != 0) {
+                            auto kids = ast.children(cur);
+                            for (size_t i = kids.size(); i-- > 1;)
+                                right.push_back(kids[i]);
+                            cur = kids.front();
+                        }
+                        if (cur == id) return makeExact("", 0);
+                        Info acc = (*this)(cur);
+                        for (size_t i = right.size(); i-- > 0;)
+                            acc = alternative(acc, (*this)(right[i]));
+                        return acc;
+                    }
+
+                    case NodeType::Repeat: {
+                        Info c = (*this)(ast.child(id));
+                        size_t times = node.max == INFINITY ? NPOS : static_cast<size_t>(node.max);
+                        size_t max_len = mulLen(c.max_len, times);
+
+                        if (c.exact && c.str.empty())
+                            return makeExact("", 0);
+                        if (node.min == 0)
+                            return anything(0, max_len);
+
+                        size_t min_len = mulLen(c.min_len, static_cast<size_t>(node.min));
+                        if (c.exact) {
+                            std::string s;
+                            for (int i = 0; i < node.min && s.size() <= LIMIT; ++i)
+                                s += c.str;
+                            if (node.min == node.max)
+                                return makeExact(s, min_len);
+                            Info r = anything(min_len, max_len);
+                            r.pre = s.size() > LIMIT ? s.substr(0, LIMIT) : s;
+                            r.suf = s.size() > LIMIT ? s.substr(s.size() - LIMIT) : s;
+                            consider(r, r.pre, 0);
+                            return r;
+                        }
+                        Info r = anything(min_len, max_len);
+                        r.pre = c.pre;
+                        r.suf = c.suf;
+                        consider(r, c.best, c.best_off);
+                        return r;
+                    }
+
+                    case NodeType::Group:
+                        return (*this)(ast.child(id));
+
+                    case NodeType::Class: {
+                        auto list = ast.classRanges(id);
+                        std::vector<Utf8Sequence> seqs = classSequences({ list.begin(), list.end() },
+                                                                        node.value != 0, encoding);
+                        if (seqs.empty()) return makeExact("", 0);
+                        // [x] is the literal x
+                        const auto& first = seqs[0].bytes[0];
+                        if (seqs.size() == 1 && seqs[0].length == 1 && first.first == first.second)
+                            return makeExact(std::string(1, static_cast<char>(first.first)), 1);
+                        size_t lo = seqs.front().length, hi = lo;
+                        for (const Utf8Sequence& seq : seqs) {
+                            lo = std::min<size_t>(lo, seq.length);
+                            hi = std::max<size_t>(hi, seq.length);
+                        }
+                        return anything(lo, hi);
+                    }
+
+                    default:
+                        throw std::logic_error("Unknown node type in requiredLiteral");
+                }
+            }
+        };
+
+        size_t findScalar(std::string_view hay, std::string_view needle, size_t from) {
+            return hay.find(needle, from);
+        }
+
+#ifdef MGR_PREFILTER_X86
+        // Muła's "generic SIMD" substring search: compare the first and the
+        // last needle byte at every offset of a block, verify candidates.
+        size_t findSSE2(std::string_view hay, std::string_view needle, size_t from) {
+            const size_t n = hay.size(), m = needle.size();
+            const char* h = hay.data();
+            const __m128i first = _mm_set1_epi8(needle.front());
+            const __m128i last = _mm_set1_epi8(needle.back());
+            size_t i = from;
+            for (; i + m - 1 + 16 <= n; i += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i + m - 1));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+                while (mask) {
+                    unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+                    if (m <= 2 || std::memcmp(h + i + bit + 1, needle.data() + 1, m - 2) == 0)
+                        return i + bit;
+                    mask &= mask - 1;
+                }
+            }
+            return findScalar(hay, needle, i);
+        }
+
+        __attribute__((target("avx2")))
+        size_t findAVX2(std::string_view hay, std::string_view needle, size_t from) {
+            const size_t n = hay.size(), m = needle.size();
+            const char* h = hay.data();
+            const __m256i first = _mm256_set1_epi8(needle.front());
+            const __m256i last = _mm256_set1_epi8(needle.back());
+            size_t i = from;
+            for (; i + m - 1 + 32 <= n; i += 32) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+                unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+                while (mask) {
+                    unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+                    if (m <= 2 || std::memcmp(h + i + bit + 1, needle.data() + 1, m - 2) == 0)
+                        return i + bit;
+                    mask &= mask - 1;
+                }
+            }
+            return findSSE2(hay, needle, i);
+        }
+
+        bool hasAVX2() {
+            static const bool yes = __builtin_cpu_supports("avx2");
+            return yes;
+        }
+#endif
+
+    }
+
+    RequiredLiteral requiredLiteral(const RegexTree& rt, Encoding encoding) {
+        ArenaRef ast = arenaOf(rt);
+        Info info = Analyzer(*ast.arena, encoding)(ast.root);
+        if (info.best.empty())
+            return {};
+        return RequiredLiteral{ info.best, info.best_off };
+    }
+
+    size_t findLiteral(std::string_view haystack, std::string_view needle, size_t from) {
+        if (needle.empty()) return from <= haystack.size() ? from : NPOS;
+        if (from >= haystack.size() || haystack.size() - from < needle.size()) return NPOS;
+        if (needle.size() == 1) {
+            const void* p = std::memchr(haystack.data() + from, needle.front(), haystack.size() - from);
+            return p ? static_cast<const char*>(p) - haystack.data() : NPOS;
+        }
+#ifdef MGR_PREFILTER_X86
+        return hasAVX2() ? findAVX2(haystack, needle, from) : findSSE2(haystack, needle, from);
+#else
+        return findScalar(haystack, needle, from);
+#endif
+    }
+
+}
@@ -0,0 +1,45 @@
+#ifndef PREFILTER_HPP_
+#define PREFILTER_HPP_
+
+#include <string>
+#include <string_view>
+#include "RegexArena.hpp"
+#include "Utf8.hpp"
+
+namespace mgr {
+
+    // A literal that occurs in every match. max_offset bounds the distance
+    // from the start of a match to the start of the literal, npos when the
+    // part in front of it is unbounded (e.g. ".*error").
+    struct RequiredLiteral {
+        std::string text;
+        size_t max_offset = std::string::npos;
+    };
+
+    // encoding says how many bytes a '.' may take.
+    RequiredLiteral requiredLiteral(const RegexTree& rt, Encoding encoding = Encoding::Ascii);
+
+    // Substring search used by the prefilter: SSE2/AVX2 on x86, with a
+    // scalar fallback elsewhere. Returns npos when needle is not found.
+    size_t findLiteral(std::string_view haystack, std::string_view needle, size_t from = 0);
+
+    class Prefilter {
+    public:
+        Prefilter() = default;
+        explicit Prefilter(RequiredLiteral lit) : lit(std::move(lit)) {}
+
+        inline bool active() const { return !lit.text.empty(); }
+        inline const std::string& literal() const { return lit.text; }
+        inline size_t maxOffset() const { return lit.max_offset; }
+
+        inline size_t find(std::string_view text, size_t from) const {
+            return findLiteral(text, lit.text, from);
+        }
+
+    private:
+        RequiredLiteral lit;
+    };
+
+}
+
+#endif
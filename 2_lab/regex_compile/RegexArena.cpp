@@ -0,0 +1,237 @@
+#include "RegexArena.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mgr {
+
+    NodeId RegexArena::literal(char ch) {
+        Node n{ NodeType::Literal };
+        n.value = ch;
+        return intern(n, {});
+    }
+
+    NodeId RegexArena::wildcard() { return intern(Node{ NodeType::Wildcard }, {}); }
+    NodeId RegexArena::end() { return intern(Node{ NodeType::End }, {}); }
+    NodeId RegexArena::epsilon() { return intern(Node{ NodeType::Epsilon }, {}); }
+    NodeId RegexArena::emptySet() { return intern(Node{ NodeType::EmptySet }, {}); }
+
+    NodeId RegexArena::concat(std::span<const NodeId> children) {
+        return intern(Node{ NodeType::Concat }, children);
+    }
+
+    NodeId RegexArena::alternation(std::span<const NodeId> children) {
+        return intern(Node{ NodeType::Alternation }, children);
+    }
+
+    NodeId RegexArena::repeat(NodeId child, int min, int max) {
+        if (min > max) throw std::invalid_argument("Invalid repeat bounds");
+        Node n{ NodeType::Repeat };
+        n.min = min;
+        n.max = max;
+        return intern(n, std::span<const NodeId>(&child, 1));
+    }
+
+    NodeId RegexArena::group(NodeId child, int index) {
+        Node n{ NodeType::Group };
+        n.min = index;
+        return intern(n, std::span<const NodeId>(&child, 1));
+    }
+
+    NodeId RegexArena::charClass(std::span<const ClassRange> list, bool negated) {
+        // appended first so equal classes can be compared by content
+        Node n{ NodeType::Class };
+        n.value = negated;
+        n.min = static_cast<int>(ranges.size());
+        n.max = static_cast<int>(list.size());
+        ranges.insert(ranges.end(), list.begin(), list.end());
+        NodeId id = intern(n, {});
+        if (nodes[id].min != n.min) ranges.resize(n.min);
+        return id;
+    }
+
+    void RegexArena::reserve(size_t node_count) {
+        nodes.reserve(node_count);
+        kids.reserve(node_count);
+        while (table.size() < 2 * node_count)
+            grow();
+    }
+
+    void RegexArena::clear() {
+        nodes.clear();
+        kids.clear();
+        ranges.clear();
+        std::fill(table.begin(), table.end(), NONE);
+    }
+
+    size_t RegexArena::hash(const Node& n, std::span<const NodeId> children) const {
+        size_t h = static_cast<size_t>(n.type) * 0x9e3779b97f4a7c15ULL;
+        auto mix = [&h](size_t x) { h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+        mix(static_cast<unsigned char>(n.value));
+        if (n.type == NodeType::Class) {
+            for (int i = 0; i < n.max; ++i) {
+                mix(ranges[n.min + i].first);
+                mix(ranges[n.min + i].second);
+            }
+            return h;
+        }
+        mix(static_cast<size_t>(n.min));
+        mix(static_cast<size_t>(n.max));
+        for (NodeId c : children) mix(c);
+        return h;
+    }
+
+    bool RegexArena::same(NodeId id, const Node& n, std::span<const NodeId> children) const {
+        const Node& m = nodes[id];
+        if (m.type == NodeType::Class && n.type == NodeType::Class)
+            return m.value == n.value && m.max == n.max &&
+                   std::equal(ranges.begin() + m.min, ranges.begin() + m.min + m.max, ranges.begin() + n.min);
+        if (m.type != n.type || m.value != n.value || m.min != n.min || m.max != n.max ||
+            m.count != children.size())
+            return false;
+        for (size_t i = 0; i < children.size(); ++i)
+            if (kids[m.first + i] != children[i]) return false;
+        return true;
+    }
+
+    void RegexArena::grow() {
+        std::vector<NodeId> old = std::move(table);
+        table.assign(old.empty() ? 64 : old.size() * 2, NONE);
+        const size_t mask = table.size() - 1;
+        for (NodeId id : old) {
+            if (id == NONE) continue;
+            size_t i = hash(nodes[id], children(id)) & mask;
+            while (table[i] != NONE) i = (i + 1) & mask;
+            table[i] = id;
+        }
+    }
+
+    NodeId RegexArena::intern(const Node& node, std::span<const NodeId> children) {
+        for (NodeId c : children)
+            if (c >= nodes.size()) throw std::out_of_range("RegexArena: unknown child");
+        if (nodes.size() + 1 > table.size() / 2)
+            grow();
+
+        const size_t mask = table.size() - 1;
+        size_t i = hash(node, children) & mask;
+        for (; table[i] != NONE; i = (i + 1) & mask)
+            if (same(table[i], node, children))
+                return table[i];
+
+        NodeId id = static_cast<NodeId>(nodes.size());
+        Node n = node;
+        n.first = static_cast<uint32_t>(kids.size());
+        n.count = static_cast<uint32_t>(children.size());
+        kids.insert(kids.end(), children.begin(), children.end());
+        nodes.push_back(n);
+        table[i] = id;
+        return id;
+    }
+
+    NodeId RegexArena::import(const NodePtr& node) {
+        if (!node) throw std::logic_error("Regex tree is empty");
+        switch (getType(node)) {
+            case NodeType::Literal:
+                return literal(std::get<Literal>(*node).value);
+            case NodeType::Wildcard:
+                return wildcard();
+            case NodeType::End:
+                return end();
+            case NodeType::Epsilon:
+                return epsilon();
+            case NodeType::EmptySet:
+                return emptySet();
+            case NodeType::Repeat: {
+                const Repeat& r = std::get<Repeat>(*node);
+                return repeat(import(r.child), r.min, r.max);
+            }
+            case NodeType::Group: {
+                const Group& g = std::get<Group>(*node);
+                return group(import(g.child), g.index);
+            }
+            case NodeType::Class: {
+                const CharClass& c = std::get<CharClass>(*node);
+                return charClass(c.ranges, c.negated);
+            }
+            case NodeType::Concat:
+            case NodeType::Alternation: {
+                const auto& list = getType(node) == NodeType::Concat
+                                 ? std::get<Concat>(*node).children
+                                 : std::get<Alternation>(*node).children;
+                std::vector<NodeId> ids;
+                ids.reserve(list.size());
+                for (const auto& c : list) ids.push_back(import(c));
+                return getType(node) == NodeType::Concat ? concat(ids) : alternation(ids);
+            }
+            default:
+                throw std::logic_error("Unknown node type in RegexArena::import");
+        }
+    }
+
+    static NodePtr materialize(const RegexArena& a, NodeId id, std::vector<NodePtr>& done) {
+        if (done[id]) return done[id];
+        const RegexArena::Node& n = a[id];
+        NodePtr res;
+        switch (n.type) {
+            case NodeType::Literal:  res = std::make_shared<Node>(Literal{ n.value }); break;
+            case NodeType::Wildcard: res = std::make_shared<Node>(Wildcard{}); break;
+            case NodeType::End:      res = std::make_shared<Node>(End{}); break;
+            case NodeType::Epsilon:  res = std::make_shared<Node>(Epsilon{}); break;
+            case NodeType::EmptySet: res = std::make_shared<Node>(EmptySet{}); break;
+            case NodeType::Repeat: {
+                Repeat r{ n.min, n.max };
+                r.child = materialize(a, a.child(id), done);
+                res = std::make_shared<Node>(std::move(r));
+                break;
+            }
+            case NodeType::Group: {
+                Group g{ n.min };
+                g.child = materialize(a, a.child(id), done);
+                res = std::make_shared<Node>(std::move(g));
+                break;
+            }
+            case NodeType::Class: {
+                auto list = a.classRanges(id);
+                CharClass c;
+                c.negated = n.value != 0;
+                c.ranges.assign(list.begin(), list.end());
+                res = std::make_shared<Node>(std::move(c));
+                break;
+            }
+            case NodeType::Concat: {
+                Concat c;
+                for (NodeId k : a.children(id)) c.children.push_back(materialize(a, k, done));
+                res = std::make_shared<Node>(std::move(c));
+                break;
+            }
+            case NodeType::Alternation: {
+                Alternation alt;
+                for (NodeId k : a.children(id)) alt.children.push_back(materialize(a, k, done));
+                res = std::make_shared<Node>(std::move(alt));
+                break;
+            }
+        }
+        return done[id] = res;
+    }
+
+    NodePtr RegexArena::toTree(NodeId id) const {
+        std::vector<NodePtr> done(nodes.size());
+        return materialize(*this, id, done);
+    }
+
+    void RegexTree::makeRoot(const NodePtr& ptr) {
+        auto nodes = std::make_shared<RegexArena>();
+        NodeId id = nodes->import(ptr);
+        attach(std::move(nodes), id);
+    }
+
+    NodePtr RegexTree::getRoot() const {
+        return arena ? arena->toTree(arena_root) : nullptr;
+    }
+
+    ArenaRef arenaOf(const RegexTree& rt) {
+        if (!rt.arena)
+            throw std::logic_error("Regex tree is empty");
+        return { rt.arena, rt.arena_root };
+    }
+
+}
@@ -0,0 +1,83 @@
+#ifndef REGEX_ARENA_HPP_
+#define REGEX_ARENA_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include "regex_tree.hpp"
+#include "Utf8.hpp"
+
+namespace mgr {
+
+    // Regex syntax tree stored in flat arrays: nodes refer to their
+    // children by index and every child list is a slice of one shared
+    // vector. Nodes are hash-consed, so structurally equal subtrees are a
+    // single node and building a tree costs a few vector growths instead
+    // of one allocation per node. Nodes are immutable once created.
+    class RegexArena {
+    public:
+        static constexpr NodeId NONE = UINT32_MAX;
+
+        struct Node {
+            NodeType type;
+            char value = 0;            // Literal; Class: negated
+            int min = 0, max = 0;      // Repeat; Group: min is the index; Class: ranges slice
+            uint32_t first = 0;        // children: kids[first, first + count)
+            uint32_t count = 0;
+        };
+
+        NodeId literal(char ch);
+        NodeId wildcard();
+        NodeId end();
+        NodeId epsilon();
+        NodeId emptySet();
+        NodeId concat(std::span<const NodeId> children);
+        NodeId alternation(std::span<const NodeId> children);
+        NodeId repeat(NodeId child, int min, int max);
+        NodeId group(NodeId child, int index);
+        // ranges sorted and disjoint
+        NodeId charClass(std::span<const ClassRange> ranges, bool negated);
+
+        inline const Node& operator[](NodeId id) const { return nodes[id]; }
+        inline std::span<const NodeId> children(NodeId id) const {
+            return { kids.data() + nodes[id].first, nodes[id].count };
+        }
+        inline NodeId child(NodeId id) const { return kids[nodes[id].first]; }
+        inline std::span<const ClassRange> classRanges(NodeId id) const {
+            return { ranges.data() + nodes[id].min, static_cast<size_t>(nodes[id].max) };
+        }
+        inline size_t size() const { return nodes.size(); }
+
+        void reserve(size_t node_count);
+        // Drops all nodes but keeps the memory for the next tree.
+        void clear();
+
+        // Conversions from and to the pointer-based tree. Shared nodes
+        // become shared NodePtrs.
+        NodeId import(const NodePtr& node);
+        NodePtr toTree(NodeId id) const;
+
+    private:
+        std::vector<Node> nodes;
+        std::vector<NodeId> kids;
+        std::vector<ClassRange> ranges;  // of every Class node
+        std::vector<NodeId> table;       // open addressing, NONE when empty
+
+        NodeId intern(const Node& node, std::span<const NodeId> children);
+        size_t hash(const Node& node, std::span<const NodeId> children) const;
+        bool same(NodeId id, const Node& node, std::span<const NodeId> children) const;
+        void grow();
+    };
+
+    // A tree as an arena: the one attached by the parser, or an imported
+    // copy for trees assembled by hand.
+    struct ArenaRef {
+        std::shared_ptr<const RegexArena> arena;
+        NodeId root;
+    };
+    ArenaRef arenaOf(const RegexTree& rt);
+
+}
+
+#endif
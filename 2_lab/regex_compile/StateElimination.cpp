@@ -0,0 +1,362 @@
+#include "StateElimination.hpp"
+#include "DKA.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace mgr {
+
+    ExprDag::ExprDag() {
+        nodes.push_back(Node{ Kind::Empty, 0, {} });
+        nodes.push_back(Node{ Kind::Epsilon, 0, {} });
+    }
+
+    ExprDag::Id ExprDag::intern(Kind kind, uint32_t set, std::vector<Id> kids) {
+        std::string key(1, static_cast<char>(kind));
+        key.append(reinterpret_cast<const char*>(&set), sizeof set);
+        key.append(reinterpret_cast<const char*>(kids.data()), kids.size() * sizeof(Id));
+        auto [it, inserted] = index.try_emplace(std::move(key), static_cast<Id>(nodes.size()));
+        if (inserted)
+            nodes.push_back(Node{ kind, set, std::move(kids) });
+        return it->second;
+    }
+
+    ExprDag::Id ExprDag::bytes(const ByteSet& set) {
+        if (set.none()) return EMPTY;
+        auto found = std::find(sets.begin(), sets.end(), set);
+        uint32_t at = static_cast<uint32_t>(found - sets.begin());
+        if (found == sets.end()) sets.push_back(set);
+        return intern(Kind::Set, at, {});
+    }
+
+    ExprDag::Id ExprDag::concat(Id a, Id b) {
+        if (a == EMPTY || b == EMPTY) return EMPTY;
+        if (a == EPSILON) return b;
+        if (b == EPSILON) return a;
+        std::vector<Id> kids;
+        for (Id x : { a, b }) {
+            if (nodes[x].kind == Kind::Concat)
+                kids.insert(kids.end(), nodes[x].kids.begin(), nodes[x].kids.end());
+            else
+                kids.push_back(x);
+        }
+        return intern(Kind::Concat, 0, std::move(kids));
+    }
+
+    ExprDag::Id ExprDag::alternation(Id a, Id b) {
+        if (a == EMPTY || a == b) return b;
+        if (b == EMPTY) return a;
+
+        std::vector<Id> kids;
+        ByteSet merged;
+        bool has_set = false;
+        for (Id x : { a, b }) {
+            const std::vector<Id> one{ x };
+            const std::vector<Id>& list = nodes[x].kind == Kind::Alternation ? nodes[x].kids : one;
+            for (Id k : list) {
+                if (nodes[k].kind == Kind::Set) {
+                    merged |= sets[nodes[k].set];
+                    has_set = true;
+                } else {
+                    kids.push_back(k);
+                }
+            }
+        }
+        if (has_set) kids.push_back(bytes(merged));
+        std::sort(kids.begin(), kids.end());
+        kids.erase(std::unique(kids.begin(), kids.end()), kids.end());
+
+        // ε | x* = x*, ε | x x* = x*
+        if (kids.front() == EPSILON) {
+            for (Id k : kids) {
+                const Node& n = nodes[k];
+                bool nullable = n.kind == Kind::Star;
+                Id plus = EMPTY;
+                if (n.kind == Kind::Concat && n.kids.size() == 2 && nodes[n.kids[1]].kind == Kind::Star &&
+                    nodes[n.kids[1]].kids[0] == n.kids[0])
+                    plus = n.kids[1];
+                if (nullable || plus != EMPTY) {
+                    kids.erase(kids.begin());
+                    if (plus != EMPTY) *std::find(kids.begin(), kids.end(), k) = plus;
+                    std::sort(kids.begin(), kids.end());
+                    kids.erase(std::unique(kids.begin(), kids.end()), kids.end());
+                    break;
+                }
+            }
+        }
+        if (kids.size() == 1) return kids.front();
+        return intern(Kind::Alternation, 0, std::move(kids));
+    }
+
+    ExprDag::Id ExprDag::star(Id a) {
+        if (a == EMPTY || a == EPSILON) return EPSILON;
+        if (nodes[a].kind == Kind::Star) return a;
+        if (nodes[a].kind == Kind::Alternation && nodes[a].kids.front() == EPSILON) {
+            // (ε | x)* = x*
+            const std::vector<Id> kids = nodes[a].kids;
+            Id rest = EMPTY;
+            for (size_t i = 1; i < kids.size(); ++i)
+                rest = alternation(rest, kids[i]);
+            return star(rest);
+        }
+        return intern(Kind::Star, 0, { a });
+    }
+
+    namespace {
+
+        constexpr size_t SMALL_SET = 6;
+
+        bool printable(unsigned c) { return c >= ' ' && c <= '~'; }
+
+        void appendByte(std::string& out, unsigned c) {
+            if (!printable(c) || std::strchr("&|.+*?(){}$[", static_cast<int>(c)))
+                out.push_back('&');
+            out.push_back(static_cast<char>(c));
+        }
+
+        void appendClassByte(std::string& out, unsigned c) {
+            if (c == ']' || c == '\\' || c == '-' || c == '^') out.push_back('\\');
+            out.push_back(static_cast<char>(c));
+        }
+
+    }
+
+    std::string ExprDag::render(Id root) const {
+        if (root == EMPTY) return "";
+        if (root == EPSILON) return ".{0}";
+
+        // levels: 0 alternation, 1 concatenation, 2 operand of a postfix
+        struct Renderer {
+            const ExprDag& dag;
+            std::string out;
+
+            bool postfixed(Id id) const {
+                const Node& n = dag.nodes[id];
+                if (n.kind == Kind::Star) return true;
+                if (n.kind == Kind::Alternation) return n.kids.front() == EPSILON;
+                return n.kind == Kind::Concat && isPlus(n);
+            }
+
+            bool isPlus(const Node& n) const {
+                return n.kids.size() == 2 && dag.nodes[n.kids[1]].kind == Kind::Star &&
+                       dag.nodes[n.kids[1]].kids[0] == n.kids[0];
+            }
+
+            void set(const ByteSet& s) {
+                size_t count = s.count();
+                if (count == 1) {
+                    for (unsigned c = 0; c < 256; ++c)
+                        if (s[c]) appendByte(out, c);
+                    return;
+                }
+                bool dot = count == 95;
+                for (unsigned c = ' '; dot && c <= '~'; ++c) dot = s[c];
+                if (dot) {
+                    out.push_back('.');
+                    return;
+                }
+                // a few scattered bytes read better as (b|c)
+                size_t longest = 0;
+                for (unsigned c = 0, run = 0; c < 256; ++c) {
+                    run = s[c] ? run + 1 : 0;
+                    longest = std::max<size_t>(longest, run);
+                }
+                if (longest <= 2 && count <= SMALL_SET) {
+                    out.push_back('(');
+                    for (unsigned c = 0, k = 0; c < 256; ++c) {
+                        if (!s[c]) continue;
+                        if (k++) out.push_back('|');
+                        appendByte(out, c);
+                    }
+                    out.push_back(')');
+                    return;
+                }
+                out.push_back('[');
+                for (unsigned c = 0; c < 256;) {
+                    if (!s[c]) { ++c; continue; }
+                    unsigned e = c;
+                    while (e + 1 < 256 && s[e + 1]) ++e;
+                    appendClassByte(out, c);
+                    if (e > c + 1) out.push_back('-');
+                    if (e > c) appendClassByte(out, e);
+                    c = e + 1;
+                }
+                out.push_back(']');
+            }
+
+            // operand of a postfix operator
+            void operand(Id id) {
+                const Node& n = dag.nodes[id];
+                bool wrap = n.kind == Kind::Concat || n.kind == Kind::Alternation || postfixed(id);
+                if (wrap) out.push_back('(');
+                expr(id, 0);
+                if (wrap) out.push_back(')');
+            }
+
+            void expr(Id id, int level) {
+                const Node& n = dag.nodes[id];
+                switch (n.kind) {
+                    case Kind::Empty:
+                    case Kind::Epsilon:
+                        out += ".{0}";
+                        return;
+                    case Kind::Set:
+                        set(dag.sets[n.set]);
+                        return;
+                    case Kind::Star:
+                        operand(n.kids[0]);
+                        out.push_back('*');
+                        return;
+                    case Kind::Concat:
+                        for (size_t i = 0; i < n.kids.size(); ++i) {
+                            // x x* as x+
+                            if (i + 1 < n.kids.size() && dag.nodes[n.kids[i + 1]].kind == Kind::Star &&
+                                dag.nodes[n.kids[i + 1]].kids[0] == n.kids[i]) {
+                                operand(n.kids[i]);
+                                out.push_back('+');
+                                ++i;
+                                continue;
+                            }
+                            expr(n.kids[i], 1);
+                        }
+                        return;
+                    case Kind::Alternation: {
+                        size_t first = n.kids.front() == EPSILON ? 1 : 0;
+                        if (first == 1) {
+                            // (ε | x) as x?
+                            if (n.kids.size() == 2) {
+                                operand(n.kids[1]);
+                            } else {
+                                out.push_back('(');
+                                branches(n, 1);
+                                out.push_back(')');
+                            }
+                            out.push_back('?');
+                            return;
+                        }
+                        if (level > 0) out.push_back('(');
+                        branches(n, 0);
+                        if (level > 0) out.push_back(')');
+                        return;
+                    }
+                }
+            }
+
+            void branches(const Node& n, size_t first) {
+                for (size_t i = first; i < n.kids.size(); ++i) {
+                    if (i > first) out.push_back('|');
+                    expr(n.kids[i], 1);
+                }
+            }
+        };
+
+        // The root at the concatenation level: a top-level alternation has
+        // to be parenthesized, as regex() appends End to the last branch.
+        Renderer r{ *this, {} };
+        r.expr(root, 1);
+        return std::move(r.out);
+    }
+
+    std::string eliminateStates(const DKA& dka) {
+        const size_t n = dka.states.size();
+        if (n == 0) return "";
+
+        // only states on some path from the start to a final state matter
+        std::vector<std::vector<size_t>> preds(n);
+        for (size_t s = 0; s < n; ++s)
+            for (const auto& tr : dka.states[s].transitions)
+                preds[tr.target].push_back(s);
+        auto sweep = [n](std::vector<size_t> from, auto&& next) {
+            std::vector<bool> seen(n, false);
+            for (size_t s : from) seen[s] = true;
+            while (!from.empty()) {
+                size_t s = from.back();
+                from.pop_back();
+                next(s, [&](size_t t) {
+                    if (!seen[t]) { seen[t] = true; from.push_back(t); }
+                });
+            }
+            return seen;
+        };
+        std::vector<bool> reach = sweep({ dka.start_state }, [&](size_t s, auto&& visit) {
+            for (const auto& tr : dka.states[s].transitions) visit(tr.target);
+        });
+        std::vector<size_t> finals;
+        for (size_t s = 0; s < n; ++s)
+            if (dka.states[s].is_final) finals.push_back(s);
+        std::vector<bool> useful = sweep(finals, [&](size_t s, auto&& visit) {
+            for (size_t p : preds[s]) visit(p);
+        });
+        if (!reach[dka.start_state] || !useful[dka.start_state]) return "";
+
+        // generalized automaton: the kept states, then a new start and final
+        std::vector<uint32_t> id(n, UINT32_MAX);
+        uint32_t m = 0;
+        for (size_t s = 0; s < n; ++s)
+            if (reach[s] && useful[s]) id[s] = m++;
+        const uint32_t START = m, FINAL = m + 1;
+
+        ExprDag dag;
+        std::vector<std::unordered_map<uint32_t, ExprDag::Id>> out(m + 2);
+        std::vector<std::unordered_set<uint32_t>> in(m + 2);
+        for (size_t s = 0; s < n; ++s) {
+            if (id[s] == UINT32_MAX) continue;
+            std::unordered_map<uint32_t, ExprDag::ByteSet> labels;
+            for (const auto& tr : dka.states[s].transitions) {
+                if (id[tr.target] == UINT32_MAX) continue;
+                ExprDag::ByteSet& set = labels[id[tr.target]];
+                for (unsigned c = tr.from; c <= tr.to; ++c)
+                    set.set(c);
+            }
+            for (auto& [t, set] : labels) {
+                out[id[s]][t] = dag.bytes(set);
+                in[t].insert(id[s]);
+            }
+            if (dka.states[s].is_final) {
+                out[id[s]][FINAL] = ExprDag::EPSILON;
+                in[FINAL].insert(id[s]);
+            }
+        }
+        out[START][id[dka.start_state]] = ExprDag::EPSILON;
+        in[id[dka.start_state]].insert(START);
+
+        auto degree = [&](uint32_t k) {
+            size_t self = out[k].count(k);
+            return (in[k].size() - self) * (out[k].size() - self);
+        };
+
+        std::vector<uint32_t> alive(m);
+        for (uint32_t k = 0; k < m; ++k) alive[k] = k;
+        while (!alive.empty()) {
+            // cheapest first: the number of edges its removal rewrites
+            size_t best = 0;
+            for (size_t i = 1; i < alive.size(); ++i)
+                if (degree(alive[i]) < degree(alive[best])) best = i;
+            uint32_t k = alive[best];
+            alive[best] = alive.back();
+            alive.pop_back();
+
+            auto self = out[k].find(k);
+            ExprDag::Id loop = self == out[k].end() ? ExprDag::EPSILON : dag.star(self->second);
+            for (uint32_t p : in[k]) {
+                if (p == k) continue;
+                ExprDag::Id head = dag.concat(out[p][k], loop);
+                for (auto [q, tail] : out[k]) {
+                    if (q == k) continue;
+                    ExprDag::Id path = dag.concat(head, tail);
+                    auto [it, inserted] = out[p].try_emplace(q, path);
+                    if (!inserted) it->second = dag.alternation(it->second, path);
+                    in[q].insert(p);
+                }
+                out[p].erase(k);
+            }
+            for (auto [q, tail] : out[k]) in[q].erase(k);
+            out[k].clear();
+            in[k].clear();
+        }
+
+        auto result = out[START].find(FINAL);
+        return dag.render(result == out[START].end() ? ExprDag::EMPTY : result->second);
+    }
+
+}
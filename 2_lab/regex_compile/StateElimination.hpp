@@ -0,0 +1,64 @@
+#ifndef STATE_ELIMINATION_HPP_
+#define STATE_ELIMINATION_HPP_
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mgr {
+
+    class DKA;
+
+    // Hash-consed regular expressions over byte sets. Constructors
+    // simplify as they go (flattening, ∅ and ε absorption, merging byte
+    // sets inside alternations, (x*)* = x*), so equal subexpressions built
+    // along different elimination paths share one node.
+    class ExprDag {
+    public:
+        using Id = uint32_t;
+        using ByteSet = std::bitset<256>;
+
+        enum class Kind : uint8_t { Empty, Epsilon, Set, Concat, Alternation, Star };
+
+        struct Node {
+            Kind kind;
+            uint32_t set;            // Set: index into sets
+            std::vector<Id> kids;    // Concat, Alternation: 2 or more; Star: 1
+        };
+
+        ExprDag();
+
+        static constexpr Id EMPTY = 0, EPSILON = 1;
+
+        Id bytes(const ByteSet& set);
+        Id concat(Id a, Id b);
+        Id alternation(Id a, Id b);
+        Id star(Id a);
+
+        inline const Node& operator[](Id id) const { return nodes[id]; }
+        inline const ByteSet& setOf(Id id) const { return sets[nodes[id].set]; }
+        inline size_t size() const { return nodes.size(); }
+
+        // In the 2_lab dialect. Byte sets are single bytes, '.', a small
+        // alternation like (b|c) or, when they hold runs, [a-z] ranges.
+        // ∅ renders as "" and a lone ε as ".{0}".
+        std::string render(Id root) const;
+
+    private:
+        std::vector<Node> nodes;
+        std::vector<ByteSet> sets;
+        std::unordered_map<std::string, Id> index;
+
+        Id intern(Kind kind, uint32_t set, std::vector<Id> kids);
+    };
+
+    // Regular expression for the language of dka by state elimination on
+    // an ExprDag. States are removed cheapest first (fewest in x out
+    // edges), expressions are rendered once at the end.
+    std::string eliminateStates(const DKA& dka);
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "TaggedDKA.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mgr {
+
+    namespace {
+
+        // A thread reached by a closure: the NFA state it stands in, the
+        // thread it came from and the tags crossed on the way.
+        struct Reached {
+            uint32_t state, src;
+            uint32_t set_first, set_count;
+        };
+
+        // Leftmost-greedy closure: seeds in priority order, Split tries out
+        // before out1, the first path to reach a state owns it.
+        class Closure {
+        public:
+            explicit Closure(const NFA& nfa) : nfa(nfa), mark(nfa.states.size(), 0) {}
+
+            void run(const std::vector<std::pair<uint32_t, uint32_t>>& seeds,
+                     std::vector<Reached>& out, std::vector<uint32_t>& sets) {
+                out.clear();
+                if (++generation == 0) {
+                    std::fill(mark.begin(), mark.end(), 0);
+                    generation = 1;
+                }
+                for (auto [src, state] : seeds) {
+                    stack.push_back(Item{ state, false });
+                    while (!stack.empty()) {
+                        Item it = stack.back();
+                        stack.pop_back();
+                        if (it.pop) {
+                            path.pop_back();
+                            continue;
+                        }
+                        if (it.state == NFA::NONE || mark[it.state] == generation) continue;
+                        mark[it.state] = generation;
+                        const NFA::State& st = nfa.states[it.state];
+                        switch (st.kind) {
+                            case NFA::Kind::Range:
+                            case NFA::Kind::Match:
+                                out.push_back(Reached{ it.state, src, static_cast<uint32_t>(sets.size()),
+                                                       static_cast<uint32_t>(path.size()) });
+                                sets.insert(sets.end(), path.begin(), path.end());
+                                break;
+                            case NFA::Kind::Split:
+                                stack.push_back(Item{ st.out1, false });
+                                stack.push_back(Item{ st.out, false });
+                                break;
+                            case NFA::Kind::Epsilon:
+                                stack.push_back(Item{ st.out, false });
+                                break;
+                            case NFA::Kind::Tag:
+                                // the tag holds for everything below it
+                                stack.push_back(Item{ 0, true });
+                                stack.push_back(Item{ st.out, false });
+                                path.push_back(st.counter);
+                                break;
+                            case NFA::Kind::Fail:
+                                break;
+                            default:
+                                throw std::logic_error("TaggedDKA: counted repeats are not supported");
+                        }
+                    }
+                }
+            }
+
+        private:
+            struct Item {
+                uint32_t state;
+                bool pop;
+            };
+
+            const NFA& nfa;
+            std::vector<uint32_t> mark;
+            uint32_t generation = 0;
+            std::vector<Item> stack;
+            std::vector<uint32_t> path;
+        };
+
+    }
+
+    TaggedDKA::TaggedDKA(const NFA& nfa) {
+        if (!nfa.counters.empty())
+            throw std::logic_error("TaggedDKA: counted repeats are not supported");
+        const ByteClasses classes = nfa.byteClasses();
+        std::copy(classes.data(), classes.data() + 256, classmap.begin());
+        num_classes = classes.count();
+        num_tags = nfa.tag_count;
+        num_threads = nfa.states.size();
+        std::vector<unsigned char> reps(num_classes);
+        for (size_t c = 0; c < num_classes; ++c)
+            reps[c] = classes.representative(c);
+
+        Closure closure(nfa);
+        std::unordered_map<std::vector<uint32_t>, uint32_t, NFA::SetHash> index;
+        std::vector<std::vector<uint32_t>> lists;
+        std::vector<Reached> reached;
+        std::vector<std::pair<uint32_t, uint32_t>> seeds;
+        std::vector<uint32_t> list;
+
+        // target state of a closure result, its ops appended to ops
+        auto intern = [&](Edge& e) {
+            e.op_first = static_cast<uint32_t>(ops.size());
+            e.op_count = static_cast<uint32_t>(reached.size());
+            list.clear();
+            for (const Reached& r : reached) {
+                ops.push_back(Op{ r.state, r.src, r.set_first, r.set_count });
+                list.push_back(r.state);
+            }
+            auto [it, inserted] = index.try_emplace(list, static_cast<uint32_t>(lists.size()));
+            if (inserted) {
+                if (lists.size() == MAX_STATES)
+                    throw std::length_error("TaggedDKA: too many states");
+                lists.push_back(list);
+                uint32_t best = NONE;
+                for (uint32_t s : list)
+                    if (nfa.states[s].kind == NFA::Kind::Match) {
+                        best = s;
+                        break;
+                    }
+                final_thread.push_back(best);
+            }
+            e.target = it->second;
+        };
+
+        seeds.emplace_back(NONE, nfa.start);
+        closure.run(seeds, reached, sets);
+        intern(start);
+
+        for (size_t i = 0; i < lists.size(); ++i) {
+            edges.resize(lists.size() * num_classes);
+            for (size_t c = 0; c < num_classes; ++c) {
+                seeds.clear();
+                for (uint32_t s : lists[i]) {
+                    const NFA::State& st = nfa.states[s];
+                    if (st.kind == NFA::Kind::Range && st.from <= reps[c] && reps[c] <= st.to)
+                        seeds.emplace_back(s, st.out);
+                }
+                if (seeds.empty()) continue;
+                closure.run(seeds, reached, sets);
+                if (reached.empty()) continue;
+                Edge e;
+                intern(e);
+                edges[i * num_classes + c] = e;
+            }
+        }
+        edges.resize(lists.size() * num_classes);
+    }
+
+    void TaggedDKA::apply(const Edge& e, size_t pos, const std::vector<size_t>& from,
+                          std::vector<size_t>& to) const {
+        const size_t t = num_tags;
+        for (uint32_t k = e.op_first; k < e.op_first + e.op_count; ++k) {
+            const Op& op = ops[k];
+            size_t* dst = to.data() + op.dst * t;
+            if (op.src == NONE) std::fill(dst, dst + t, NPOS);
+            else std::copy(from.data() + op.src * t, from.data() + (op.src + 1) * t, dst);
+            for (uint32_t j = op.set_first; j < op.set_first + op.set_count; ++j)
+                dst[sets[j]] = pos;
+        }
+    }
+
+    bool TaggedDKA::extract(std::string_view text, size_t begin, size_t end,
+                            std::span<size_t> groups, Workspace& ws) const {
+        if (empty() || groups.size() < num_tags + 2)
+            throw std::logic_error("TaggedDKA: not built or groups too small");
+        ws.regs.resize(num_threads * num_tags);
+        ws.next.resize(num_threads * num_tags);
+
+        apply(start, begin, ws.regs, ws.next);
+        ws.regs.swap(ws.next);
+        uint32_t s = start.target;
+        for (size_t i = begin; i < end; ++i) {
+            const Edge& e = edges[s * num_classes + classmap[static_cast<unsigned char>(text[i])]];
+            if (e.target == NONE) return false;
+            apply(e, i + 1, ws.regs, ws.next);
+            ws.regs.swap(ws.next);
+            s = e.target;
+        }
+        const uint32_t thread = final_thread[s];
+        if (thread == NONE) return false;
+
+        groups[0] = begin;
+        groups[1] = end;
+        std::copy(ws.regs.begin() + thread * num_tags, ws.regs.begin() + (thread + 1) * num_tags,
+                  groups.begin() + 2);
+        return true;
+    }
+
+}
@@ -0,0 +1,81 @@
+#ifndef TAGGED_DKA_HPP_
+#define TAGGED_DKA_HPP_
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "NFA.hpp"
+
+namespace mgr {
+
+    // Tagged DFA for capture groups, in the style of Laurikari's TDFA.
+    // A state is the priority-ordered list of NFA threads a leftmost-greedy
+    // simulation would hold (earlier alternatives and longer repeats
+    // first). Every thread owns one register per tag, and each transition
+    // carries the register operations for its target threads: copy the
+    // registers of the thread they come from, then set the tags crossed on
+    // the way to the current position. Extraction is then one pass over
+    // the span doing table lookups and those copies.
+    //
+    // A group inside a repeat reports the last iteration that went through
+    // it. Counted repeats have to be unrolled, the NFA must not use
+    // counters.
+    class TaggedDKA {
+    public:
+        static constexpr size_t MAX_STATES = 1 << 14;
+        static constexpr size_t NPOS = SIZE_MAX;
+
+        // Register banks, owned by the caller so a TaggedDKA can be shared
+        // between threads. They grow on first use and are reused after.
+        struct Workspace {
+            std::vector<size_t> regs, next;
+        };
+
+        TaggedDKA() = default;
+        // Throws std::length_error past MAX_STATES states.
+        explicit TaggedDKA(const NFA& nfa);
+
+        // Parses text[begin, end) as a whole. groups needs groupCount() + 1
+        // pairs: groups[2g], groups[2g + 1] bound group g, group 0 being
+        // [begin, end); NPOS for groups that took no part. False when the
+        // span does not match.
+        bool extract(std::string_view text, size_t begin, size_t end,
+                     std::span<size_t> groups, Workspace& ws) const;
+
+        inline size_t groupCount() const { return num_tags / 2; }
+        inline size_t stateCount() const { return final_thread.size(); }
+        inline bool empty() const { return final_thread.empty(); }
+
+    private:
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        // registers of thread dst = those of src (all NPOS for NONE), then
+        // the tags sets[set_first, set_first + set_count) = position
+        struct Op {
+            uint32_t dst, src;
+            uint32_t set_first, set_count;
+        };
+        struct Edge {
+            uint32_t target = NONE;
+            uint32_t op_first = 0, op_count = 0;
+        };
+
+        std::array<uint8_t, 256> classmap{};
+        size_t num_classes = 0;
+        size_t num_tags = 0;
+        size_t num_threads = 0;             // NFA states, one register row each
+        std::vector<Edge> edges;            // state x class
+        std::vector<Op> ops;
+        std::vector<uint32_t> sets;
+        Edge start;                         // ops run before the first byte
+        std::vector<uint32_t> final_thread; // best Match thread per state, NONE if not final
+
+        void apply(const Edge& e, size_t pos, const std::vector<size_t>& from,
+                   std::vector<size_t>& to) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace mgr {
+
+    namespace {
+
+        // a participant's part of the range, [begin, end)
+        struct alignas(64) Share {
+            std::mutex m;
+            size_t begin = 0, end = 0;
+        };
+
+    }
+
+    struct ThreadPool::Job {
+        const std::function<void(size_t, size_t)>* f;
+        size_t grain;
+        std::unique_ptr<Share[]> shares;
+        size_t count;
+        std::atomic<bool> failed{ false };
+        std::mutex error_mtx;
+        std::exception_ptr error;
+        size_t pending = 0;       // workers not done with it yet, under ThreadPool::mtx
+
+        // Moves the back half of the largest other share into shares[slot];
+        // false when no share has two slices left.
+        bool steal(size_t slot) {
+            size_t victim = count, most = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (i == slot) continue;
+                std::lock_guard<std::mutex> lk(shares[i].m);
+                if (shares[i].end - shares[i].begin > most) {
+                    most = shares[i].end - shares[i].begin;
+                    victim = i;
+                }
+            }
+            if (victim == count || most <= grain) return false;
+            size_t from, to;
+            {
+                Share& v = shares[victim];
+                std::lock_guard<std::mutex> lk(v.m);
+                const size_t slices = (v.end - v.begin + grain - 1) / grain;
+                if (slices < 2) return true;   // taken meanwhile, look again
+                from = v.begin + (slices + 1) / 2 * grain;
+                to = v.end;
+                v.end = from;
+            }
+            std::lock_guard<std::mutex> lk(shares[slot].m);
+            shares[slot].begin = from;
+            shares[slot].end = to;
+            return true;
+        }
+
+        void run(size_t slot) {
+            Share& own = shares[slot];
+            while (!failed.load(std::memory_order_relaxed)) {
+                size_t b, e;
+                {
+                    std::lock_guard<std::mutex> lk(own.m);
+                    b = own.begin;
+                    e = std::min(own.end, b + grain);
+                    if (b < e) own.begin = e;
+                }
+                if (b >= e) {
+                    if (!steal(slot)) return;
+                    continue;
+                }
+                try {
+                    (*f)(b, e);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lk(error_mtx);
+                    if (!error) error = std::current_exception();
+                    failed = true;
+                }
+            }
+        }
+    };
+
+    ThreadPool::ThreadPool(size_t threads) {
+        if (threads == 0) {
+            const unsigned hw = std::thread::hardware_concurrency();
+            threads = hw > 1 ? hw - 1 : 0;
+        }
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            workers.emplace_back([this, i] { workerMain(i + 1); });
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    void ThreadPool::workerMain(size_t slot) {
+        size_t seen = 0;
+        while (true) {
+            Job* j;
+            {
+                std::unique_lock<std::mutex> lk(mtx);
+                wake.wait(lk, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                j = job;
+            }
+            j->run(slot);
+            std::lock_guard<std::mutex> lk(mtx);
+            if (--j->pending == 0) idle.notify_all();
+        }
+    }
+
+    void ThreadPool::parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& f) {
+        grain = std::max<size_t>(grain, 1);
+        if (n <= grain || workers.empty()) {
+            for (size_t b = 0; b < n; b += grain)
+                f(b, std::min(n, b + grain));
+            return;
+        }
+
+        std::lock_guard<std::mutex> serial(loop);
+        Job j;
+        j.f = &f;
+        j.grain = grain;
+        j.count = concurrency();
+        j.shares = std::make_unique<Share[]>(j.count);
+        const size_t slices = (n + grain - 1) / grain;
+        for (size_t i = 0; i < j.count; ++i) {
+            j.shares[i].begin = std::min(n, slices * i / j.count * grain);
+            j.shares[i].end = std::min(n, slices * (i + 1) / j.count * grain);
+        }
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            job = &j;
+            j.pending = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        j.run(0);
+        {
+            // every worker has to leave the job before it goes out of scope
+            std::unique_lock<std::mutex> lk(mtx);
+            idle.wait(lk, [&] { return j.pending == 0; });
+            job = nullptr;
+        }
+        if (j.error) std::rethrow_exception(j.error);
+    }
+
+    ThreadPool& ThreadPool::global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+}
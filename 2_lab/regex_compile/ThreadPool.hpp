@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mgr {
+
+    // Fixed set of worker threads for data-parallel loops. parallelFor
+    // hands every participant (the workers and the calling thread) an
+    // equal share of the index range; a participant takes grain-sized
+    // slices from the front of its own share, and once that is empty it
+    // steals the back half of the largest share left. Uneven inputs thus
+    // end up balanced without a shared queue on the hot path.
+    class ThreadPool {
+    public:
+        // threads is the number of workers besides the caller; 0: one less
+        // than the hardware threads.
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Calls f(begin, end) on disjoint slices covering [0, n). Every
+        // slice begins at a multiple of grain and is at most grain long.
+        // Returns when all of them are done; the first exception thrown by
+        // f is rethrown here and the slices not started yet are skipped.
+        // One loop runs at a time, f must not call parallelFor itself.
+        void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& f);
+
+        // participants of a loop, the caller included
+        inline size_t concurrency() const { return workers.size() + 1; }
+
+        // Process-wide instance, created on first use
+        static ThreadPool& global();
+
+    private:
+        struct Job;
+
+        std::vector<std::thread> workers;
+        std::mutex mtx;
+        std::condition_variable wake, idle;
+        Job* job = nullptr;
+        size_t generation = 0;
+        size_t busy = 0;          // workers inside the current job
+        bool stopping = false;
+        std::mutex loop;          // serializes parallelFor
+
+        void workerMain(size_t slot);
+    };
+
+}
+
+#endif
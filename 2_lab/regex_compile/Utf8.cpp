@@ -0,0 +1,154 @@
+#include "Utf8.hpp"
+#include <algorithm>
+
+namespace mgr {
+
+    namespace {
+
+        // largest code point of each encoded length
+        constexpr char32_t LAST[] = { 0x7F, 0x7FF, 0xFFFF, MAX_CODE_POINT };
+
+        size_t encode(char32_t cp, unsigned char out[4]) {
+            if (cp <= LAST[0]) {
+                out[0] = static_cast<unsigned char>(cp);
+                return 1;
+            }
+            size_t n = cp <= LAST[1] ? 2 : cp <= LAST[2] ? 3 : 4;
+            for (size_t i = n; i-- > 1; cp >>= 6)
+                out[i] = static_cast<unsigned char>(0x80 | (cp & 0x3F));
+            static constexpr unsigned char LEAD[] = { 0, 0, 0xC0, 0xE0, 0xF0 };
+            out[0] = static_cast<unsigned char>(LEAD[n] | cp);
+            return n;
+        }
+
+        // Splits [from, to] until both ends share every byte but where the
+        // range lies, then emits the bytewise ranges.
+        void split(char32_t from, char32_t to, std::vector<Utf8Sequence>& out) {
+            for (size_t n = 0; n < 3; ++n) {
+                if (from <= LAST[n] && to > LAST[n]) {
+                    split(from, LAST[n], out);
+                    split(LAST[n] + 1, to, out);
+                    return;
+                }
+            }
+            unsigned char a[4], b[4];
+            const size_t len = encode(from, a);
+            // trailing bytes have to cover whole 6 bit blocks
+            for (size_t i = 1; i < len; ++i) {
+                const char32_t m = (char32_t(1) << (6 * i)) - 1;
+                if ((from & ~m) == (to & ~m)) continue;
+                if ((from & m) != 0) {
+                    split(from, from | m, out);
+                    split((from | m) + 1, to, out);
+                    return;
+                }
+                if ((to & m) != m) {
+                    split(from, (to & ~m) - 1, out);
+                    split(to & ~m, to, out);
+                    return;
+                }
+            }
+            encode(to, b);
+            Utf8Sequence seq{};
+            seq.length = static_cast<uint8_t>(len);
+            for (size_t i = 0; i < len; ++i)
+                seq.bytes[i] = { a[i], b[i] };
+            out.push_back(seq);
+        }
+
+    }
+
+    std::vector<Utf8Sequence> utf8Sequences(char32_t from, char32_t to) {
+        std::vector<Utf8Sequence> res;
+        to = std::min(to, MAX_CODE_POINT);
+        // surrogates have no encoding
+        constexpr char32_t SURROGATE_FIRST = 0xD800, SURROGATE_LAST = 0xDFFF;
+        if (from < SURROGATE_FIRST && from <= to)
+            split(from, std::min<char32_t>(to, SURROGATE_FIRST - 1), res);
+        from = std::max<char32_t>(from, SURROGATE_LAST + 1);
+        if (from <= to)
+            split(from, to, res);
+        return res;
+    }
+
+    std::vector<Utf8Sequence> dotSequences(Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Ascii:
+                return { Utf8Sequence{ { ByteClasses::Range{ ' ', '~' } }, 1 } };
+            case Encoding::Bytes:
+                return { Utf8Sequence{ { ByteClasses::Range{ 0, '\n' - 1 } }, 1 },
+                         Utf8Sequence{ { ByteClasses::Range{ '\n' + 1, 0xFF } }, 1 } };
+            case Encoding::Utf8: {
+                std::vector<Utf8Sequence> res = utf8Sequences(0, '\n' - 1);
+                std::vector<Utf8Sequence> rest = utf8Sequences('\n' + 1, MAX_CODE_POINT);
+                res.insert(res.end(), rest.begin(), rest.end());
+                return res;
+            }
+        }
+        return {};
+    }
+
+    std::vector<Utf8Sequence> classSequences(const std::vector<ClassRange>& ranges, bool negated,
+                                             Encoding encoding) {
+        std::vector<Utf8Sequence> res;
+        auto byteRange = [&res](char32_t from, char32_t to) {
+            res.push_back(Utf8Sequence{ { ByteClasses::Range{ static_cast<unsigned char>(from),
+                                                               static_cast<unsigned char>(to) } }, 1 });
+        };
+        if (!negated) {
+            for (auto [from, to] : ranges) {
+                if (from >= RAW_BYTE) {
+                    byteRange(from - RAW_BYTE, to - RAW_BYTE);
+                    continue;
+                }
+                if (from < 0x80) byteRange(from, std::min<char32_t>(to, 0x7F));
+                if (to >= 0x80) {
+                    std::vector<Utf8Sequence> seqs = utf8Sequences(std::max<char32_t>(from, 0x80), to);
+                    res.insert(res.end(), seqs.begin(), seqs.end());
+                }
+            }
+            return res;
+        }
+
+        // the universe of '.' with the listed ranges cut out, in ranges of
+        // the same kind as the universe
+        const bool wide = encoding == Encoding::Utf8;
+        const char32_t first = encoding == Encoding::Ascii ? ' ' : 0;
+        const char32_t last = encoding == Encoding::Ascii ? '~' : wide ? MAX_CODE_POINT : 0xFF;
+        std::vector<ClassRange> cut{ { '\n', '\n' } };
+        for (auto [from, to] : ranges) {
+            if (from >= RAW_BYTE) {
+                if (!wide) cut.emplace_back(from - RAW_BYTE, to - RAW_BYTE);
+            } else if (wide || from < 0x80) {
+                cut.emplace_back(from, wide ? to : std::min<char32_t>(to, 0x7F));
+            }
+        }
+        std::sort(cut.begin(), cut.end());
+        char32_t next = first;
+        auto keep = [&](char32_t from, char32_t to) {
+            if (from > to) return;
+            if (!wide) {
+                byteRange(from, to);
+                return;
+            }
+            std::vector<Utf8Sequence> seqs = utf8Sequences(from, to);
+            res.insert(res.end(), seqs.begin(), seqs.end());
+        };
+        for (auto [from, to] : cut) {
+            if (to < next) continue;
+            if (from > last) break;
+            if (from > next) keep(next, from - 1);
+            if (to >= last) return res;
+            next = to + 1;
+        }
+        keep(next, last);
+        return res;
+    }
+
+    void appendUtf8(std::string& out, char32_t cp) {
+        unsigned char buf[4];
+        size_t n = encode(std::min(cp, MAX_CODE_POINT), buf);
+        out.append(reinterpret_cast<const char*>(buf), n);
+    }
+
+}
@@ -0,0 +1,85 @@
+#ifndef UTF8_HPP_
+#define UTF8_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ByteClasses.hpp"
+
+namespace mgr {
+
+    // What '.' matches. Ascii: one printable ASCII byte, the original
+    // dialect. Bytes: any byte but '\n'. Utf8: the encoding of any code
+    // point but '\n'; surrogates, overlong forms and bytes that cannot
+    // start a sequence never match.
+    enum class Encoding : uint8_t {
+        Ascii,
+        Bytes,
+        Utf8
+    };
+
+    // Byte ranges matched one after the other, e.g. [e1-ec][80-bf][80-bf].
+    struct Utf8Sequence {
+        std::array<ByteClasses::Range, 4> bytes;
+        uint8_t length;
+    };
+
+    constexpr char32_t MAX_CODE_POINT = 0x10FFFF;
+
+    // Inclusive range of a bracket class. Values from RAW_BYTE on stand for
+    // the byte value - RAW_BYTE: a byte >= 0x80 written into the class
+    // that does not start a UTF-8 character.
+    using ClassRange = std::pair<char32_t, char32_t>;
+    constexpr char32_t RAW_BYTE = MAX_CODE_POINT + 1;
+
+    // Sequences whose byte strings are exactly the encodings of the code
+    // points in [from, to], surrogates left out. Sorted by first byte and
+    // disjoint, so at most one of them matches any string.
+    std::vector<Utf8Sequence> utf8Sequences(char32_t from, char32_t to);
+
+    // The sequences '.' stands for in the given encoding.
+    std::vector<Utf8Sequence> dotSequences(Encoding encoding);
+
+    // What a bracket class reads. Listed code points become their UTF-8
+    // encodings and raw bytes themselves, whatever the encoding; [^...]
+    // is what '.' reads minus the listed characters, so in Ascii and Bytes
+    // it stays one byte and code points above U+007F in it are ignored.
+    std::vector<Utf8Sequence> classSequences(const std::vector<ClassRange>& ranges, bool negated,
+                                             Encoding encoding);
+
+    void appendUtf8(std::string& out, char32_t cp);
+
+    // Length of the well-formed sequence s starts with, 0 if it does not
+    // start with one.
+    constexpr size_t utf8Length(std::string_view s) {
+        if (s.empty()) return 0;
+        const auto b0 = static_cast<unsigned char>(s[0]);
+        if (b0 < 0x80) return 1;
+        size_t n = b0 >= 0xC2 && b0 <= 0xDF ? 2 : b0 >= 0xE0 && b0 <= 0xEF ? 3
+                 : b0 >= 0xF0 && b0 <= 0xF4 ? 4 : 0;
+        if (n == 0 || s.size() < n) return 0;
+        // the second byte is narrowed for overlongs, surrogates and > U+10FFFF
+        const auto b1 = static_cast<unsigned char>(s[1]);
+        unsigned char lo = b0 == 0xE0 ? 0xA0 : b0 == 0xF0 ? 0x90 : 0x80;
+        unsigned char hi = b0 == 0xED ? 0x9F : b0 == 0xF4 ? 0x8F : 0xBF;
+        if (b1 < lo || b1 > hi) return 0;
+        for (size_t i = 2; i < n; ++i)
+            if ((static_cast<unsigned char>(s[i]) & 0xC0) != 0x80) return 0;
+        return n;
+    }
+
+    // Code point of the n byte sequence utf8Length accepted.
+    constexpr char32_t utf8Decode(std::string_view s, size_t n) {
+        constexpr unsigned char LEAD_MASK[] = { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+        char32_t cp = static_cast<unsigned char>(s[0]) & LEAD_MASK[n];
+        for (size_t i = 1; i < n; ++i)
+            cp = (cp << 6) | (static_cast<unsigned char>(s[i]) & 0x3F);
+        return cp;
+    }
+
+}
+
+#endif
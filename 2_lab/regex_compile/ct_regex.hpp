@@ -0,0 +1,610 @@
+#ifndef CT_REGEX_HPP_
+#define CT_REGEX_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Utf8.hpp"
+
+// Compile-time regex for patterns known when the program is built:
+//
+//     using Rule = mgr::ct_regex<"(M+(e+)?p+|(h+)?i)">;
+//     static_assert(Rule::match("Mepp"));
+//
+// The dialect is the one of mgr::regex. Tokenizing, parsing, Thompson
+// construction, subset construction and minimization all run during
+// constant evaluation with transient std::vector storage; only the
+// minimized table survives, as std::array members of ct_regex. A bad
+// pattern fails to compile at the throw that rejects it. Bounded repeats
+// are always unrolled here, so keep the bounds modest. '.' is the
+// Encoding::Ascii one. Named groups are accepted but capture nothing;
+// bracket classes may only list single bytes.
+
+namespace mgr {
+
+    namespace ct {
+
+        template<size_t N>
+        struct fixed_string {
+            char chars[N]{};
+
+            constexpr fixed_string(const char (&s)[N]) {
+                for (size_t i = 0; i < N; ++i) chars[i] = s[i];
+            }
+            constexpr std::string_view view() const { return { chars, N - 1 }; }
+        };
+
+        inline constexpr int INF = std::numeric_limits<int>::max();
+
+        struct Ast {
+            enum Kind : uint8_t { Range, Concat, Alternation, Repeat, End };
+            Kind kind;
+            unsigned char lo = 0, hi = 0;
+            int min = 0, max = 0;
+            size_t left = 0, right = 0;   // Concat/Alternation: both, Repeat: left
+        };
+
+        // Recursive descent straight over the pattern, mirroring
+        // Tokenizer::Tokenize and regex::TokenToTree.
+        class Parser {
+        public:
+            std::vector<Ast> nodes;
+            size_t root = 0;
+
+            constexpr explicit Parser(std::string_view pattern) : src(pattern) {
+                if (src.empty() || src.back() != '$') {
+                    owned.assign(src.begin(), src.end());
+                    owned.push_back('$');
+                    src = std::string_view(owned.data(), owned.size());
+                }
+                root = expr();
+                if (!atEnd())
+                    throw std::invalid_argument("Unexpected ')'");
+            }
+
+        private:
+            std::string_view src;
+            std::vector<char> owned;
+            size_t cur = 0;
+
+            constexpr bool atEnd() const { return cur >= src.size(); }
+            constexpr char peek() const { return src[cur]; }
+            constexpr bool atEndToken() const { return !atEnd() && peek() == '$' && cur + 1 == src.size(); }
+
+            constexpr size_t add(Ast node) {
+                nodes.push_back(node);
+                return nodes.size() - 1;
+            }
+
+            constexpr size_t expr() {
+                size_t left = concat();
+                while (!atEnd() && peek() == '|') {
+                    ++cur;
+                    size_t right = concat();
+                    left = add(Ast{ Ast::Alternation, 0, 0, 0, 0, left, right });
+                }
+                return left;
+            }
+
+            constexpr size_t concat() {
+                bool any = false;
+                size_t res = 0;
+                auto push = [&](size_t node) {
+                    res = any ? add(Ast{ Ast::Concat, 0, 0, 0, 0, res, node }) : node;
+                    any = true;
+                };
+                while (!atEnd() && peek() != '|' && peek() != ')' && !atEndToken())
+                    push(repeat());
+                if (!any)
+                    throw std::invalid_argument("Error: Empty concat");
+                if (atEndToken()) {
+                    ++cur;
+                    push(add(Ast{ Ast::End }));
+                }
+                return res;
+            }
+
+            constexpr int number() {
+                if (atEnd() || peek() < '0' || peek() > '9')
+                    throw std::invalid_argument("Invalid repeat bounds");
+                long long n = 0;
+                while (!atEnd() && peek() >= '0' && peek() <= '9') {
+                    n = n * 10 + (peek() - '0');
+                    if (n > INF) throw std::invalid_argument("Invalid repeat bounds");
+                    ++cur;
+                }
+                return static_cast<int>(n);
+            }
+
+            constexpr size_t repeat() {
+                size_t node = atom();
+                if (atEnd()) return node;
+                int min = 0, max = INF;
+                switch (peek()) {
+                    case '+': min = 1; ++cur; break;
+                    case '*': ++cur; break;
+                    case '?': max = 1; ++cur; break;
+                    case '{': {
+                        // like Tokenizer::parseCurly: anything after the
+                        // bounds up to the '}' is ignored
+                        size_t close = cur + 1;
+                        while (close < src.size() && src[close] != '}') ++close;
+                        if (close == src.size() || close == cur + 1)
+                            throw std::invalid_argument("Incorrect string: Curly Error");
+                        ++cur;
+                        if (peek() == ',') {
+                            ++cur;
+                            max = number();
+                        } else {
+                            min = max = number();
+                            if (peek() == ',') {
+                                ++cur;
+                                max = peek() >= '0' && peek() <= '9' ? number() : INF;
+                            }
+                        }
+                        cur = close + 1;
+                        break;
+                    }
+                    default:
+                        return node;
+                }
+                if (min > max)
+                    throw std::invalid_argument("Invalid repeat bounds");
+                return add(Ast{ Ast::Repeat, 0, 0, min, max, node });
+            }
+
+            // ranges of \d \w \s and of the [:name:] classes
+            static constexpr bool named(std::string_view name, std::array<bool, 256>& set) {
+                auto mark = [&set](unsigned char lo, unsigned char hi) {
+                    for (unsigned c = lo; c <= hi; ++c) set[c] = true;
+                };
+                const bool digit = name == "d" || name == "digit" || name == "alnum" || name == "w" ||
+                                   name == "word" || name == "xdigit";
+                const bool upper = name == "alpha" || name == "alnum" || name == "upper" || name == "w" ||
+                                   name == "word";
+                const bool lower = name == "alpha" || name == "alnum" || name == "lower" || name == "w" ||
+                                   name == "word";
+                const bool space = name == "s" || name == "space";
+                if (digit) mark('0', '9');
+                if (upper) mark('A', 'Z');
+                if (lower) mark('a', 'z');
+                if (name == "w" || name == "word") mark('_', '_');
+                if (space) { mark('\t', '\r'); mark(' ', ' '); }
+                if (name == "xdigit") { mark('A', 'F'); mark('a', 'f'); }
+                if (name == "punct") { mark('!', '/'); mark(':', '@'); mark('[', '`'); mark('{', '~'); }
+                return digit || upper || lower || space || name == "punct";
+            }
+
+            // one alternative per run of the set; negation is within '.'
+            constexpr size_t classNode(std::array<bool, 256> set, bool negated) {
+                if (negated)
+                    for (unsigned c = 0; c < 256; ++c) set[c] = c >= ' ' && c <= '~' && !set[c];
+                size_t res = 0;
+                bool any = false;
+                for (unsigned c = 0; c < 256;) {
+                    if (!set[c]) { ++c; continue; }
+                    unsigned e = c;
+                    while (e + 1 < 256 && set[e + 1]) ++e;
+                    size_t r = add(Ast{ Ast::Range, static_cast<unsigned char>(c), static_cast<unsigned char>(e) });
+                    res = any ? add(Ast{ Ast::Alternation, 0, 0, 0, 0, res, r }) : r;
+                    any = true;
+                    c = e + 1;
+                }
+                if (!any)
+                    throw std::invalid_argument("Class matches nothing");
+                return res;
+            }
+
+            // like Tokenizer's parseClass, bytes only
+            constexpr size_t bracket() {
+                std::array<bool, 256> set{};
+                bool negated = !atEnd() && peek() == '^';
+                if (negated) ++cur;
+                auto item = [&](bool& was_set) -> unsigned char {
+                    was_set = false;
+                    if (atEnd())
+                        throw std::invalid_argument("Unterminated class");
+                    char c = src[cur++];
+                    if (c == '\\') {
+                        if (atEnd())
+                            throw std::invalid_argument("Unterminated class");
+                        c = src[cur++];
+                        if (c == 'd' || c == 'w' || c == 's') {
+                            named(std::string_view(&c, 1), set);
+                            was_set = true;
+                        } else if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+                            throw std::invalid_argument("Unknown class escape");
+                        }
+                    } else if (c == '[' && !atEnd() && peek() == ':') {
+                        size_t close = src.find(":]", cur + 1);
+                        if (close != std::string_view::npos) {
+                            if (!named(src.substr(cur + 1, close - cur - 1), set))
+                                throw std::invalid_argument("Unknown class name");
+                            cur = close + 2;
+                            was_set = true;
+                        }
+                    } else if (utf8Length(src.substr(cur - 1)) > 1) {
+                        throw std::invalid_argument("ct_regex classes are bytes only");
+                    }
+                    return static_cast<unsigned char>(c);
+                };
+                bool any = false;
+                while (atEnd() || peek() != ']') {
+                    bool was_set = false;
+                    unsigned char from = item(was_set), to = from;
+                    any = true;
+                    if (was_set) continue;
+                    if (cur + 1 < src.size() && peek() == '-' && src[cur + 1] != ']') {
+                        ++cur;
+                        bool to_set = false;
+                        to = item(to_set);
+                        if (to_set || to < from)
+                            throw std::invalid_argument("Invalid class range");
+                    }
+                    for (unsigned c = from; c <= to; ++c) set[c] = true;
+                }
+                ++cur;
+                if (!any)
+                    throw std::invalid_argument("Empty class");
+                return classNode(set, negated);
+            }
+
+            constexpr size_t atom() {
+                if (atEnd())
+                    throw std::invalid_argument("Unexpected end in ParseAtom");
+                char c = src[cur++];
+                switch (c) {
+                    case '&':
+                        if (atEnd())
+                            throw std::invalid_argument("Dangling escape '&' at end");
+                        c = src[cur++];
+                        if (c == 'd' || c == 'w' || c == 's' || c == 'D' || c == 'W' || c == 'S') {
+                            std::array<bool, 256> set{};
+                            const char lower = static_cast<char>(c | 0x20);
+                            named(std::string_view(&lower, 1), set);
+                            return classNode(set, c != lower);
+                        }
+                        break;
+                    case '[':
+                        return bracket();
+                    case '.':
+                        return add(Ast{ Ast::Range, ' ', '~' });
+                    case '(': {
+                        // a group name only matters for captures, which this has none of
+                        if (!atEnd() && peek() == '<') {
+                            size_t close = src.find('>', cur);
+                            if (close == std::string_view::npos || close == cur + 1)
+                                throw std::invalid_argument("Invalid group name");
+                            cur = close + 1;
+                        }
+                        size_t inner = expr();
+                        if (atEnd() || peek() != ')')
+                            throw std::invalid_argument("Expected closing ')'");
+                        ++cur;
+                        return inner;
+                    }
+                    case '$':
+                        throw std::invalid_argument("Incorrect string: found $(EOL) before end");
+                    case '|': case ')': case '+': case '*': case '?': case '{':
+                        throw std::invalid_argument("Unexpected token in ParseAtom");
+                    default: {
+                        // a multibyte character is one atom, as in regex::ParseAtom
+                        size_t n = utf8Length(src.substr(cur - 1));
+                        if (n <= 1) break;
+                        size_t res = add(Ast{ Ast::Range, static_cast<unsigned char>(c), static_cast<unsigned char>(c) });
+                        for (size_t end = cur - 1 + n; cur < end; ++cur) {
+                            auto b = static_cast<unsigned char>(src[cur]);
+                            size_t next = add(Ast{ Ast::Range, b, b });
+                            res = add(Ast{ Ast::Concat, 0, 0, 0, 0, res, next });
+                        }
+                        return res;
+                    }
+                }
+                auto b = static_cast<unsigned char>(c);
+                return add(Ast{ Ast::Range, b, b });
+            }
+        };
+
+        // Thompson NFA, built the way NFA::build does it.
+        struct Nfa {
+            enum Kind : uint8_t { Range, Split, Epsilon, Match };
+            struct State {
+                Kind kind;
+                unsigned char lo = 0, hi = 0;
+                size_t out = NONE, out1 = NONE;
+            };
+            struct Hole {
+                size_t state;
+                bool second;
+            };
+            struct Fragment {
+                size_t start;
+                std::vector<Hole> holes;
+            };
+
+            static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+            std::vector<State> states;
+            size_t start = NONE;
+
+            constexpr explicit Nfa(const Parser& p) {
+                Fragment f = build(p.nodes, p.root);
+                start = f.start;   // holes that never reached End stay NONE
+            }
+
+        private:
+            constexpr size_t add(State s) {
+                states.push_back(s);
+                return states.size() - 1;
+            }
+
+            constexpr void patch(const std::vector<Hole>& holes, size_t target) {
+                for (const Hole& h : holes)
+                    (h.second ? states[h.state].out1 : states[h.state].out) = target;
+            }
+
+            constexpr Fragment build(const std::vector<Ast>& ast, size_t id) {
+                const Ast node = ast[id];
+                switch (node.kind) {
+                    case Ast::Range: {
+                        size_t s = add(State{ Range, node.lo, node.hi });
+                        return Fragment{ s, { Hole{ s, false } } };
+                    }
+                    case Ast::End:
+                        return Fragment{ add(State{ Match }), {} };
+                    case Ast::Concat: {
+                        Fragment a = build(ast, node.left);
+                        Fragment b = build(ast, node.right);
+                        patch(a.holes, b.start);
+                        return Fragment{ a.start, std::move(b.holes) };
+                    }
+                    case Ast::Alternation: {
+                        Fragment a = build(ast, node.left);
+                        Fragment b = build(ast, node.right);
+                        size_t split = add(State{ Split, 0, 0, a.start, b.start });
+                        a.holes.insert(a.holes.end(), b.holes.begin(), b.holes.end());
+                        return Fragment{ split, std::move(a.holes) };
+                    }
+                    case Ast::Repeat:
+                        return repeat(ast, node);
+                }
+                throw std::logic_error("Unknown node type");
+            }
+
+            constexpr Fragment repeat(const std::vector<Ast>& ast, const Ast& rep) {
+                if (rep.max == 0) {
+                    size_t s = add(State{ Epsilon });
+                    return Fragment{ s, { Hole{ s, false } } };
+                }
+                Fragment res{ NONE, {} };
+                auto append = [&](Fragment next) {
+                    if (res.start == NONE) {
+                        res = std::move(next);
+                    } else {
+                        patch(res.holes, next.start);
+                        res.holes = std::move(next.holes);
+                    }
+                };
+                for (int i = 0; i < rep.min; ++i)
+                    append(build(ast, rep.left));
+                if (rep.max == INF) {
+                    Fragment body = build(ast, rep.left);
+                    size_t split = add(State{ Split, 0, 0, body.start });
+                    patch(body.holes, split);
+                    append(Fragment{ split, { Hole{ split, true } } });
+                    return res;
+                }
+                std::vector<Hole> skips;
+                for (int i = rep.min; i < rep.max; ++i) {
+                    Fragment body = build(ast, rep.left);
+                    size_t split = add(State{ Split, 0, 0, body.start });
+                    append(Fragment{ split, std::move(body.holes) });
+                    skips.push_back(Hole{ split, true });
+                }
+                res.holes.insert(res.holes.end(), skips.begin(), skips.end());
+                return res;
+            }
+        };
+
+        // Minimized DFA over byte classes. State 0 is dead.
+        struct Dfa {
+            std::array<uint8_t, 256> classes{};
+            size_t num_classes = 0;
+            std::vector<size_t> table;   // state * num_classes + class
+            std::vector<bool> final;
+            size_t start = 0;
+
+            constexpr size_t size() const { return final.size(); }
+
+            constexpr explicit Dfa(std::string_view pattern) {
+                Parser parser(pattern);
+                Nfa nfa(parser);
+                classify(nfa);
+                determinize(nfa);
+                minimize();
+            }
+
+        private:
+            constexpr void classify(const Nfa& nfa) {
+                std::array<bool, 257> cut{};
+                for (const auto& s : nfa.states)
+                    if (s.kind == Nfa::Range) {
+                        cut[s.lo] = true;
+                        cut[s.hi + 1u] = true;
+                    }
+                size_t cls = 0;
+                for (size_t b = 0; b < 256; ++b) {
+                    if (b > 0 && cut[b]) ++cls;
+                    classes[b] = static_cast<uint8_t>(cls);
+                }
+                num_classes = cls + 1;
+            }
+
+            static constexpr void closure(const Nfa& nfa, std::vector<size_t>& set) {
+                std::vector<bool> seen(nfa.states.size(), false);
+                std::vector<size_t> stack = set, out;
+                while (!stack.empty()) {
+                    size_t s = stack.back();
+                    stack.pop_back();
+                    if (s == Nfa::NONE || seen[s]) continue;
+                    seen[s] = true;
+                    const auto& st = nfa.states[s];
+                    if (st.kind == Nfa::Split) {
+                        stack.push_back(st.out1);
+                        stack.push_back(st.out);
+                    } else if (st.kind == Nfa::Epsilon) {
+                        stack.push_back(st.out);
+                    } else {
+                        out.push_back(s);
+                    }
+                }
+                // sort: sets are compared as sequences
+                for (size_t i = 1; i < out.size(); ++i)
+                    for (size_t j = i; j > 0 && out[j - 1] > out[j]; --j)
+                        std::swap(out[j - 1], out[j]);
+                set = std::move(out);
+            }
+
+            constexpr void determinize(const Nfa& nfa) {
+                std::array<unsigned char, 256> sample{};
+                for (size_t b = 256; b-- > 0;)
+                    sample[classes[b]] = static_cast<unsigned char>(b);
+
+                std::vector<std::vector<size_t>> sets;
+                sets.push_back({});          // dead
+                std::vector<size_t> first{ nfa.start };
+                closure(nfa, first);
+                sets.push_back(first);
+                start = 1;
+
+                for (size_t d = 1; d < sets.size(); ++d) {
+                    for (size_t c = 0; c < num_classes; ++c) {
+                        std::vector<size_t> next;
+                        for (size_t s : sets[d]) {
+                            const auto& st = nfa.states[s];
+                            if (st.kind == Nfa::Range && st.lo <= sample[c] && sample[c] <= st.hi)
+                                next.push_back(st.out);
+                        }
+                        closure(nfa, next);
+                        size_t target = 0;
+                        if (!next.empty()) {
+                            target = sets.size();
+                            for (size_t k = 1; k < sets.size(); ++k)
+                                if (sets[k] == next) { target = k; break; }
+                            if (target == sets.size()) sets.push_back(std::move(next));
+                        }
+                        table.push_back(target);
+                    }
+                }
+                // the dead row
+                table.insert(table.begin(), num_classes, 0);
+                table.resize(sets.size() * num_classes);
+                final.assign(sets.size(), false);
+                for (size_t d = 1; d < sets.size(); ++d)
+                    for (size_t s : sets[d])
+                        if (nfa.states[s].kind == Nfa::Match) final[d] = true;
+            }
+
+            // Moore refinement; the dead state keeps block 0.
+            constexpr void minimize() {
+                const size_t n = size();
+                std::vector<size_t> block(n), next(n);
+                for (size_t s = 0; s < n; ++s) block[s] = final[s] ? 1 : 0;
+                if (final[0]) throw std::logic_error("Dead state cannot accept");
+                size_t count = 0;
+                for (;;) {
+                    // states with equal (block, successor blocks) share a block,
+                    // numbered in order of first appearance
+                    std::vector<size_t> reps;
+                    for (size_t s = 0; s < n; ++s) {
+                        size_t found = reps.size();
+                        for (size_t r = 0; r < reps.size(); ++r) {
+                            size_t t = reps[r];
+                            bool same = block[s] == block[t];
+                            for (size_t c = 0; same && c < num_classes; ++c)
+                                same = block[table[s * num_classes + c]] == block[table[t * num_classes + c]];
+                            if (same) { found = r; break; }
+                        }
+                        if (found == reps.size()) reps.push_back(s);
+                        next[s] = found;
+                    }
+                    bool stable = reps.size() == count;
+                    count = reps.size();
+                    block = next;
+                    if (stable) break;
+                }
+
+                std::vector<size_t> rep(count);
+                for (size_t s = n; s-- > 0;) rep[block[s]] = s;
+                std::vector<size_t> merged(count * num_classes);
+                std::vector<bool> accepting(count);
+                for (size_t b = 0; b < count; ++b) {
+                    for (size_t c = 0; c < num_classes; ++c)
+                        merged[b * num_classes + c] = block[table[rep[b] * num_classes + c]];
+                    accepting[b] = final[rep[b]];
+                }
+                table = std::move(merged);
+                final = std::move(accepting);
+                start = block[start];
+            }
+        };
+
+        template<size_t States, size_t Classes>
+        struct Table {
+            using Cell = std::conditional_t<(States <= 256), uint8_t, uint16_t>;
+            static_assert(States <= 65536, "ct_regex: too many states");
+
+            std::array<uint8_t, 256> classes{};
+            std::array<Cell, States * Classes> next{};
+            std::array<bool, States> final{};
+            Cell start = 0;
+        };
+
+        template<fixed_string Pattern>
+        constexpr auto bake() {
+            constexpr std::pair<size_t, size_t> dims = [] {
+                Dfa dfa(Pattern.view());
+                return std::pair<size_t, size_t>{ dfa.size(), dfa.num_classes };
+            }();
+            using T = Table<dims.first, dims.second>;
+            Dfa dfa(Pattern.view());
+            T t;
+            t.classes = dfa.classes;
+            for (size_t i = 0; i < dfa.table.size(); ++i)
+                t.next[i] = static_cast<typename T::Cell>(dfa.table[i]);
+            for (size_t s = 0; s < dfa.size(); ++s)
+                t.final[s] = dfa.final[s];
+            t.start = static_cast<typename T::Cell>(dfa.start);
+            return t;
+        }
+
+    }
+
+    template<ct::fixed_string Pattern>
+    class ct_regex {
+        static constexpr auto dfa = ct::bake<Pattern>();
+        static constexpr size_t num_classes = dfa.next.size() / dfa.final.size();
+
+    public:
+        static constexpr bool match(std::string_view str) noexcept {
+            size_t s = dfa.start;
+            for (char ch : str) {
+                s = dfa.next[s * num_classes + dfa.classes[static_cast<unsigned char>(ch)]];
+                if (s == 0) return false;
+            }
+            return dfa.final[s];
+        }
+
+        static constexpr std::string_view pattern() { return Pattern.view(); }
+        // including the dead state
+        static constexpr size_t stateCount() { return dfa.final.size(); }
+    };
+
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include <vector>
 #include <stdexcept>
 #include <limits>
+#include <cstdint>
+#include <utility>
 
 #define INFINITY std::numeric_limits<int>::max()
 
@@ -18,7 +20,8 @@ enum class NodeType {
     Literal,
     Epsilon,
     EmptySet,
-    // Group,
+    Group,
+    Class,
     Concat,
     End
 };
@@ -31,10 +34,12 @@ struct Epsilon;
 struct EmptySet;
 struct Concat;
 struct End;
+struct Group;
+struct CharClass;
 
 
 
-using Node = std::variant<Repeat, Alternation, Wildcard, Literal, Epsilon, EmptySet, Concat, End>;
+using Node = std::variant<Repeat, Alternation, Wildcard, Literal, Epsilon, EmptySet, Concat, End, Group, CharClass>;
 using NodePtr = std::shared_ptr<Node>;
 
 struct Repeat {
@@ -73,16 +78,43 @@ struct Literal {
 struct Epsilon {
     NodeType Type = NodeType::Epsilon;
 };
+
+// Capture group number index (from 1, in order of the opening parens).
+struct Group {
+    NodeType Type = NodeType::Group;
+    int index;
+    NodePtr child;
+    explicit Group(int i) : index(i) {}
+};
 struct EmptySet {
     NodeType Type = NodeType::EmptySet;
 };
 
+// Bracket class: sorted disjoint ranges as in the Class token (code
+// points, raw bytes from RAW_BYTE on); see classSequences.
+struct CharClass {
+    NodeType Type = NodeType::Class;
+    bool negated = false;
+    std::vector<std::pair<char32_t, char32_t>> ranges;
+};
+
 class regex;
+class RegexArena;
+
+using NodeId = uint32_t;
 
 class RegexTree {
 public:
     RegexTree() = default;
-    NodePtr root;
+    // The arena is the tree: the parser attaches one, makeRoot imports a
+    // pointer tree into a new one. The tree is never changed after that.
+    std::shared_ptr<const RegexArena> arena;
+    NodeId arena_root = 0;
+
+    void attach(std::shared_ptr<const RegexArena> nodes, NodeId id) {
+        arena = std::move(nodes);
+        arena_root = id;
+    }
 
     template<typename T, typename... Args>
     NodePtr makeNode(NodePtr& parent, Args&&... args) {
@@ -93,21 +125,19 @@ public:
 
     template<typename T, typename... Args>
     void makeRoot(Args&&... args) {
-        root = T(std::forward<Args>(args)...);
+        makeRoot(std::make_shared<Node>(T(std::forward<Args>(args)...)));
     }
 
-    void makeRoot(NodePtr& ptr) {
-        root = ptr;
-    }
-
-    void makeRoot(NodePtr&& ptr) {
-        root = std::move(ptr);
-    }
+    // Copies the tree; later edits through ptr do not reach it.
+    void makeRoot(const NodePtr& ptr);
 
     void addKid(const NodePtr kid, const NodePtr parent) {
         if (auto* ptr = std::get_if<Repeat>(parent.get())) {
             ptr->child = kid;
         }
+        else if (auto* ptr = std::get_if<Group>(parent.get())) {
+            ptr->child = kid;
+        }
         else if (auto* ptr = std::get_if<Alternation>(parent.get())) {
             ptr->children.emplace_back(kid);
         } else if(auto* ptr = std::get_if<Concat>(parent.get())){
@@ -116,9 +146,9 @@ public:
             throw std::logic_error("This node type cannot accept children");
         }
     }
-    inline NodePtr getRoot() const {
-        return root;
-    }
+    // A new pointer tree built from the arena on every call, null for an
+    // empty tree. Edits to it do not reach this tree.
+    NodePtr getRoot() const;
 };
 
 inline NodeType getType(const mgr::NodePtr& node) {
@@ -1,67 +1,222 @@
 #include "token.hpp"
 #include <limits>
 #include <stdexcept>
-#include <unordered_set>
 #include <charconv>
+#include <algorithm>
+#include <cctype>
+#include <span>
+#include <string_view>
 #include <system_error>
 
 namespace mgr {
 
-static void parseCurly(size_t &i, const std::string &str, std::list<TokenVariant> &Tokens) {
+static void parseCurly(size_t &i, const std::string &str, Tokenizer &tk) {
     size_t posStart = i + 1;
     size_t posEnd = str.find('}', i);
     if (posEnd == std::string::npos || posEnd <= posStart)
-        throw std::invalid_argument("Incorrect string: Curly Error");
+        throw ParseError("Incorrect string: Curly Error", i);
+    const size_t open = i;
     i = posEnd;
 
-    Tokens.emplace_back(TokenSimple{TokenType::LCurly});
+    // everything inside {} points at the brace
+    auto emit = [&](TokenVariant tok) {
+        tk.Tokens.push_back(tok);
+        tk.Offsets.push_back(open);
+    };
+    emit(TokenSimple{TokenType::LCurly});
 
     const char* start = str.data() + posStart;
     const char* end = str.data() + posEnd;
 
     if (*start == ',') {
         // {,y}
-        Tokens.emplace_back(TokenSimple{TokenType::Comma});
+        emit(TokenSimple{TokenType::Comma});
         int y;
         auto [ptr2, err2] = std::from_chars(start + 1, end, y);
         if (err2 != std::errc())
-            throw std::invalid_argument("Invalid {,y} bounds");
-        Tokens.emplace_back(TokenNumber{TokenType::Number, y});
+            throw ParseError("Invalid {,y} bounds", open);
+        emit(TokenNumber{TokenType::Number, y});
     } else {
         // {x} or {x,} or {x,y}
         int x;
         auto [ptr, err] = std::from_chars(start, end, x);
         if (err != std::errc())
-            throw std::invalid_argument("Invalid {x} or {x,y} bounds");
+            throw ParseError("Invalid {x} or {x,y} bounds", open);
 
-        Tokens.emplace_back(TokenNumber{TokenType::Number, x});
+        emit(TokenNumber{TokenType::Number, x});
 
         if (*ptr == ',') {
-            Tokens.emplace_back(TokenSimple{TokenType::Comma});
+            emit(TokenSimple{TokenType::Comma});
             int y;
             auto [ptr2, err2] = std::from_chars(ptr + 1, end, y);
             if (err2 != std::errc()) {
-                Tokens.emplace_back(TokenNumber{TokenType::Number, std::numeric_limits<int>::max()});  // {x,}
+                emit(TokenNumber{TokenType::Number, std::numeric_limits<int>::max()});  // {x,}
             } else {
-                Tokens.emplace_back(TokenNumber{TokenType::Number, y});  // {x,y}
+                emit(TokenNumber{TokenType::Number, y});  // {x,y}
             }
         }
     }
 
-    Tokens.emplace_back(TokenSimple{TokenType::RCurly});
+    emit(TokenSimple{TokenType::RCurly});
 }
 
-std::list<TokenVariant>& Tokenizer::Tokenize(const std::string& str) {
-    std::unordered_set<std::string> groups;
+// (<name>: name is [A-Za-z_][A-Za-z0-9_]*, the token points at the '<'
+static void parseGroupName(size_t &i, const std::string &str, Tokenizer &tk) {
+    const size_t open = i + 1;
+    size_t close = open + 1;
+    while (close < str.size() && (std::isalnum(static_cast<unsigned char>(str[close])) || str[close] == '_'))
+        ++close;
+    if (close >= str.size() || str[close] != '>' || close == open + 1 ||
+        std::isdigit(static_cast<unsigned char>(str[open + 1])))
+        throw ParseError("Invalid group name", open);
+    tk.Offsets.push_back(i);   // the '(' before it
+    tk.Tokens.push_back(TokenName{TokenType::GroupCreate, str.substr(open + 1, close - open - 1)});
+    tk.Offsets.push_back(open);
+    i = close;
+}
+
+namespace {
+
+constexpr ClassRange DIGIT[] = {{'0', '9'}};
+constexpr ClassRange WORD[] = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+constexpr ClassRange SPACE[] = {{'\t', '\r'}, {' ', ' '}};
+
+// ASCII ranges of \d \w \s, empty for other letters
+std::span<const ClassRange> shorthand(char c) {
+    switch (c) {
+        case 'd': return DIGIT;
+        case 'w': return WORD;
+        case 's': return SPACE;
+        default: return {};
+    }
+}
+
+struct Named {
+    std::string_view name;
+    std::vector<ClassRange> ranges;
+};
+
+const Named POSIX[] = {
+    {"alpha", {{'A', 'Z'}, {'a', 'z'}}},
+    {"digit", {{'0', '9'}}},
+    {"alnum", {{'0', '9'}, {'A', 'Z'}, {'a', 'z'}}},
+    {"upper", {{'A', 'Z'}}},
+    {"lower", {{'a', 'z'}}},
+    {"space", {{'\t', '\r'}, {' ', ' '}}},
+    {"xdigit", {{'0', '9'}, {'A', 'F'}, {'a', 'f'}}},
+    {"punct", {{'!', '/'}, {':', '@'}, {'[', '`'}, {'{', '~'}}},
+    {"word", {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}}},
+};
+
+void normalize(std::vector<ClassRange>& ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    size_t n = 0;
+    for (const ClassRange& r : ranges) {
+        if (n && r.first <= ranges[n - 1].second + 1)
+            ranges[n - 1].second = std::max(ranges[n - 1].second, r.second);
+        else
+            ranges[n++] = r;
+    }
+    ranges.resize(n);
+}
+
+}
+
+// [...]: '\' escapes ] \ - ^ and gives \d \w \s; [:name:] is a POSIX
+// class. A valid UTF-8 character is one code point, any other byte
+// >= 0x80 a raw byte. The token points at the '['.
+static void parseClass(size_t &i, const std::string &str, Tokenizer &tk) {
+    const size_t open = i++;
+    TokenClass cls{TokenType::Class, false, {}};
+    if (i < str.size() && str[i] == '^') {
+        cls.negated = true;
+        ++i;
+    }
+    // next item, SET for a predefined set already added
+    constexpr char32_t SET = UINT32_MAX;
+    auto item = [&]() -> char32_t {
+        const size_t at = i;
+        if (str[i] == '\\') {
+            if (++i >= str.size())
+                throw ParseError("Unterminated class", open);
+            const char c = str[i++];
+            if (auto set = shorthand(c); !set.empty()) {
+                cls.ranges.insert(cls.ranges.end(), set.begin(), set.end());
+                return SET;
+            }
+            if (std::isalnum(static_cast<unsigned char>(c)))
+                throw ParseError("Unknown class escape", at);
+            return static_cast<unsigned char>(c);
+        }
+        if (str.compare(i, 2, "[:") == 0) {
+            const size_t close = str.find(":]", i + 2);
+            if (close != std::string::npos) {
+                std::string_view name(str.data() + i + 2, close - i - 2);
+                for (const Named& n : POSIX) {
+                    if (n.name != name) continue;
+                    cls.ranges.insert(cls.ranges.end(), n.ranges.begin(), n.ranges.end());
+                    i = close + 2;
+                    return SET;
+                }
+                throw ParseError("Unknown class name", at);
+            }
+        }
+        const size_t n = utf8Length(std::string_view(str).substr(i));
+        if (n > 1) {
+            i += n;
+            return utf8Decode(std::string_view(str).substr(at), n);
+        }
+        const auto b = static_cast<unsigned char>(str[i++]);
+        return b < 0x80 ? b : RAW_BYTE + b;
+    };
+
+    while (true) {
+        if (i >= str.size())
+            throw ParseError("Unterminated class", open);
+        if (str[i] == ']') break;
+        const size_t at = i;
+        const char32_t from = item();
+        if (from == SET) continue;
+        char32_t to = from;
+        if (i + 1 < str.size() && str[i] == '-' && str[i + 1] != ']') {
+            ++i;
+            to = item();
+            // ranges stay within code points or within raw bytes
+            if (to == SET || to < from || (from < RAW_BYTE) != (to < RAW_BYTE))
+                throw ParseError("Invalid class range", at);
+        }
+        cls.ranges.emplace_back(from, to);
+    }
+    if (cls.ranges.empty())
+        throw ParseError("Empty class", open);
+    normalize(cls.ranges);
+    tk.Tokens.push_back(std::move(cls));
+    tk.Offsets.push_back(open);
+}
+
+std::vector<TokenVariant>& Tokenizer::Tokenize(const std::string& str) {
     Tokens.clear();
-    bool isOpenParen = false;
+    Offsets.clear();
     for (size_t i = 0; i < str.size(); i++) {
+        const size_t at = i;
         switch (str[i]) {
-            case '&':
+            case '&': {
                 if (i + 1 >= str.size())
-                    throw std::invalid_argument("Dangling escape '&' at end");
+                    throw ParseError("Dangling escape '&' at end", i);
+                // &d &w &s, upper case for the negation
+                const auto c = static_cast<unsigned char>(str[i + 1]);
+                if (auto set = shorthand(static_cast<char>(std::tolower(c))); !set.empty()) {
+                    Tokens.emplace_back(TokenClass{TokenType::Class, std::isupper(c) != 0,
+                                                   std::vector<ClassRange>(set.begin(), set.end())});
+                    ++i;
+                    break;
+                }
                 Tokens.emplace_back(TokenSymbol{TokenType::Escape, str[++i]});
                 break;
+            }
+            case '[':
+                parseClass(i, str, *this);
+                break;
             case '|':
                 Tokens.emplace_back(TokenSimple{TokenType::Pipe});
                 break;
@@ -79,14 +234,16 @@ std::list<TokenVariant>& Tokenizer::Tokenize(const std::string& str) {
                 break;
             case '$':
                 if(i < str.size() - 1)
-                    throw std::invalid_argument("Incorrect string: found $(EOL) before end");
+                    throw ParseError("Incorrect string: found $(EOL) before end", i);
                 Tokens.emplace_back(TokenSimple{TokenType::End});
                 break;
             case '{':
-                parseCurly(i, str, Tokens);
+                parseCurly(i, str, *this);
                 break;
             case '(':
                 Tokens.emplace_back(TokenSimple{TokenType::LParen});
+                if (i + 1 < str.size() && str[i + 1] == '<')
+                    parseGroupName(i, str, *this);
                 break;
             case ')':
                 Tokens.emplace_back(TokenSimple{TokenType::RParen});
@@ -95,6 +252,8 @@ std::list<TokenVariant>& Tokenizer::Tokenize(const std::string& str) {
                 Tokens.emplace_back(TokenSymbol{TokenType::Literal, str[i]});
                 break;
         }
+        while (Offsets.size() < Tokens.size())
+            Offsets.push_back(at);
     }
     return Tokens;
 }
@@ -2,8 +2,10 @@
 #define Token_HPP_
 
 #include <variant>
-#include <list>
+#include <vector>
 #include <string>
+#include <stdexcept>
+#include "Utf8.hpp"
 
 namespace mgr {
 
@@ -25,8 +27,10 @@ enum class TokenType {
     Comma,
     Number,
 
-    // GroupCreate,
-    // GroupRef,
+    Class,         // [...] or one of &d &w &s &D &W &S
+
+    GroupCreate,   // the <name> right after '(' of a capture group
+    // GroupRef,   backreferences are not regular, no DFA can match them
     End
 };
 
@@ -50,7 +54,25 @@ struct TokenName {
     std::string name;
 };
 
-using TokenVariant = std::variant<TokenSimple, TokenSymbol, TokenNumber, TokenName>;
+// ranges sorted and merged, raw bytes last (see ClassRange)
+struct TokenClass {
+    TokenType type;
+    bool negated;
+    std::vector<ClassRange> ranges;
+};
+
+using TokenVariant = std::variant<TokenSimple, TokenSymbol, TokenNumber, TokenName, TokenClass>;
+
+// Syntax error in a pattern; offset is the byte position it was found at.
+class ParseError : public std::invalid_argument {
+public:
+    ParseError(const std::string& what, size_t offset)
+        : std::invalid_argument(what + " at offset " + std::to_string(offset)), pos(offset) {}
+    inline size_t offset() const { return pos; }
+
+private:
+    size_t pos;
+};
 
 class regex;
 
@@ -60,8 +82,11 @@ class Tokenizer {
 public:
     Tokenizer() = default;
 
-    std::list<TokenVariant> Tokens;
-    std::list<TokenVariant>& Tokenize(const std::string& str);
+    // Both buffers keep their capacity between calls. Offsets[i] is where
+    // Tokens[i] starts in the pattern.
+    std::vector<TokenVariant> Tokens;
+    std::vector<size_t> Offsets;
+    std::vector<TokenVariant>& Tokenize(const std::string& str);
 };
 
 } // namespace mgr
@@ -0,0 +1,44 @@
+#include "regex_set.hpp"
+
+namespace mgr {
+
+    RegexSet::RegexSet(const std::vector<string>& list) {
+        for (const auto& p : list)
+            add(p);
+    }
+
+    size_t RegexSet::add(const string& pattern) {
+        regex r(pattern);
+        r.parse();
+        patterns.push_back(std::move(r));
+        return patterns.size() - 1;
+    }
+
+    void RegexSet::compile(const CompileOptions& opts) {
+        if (patterns.empty())
+            throw std::logic_error("RegexSet is empty");
+        std::vector<const RegexTree*> trees;
+        for (const auto& r : patterns)
+            trees.push_back(&r.tr);
+        automaton = DKA::fromNFA(NFA::fromTrees(trees, opts.unroll_limit, opts.encoding));
+        automaton.minimize(opts.minimize);
+        // a literal required by one pattern says nothing about the others
+        table = CompiledDKA(automaton);
+    }
+
+    std::vector<uint32_t> RegexSet::matches(std::string_view str) const {
+        if (table.empty()) return {};
+        CompiledDKA::StateId s = table.start();
+        for (unsigned char ch : str) {
+            s = table.step(s, ch);
+            if (table.is_dead(s)) return {};
+        }
+        auto ids = table.patterns(s);
+        return std::vector<uint32_t>(ids.begin(), ids.end());
+    }
+
+    bool RegexSet::isMatch(std::string_view str) const {
+        return table.match(str);
+    }
+
+}
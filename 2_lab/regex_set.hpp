@@ -0,0 +1,40 @@
+#ifndef REGEX_SET_HPP_
+#define REGEX_SET_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "my_regex.hpp"
+
+namespace mgr {
+
+// Many patterns compiled into one DFA. Accepting states carry the ids of
+// the patterns they accept, so one pass over the input tells which of
+// them match. Ids are assigned by add() in order, starting at 0.
+class RegexSet {
+public:
+    RegexSet() = default;
+    explicit RegexSet(const std::vector<string>& list);
+
+    // Parses the pattern right away, so syntax errors surface here.
+    size_t add(const string& pattern);
+    void compile(const CompileOptions& opts = {});
+
+    // Ids of the patterns matching the whole string, sorted.
+    std::vector<uint32_t> matches(std::string_view str) const;
+    bool isMatch(std::string_view str) const;
+
+    inline size_t size() const { return patterns.size(); }
+    inline const string& pattern(size_t id) const { return patterns[id].pattern(); }
+    inline const DKA& dka() const { return automaton; }
+    inline const CompiledDKA& compiled() const { return table; }
+
+private:
+    std::vector<regex> patterns;
+    DKA automaton;
+    CompiledDKA table;
+};
+
+} // namespace mgr
+
+#endif
@@ -0,0 +1,70 @@
+#include "regex_shared.hpp"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace mgr {
+
+    size_t MatchBits::count() const {
+        size_t res = 0;
+        for (uint64_t w : words) res += static_cast<size_t>(std::popcount(w));
+        return res;
+    }
+
+    std::shared_ptr<const SharedRegex> SharedRegex::compile(const string& pattern, const CompileOptions& opts) {
+        regex r(pattern);
+        r.compile(opts);
+        return std::make_shared<const SharedRegex>(r);
+    }
+
+    SharedRegex::SharedRegex(const regex& r)
+        : prompt(r.pattern()), compiled(r.compiled), tags(r.captureAutomaton()), names(r.groupNames()) {
+        if (compiled.empty())
+            throw std::logic_error("SharedRegex: the regex is not compiled");
+    }
+
+    MatchBits SharedRegex::matchAll(std::span<const std::string_view> inputs, ThreadPool& pool) const {
+        static_assert(BATCH_GRAIN % 64 == 0, "slices have to own whole words");
+        MatchBits res(inputs.size());
+        pool.parallelFor(inputs.size(), BATCH_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t w = begin / 64; w * 64 < end; ++w) {
+                uint64_t bits = 0;
+                for (size_t i = w * 64; i < std::min(end, w * 64 + 64); ++i)
+                    bits |= uint64_t(compiled.match(inputs[i])) << (i % 64);
+                res.words[w] = bits;
+            }
+        });
+        return res;
+    }
+
+    RegexMatcher::RegexMatcher(std::shared_ptr<const SharedRegex> re)
+        : re(std::move(re)), groups(2 * (this->re->groupNames().size() + 1), TaggedDKA::NPOS) {}
+
+    std::optional<Match> RegexMatcher::find(std::string_view text, size_t from) {
+        const CompiledDKA& dka = re->automaton();
+        if (!dka.scansBackwards()) return dka.find(text, from);
+        if (!starts || indexed.data() != text.data() || indexed.size() != text.size() || from < last_from) {
+            starts.emplace(dka, text);
+            indexed = text;
+        }
+        last_from = from;
+        return dka.find(text, from, *starts);
+    }
+
+    std::span<const size_t> RegexMatcher::capture(std::string_view text, size_t from) {
+        auto m = find(text, from);
+        if (!m) return {};
+        std::fill(groups.begin(), groups.end(), TaggedDKA::NPOS);
+        const TaggedDKA* tags = re->tagged();
+        if (!re->groupNames().empty() && !tags)
+            throw std::runtime_error("RegexMatcher: captures unsupported for this pattern");
+        if (!tags) {
+            groups[0] = m->begin;
+            groups[1] = m->end;
+        } else if (!tags->extract(text, m->begin, m->end, groups, ws)) {
+            throw std::logic_error("RegexMatcher: match without a parse");
+        }
+        return groups;
+    }
+
+}
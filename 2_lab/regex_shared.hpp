@@ -0,0 +1,100 @@
+#ifndef REGEX_SHARED_HPP_
+#define REGEX_SHARED_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "my_regex.hpp"
+#include "regex_compile/ThreadPool.hpp"
+
+namespace mgr {
+
+// One bit per input of a batch, bit i set when input i matched.
+class MatchBits {
+public:
+    explicit MatchBits(size_t n = 0) : n(n), words((n + 63) / 64, 0) {}
+
+    inline bool operator[](size_t i) const { return words[i / 64] >> (i % 64) & 1; }
+    inline size_t size() const { return n; }
+    size_t count() const;
+    inline std::span<const uint64_t> data() const { return words; }
+
+private:
+    friend class SharedRegex;
+    size_t n;
+    std::vector<uint64_t> words;
+};
+
+// The immutable part of a compiled regex: the automaton, the tagged
+// automaton for captures and the group names. Nothing in it changes after
+// construction but the lazy parts, which are built once behind a flag, so
+// one instance, held through shared_ptr, serves any number of threads;
+// the per-thread scratch space lives in RegexMatcher.
+class SharedRegex {
+public:
+    // Parses and compiles; syntax errors throw ParseError.
+    static std::shared_ptr<const SharedRegex> compile(const string& pattern, const CompileOptions& opts = {});
+    // Takes the compiled parts of r, which must have gone through compile().
+    explicit SharedRegex(const regex& r);
+
+    inline const string& pattern() const { return prompt; }
+    inline const CompiledDKA& automaton() const { return compiled; }
+    // null without groups or when captures are unsupported, see regex::tagged
+    inline const TaggedDKA* tagged() const { return tags ? tags->get() : nullptr; }
+    inline const std::vector<string>& groupNames() const { return names; }
+
+    inline bool match(std::string_view str) const { return compiled.match(str); }
+
+    // Whole-input match of every string, spread over the pool in slices
+    // of BATCH_GRAIN inputs; a slice covers whole words of the result, so
+    // the threads never write the same word.
+    static constexpr size_t BATCH_GRAIN = 1024;
+    MatchBits matchAll(std::span<const std::string_view> inputs,
+                       ThreadPool& pool = ThreadPool::global()) const;
+
+private:
+    string prompt;
+    CompiledDKA compiled;
+    std::shared_ptr<const CaptureAutomaton> tags;
+    std::vector<string> names;
+};
+
+// Per-thread handle on a SharedRegex: keeps the buffers captures need so
+// repeated calls do not allocate, and the StartIndex of the last text, so
+// a loop of find or capture with growing from over one text is linear.
+// The index is kept while the text has the same data and size and from
+// does not go back; a text changed in place needs forget(). Cheap to
+// create; not to be shared between threads.
+class RegexMatcher {
+public:
+    explicit RegexMatcher(std::shared_ptr<const SharedRegex> re);
+
+    inline bool match(std::string_view str) const { return re->match(str); }
+    std::optional<Match> find(std::string_view text, size_t from = 0);
+
+    // Groups of the leftmost-longest match at or after from, laid out as
+    // in regex::forEachCapture; empty when there is none. The span stays
+    // valid until the next call. Throws as regex::forEachCapture does.
+    std::span<const size_t> capture(std::string_view text, size_t from = 0);
+
+    // Drops the StartIndex of the last text.
+    inline void forget() { starts.reset(); }
+
+    inline const SharedRegex& shared() const { return *re; }
+
+private:
+    std::shared_ptr<const SharedRegex> re;
+    std::vector<size_t> groups;
+    TaggedDKA::Workspace ws;
+    std::optional<StartIndex> starts;
+    std::string_view indexed;     // the text starts was built for
+    size_t last_from = 0;
+};
+
+} // namespace mgr
+
+#endif
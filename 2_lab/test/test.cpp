@@ -1,5 +1,16 @@
 #include <gtest/gtest.h>
 #include "../my_regex.hpp"
+#include "../regex_cache.hpp"
+#include "../regex_set.hpp"
+#include "../regex_shared.hpp"
+#include "../regex_compile/CodeGen.hpp"
+#include "../regex_compile/ct_regex.hpp"
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
 using namespace mgr;
 
 TEST(RegexTreeTest, LiteralAndEnd) {
@@ -488,16 +499,1491 @@ TEST(DKA_Interface, ToRegexReturnsNonEmpty)
 
 TEST(DKA_Interface, MinimizeReducesStates)
 {
-    regex r("(a|a|a)(b|b)$");
+    // subset construction already merges (a|a|a)(b|b); the two b-states
+    // reached through different first bytes are only merged by minimize
+    regex r("(ab|cb)$");
     r.compile();
 
     size_t after = r.dka.states.size();
 
-    regex r_raw("(a|a|a)(b|b)$");
-    r_raw.tk.Tokenize("(a|a|a)(b|b)$");
+    regex r_raw("(ab|cb)$");
+    r_raw.tk.Tokenize("(ab|cb)$");
     r_raw.TokenToTree();
     r_raw.dka.TreeToDKA(r_raw.tr);
     size_t before = r_raw.dka.states.size();
 
     ASSERT_GT(before, after);
-}
\ No newline at end of file
+}
+TEST(CompiledDKA, AgreesWithListWalk)
+{
+    const std::initializer_list<std::string> inputs = {
+        "", "a", "ab", "abc", "abab", "Mp", "MMeepp", "hhi", "i", "h t", "xyz"};
+    for (const char* p : {"abc$", "(ab){2,}$", "h.t$", "(M+(e+)?p+|(h+)?i)$", "a*$"}) {
+        regex r(p);  r.compile();
+        for (auto& s : inputs)
+            EXPECT_EQ(r.compiled.match(s), r.dka.match(s)) << p << " on " << s;
+    }
+}
+
+TEST(CompiledDKA, ExplicitDeadState)
+{
+    regex r("ab$");  r.compile();
+    const CompiledDKA& c = r.compiled;
+
+    ASSERT_EQ(c.stateCount(), r.dka.states.size() + 1);
+    auto s = c.step(c.start(), 'z');
+    EXPECT_TRUE(c.is_dead(s));
+    EXPECT_TRUE(c.is_dead(c.step(s, 'a')));
+    EXPECT_TRUE(c.is_final(c.step(c.step(c.start(), 'a'), 'b')));
+}
+
+TEST(CompiledDKA, DefaultConstructedRejects)
+{
+    CompiledDKA c;
+    EXPECT_TRUE(c.empty());
+    EXPECT_FALSE(c.match(""));
+}
+
+TEST(ByteClasses, SplitRefinesToCoarsestPartition)
+{
+    ByteClasses c;
+    EXPECT_EQ(c.count(), 1u);
+
+    c.split(' ', '~');
+    c.split('h', 'h');
+    c.split('t', 't');
+    c.split('h', 'h');
+    ASSERT_EQ(c.count(), 4u);
+
+    EXPECT_EQ(c['a'], c['z']);
+    EXPECT_EQ(c[' '], c['~']);
+    EXPECT_NE(c['h'], c['t']);
+    EXPECT_NE(c['h'], c['a']);
+    EXPECT_EQ(c['\n'], c[0xff]);
+    EXPECT_NE(c['\n'], c['a']);
+
+    auto runs = c.runs(c['a']);
+    ASSERT_EQ(runs.size(), 3u);
+    EXPECT_EQ(runs[0], ByteClasses::Range(' ', 'g'));
+}
+
+TEST(ByteClasses, CompiledTableIsNarrow)
+{
+    regex r("h.t$");  r.compile();
+    EXPECT_EQ(r.dka.byteClasses().count(), 4u);
+    EXPECT_EQ(r.compiled.stride(), 4u);
+    EXPECT_EQ(r.compiled.classOf('a'), r.compiled.classOf('o'));
+    expect_matches(r, {"hat", "h t", "hht", "htt"}, {"ht", "h\tt", "hatt"});
+}
+
+TEST(ByteClasses, CompleteUsesRanges)
+{
+    regex r("a.c$");  r.compile();
+    DKA d = r.dka;
+    d.complete();
+    const auto& sink = d.states.back();
+    EXPECT_EQ(std::distance(sink.transitions.begin(), sink.transitions.end()), 1);
+    for (const auto& st : d.states)
+        EXPECT_LE(std::distance(st.transitions.begin(), st.transitions.end()), 6);
+    EXPECT_TRUE(d.match("abc"));
+    EXPECT_FALSE(d.match("abd"));
+}
+
+using Spans = std::vector<std::pair<size_t, size_t>>;
+
+TEST(FindAll, LeftmostLongestNonOverlapping)
+{
+    regex r("ab+$");  r.compile();
+    EXPECT_EQ(r.findAll("xxabbb ab a abab"),
+              (Spans{{2, 6}, {7, 9}, {12, 14}, {14, 16}}));
+    EXPECT_TRUE(r.findAll("nothing here").empty());
+    EXPECT_TRUE(r.findAll("").empty());
+}
+
+TEST(FindAll, PrefersLeftmostOverShorterLater)
+{
+    regex r("(abcd|c)$");  r.compile();
+    EXPECT_EQ(r.findAll("abcd c"), (Spans{{0, 4}, {5, 6}}));
+}
+
+TEST(FindAll, EmptyMatchesAdvance)
+{
+    regex r("a*$");  r.compile();
+    EXPECT_EQ(r.findAll("aab"), (Spans{{0, 2}, {2, 2}, {3, 3}}));
+}
+
+TEST(FindAll, IteratorCallbackAndCounts)
+{
+    regex r("(ab|cd)$");  r.compile();
+    const std::string_view text = "ab cd xx abcd";
+    const CompiledDKA& c = r.compiled;
+
+    std::vector<Match> pulled;
+    for (const Match& m : c.matches(text))
+        pulled.push_back(m);
+    ASSERT_EQ(pulled.size(), 4u);
+    EXPECT_EQ(pulled[2], (Match{9, 11}));
+
+    EXPECT_EQ(c.count(text), 4u);
+
+    size_t seen = c.forEachMatch(text, [](const Match& m) { return m.begin < 3; });
+    EXPECT_EQ(seen, 2u);
+
+    auto first = c.find(text);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(*first, (Match{0, 2}));
+    EXPECT_EQ(c.find(text, 10), (std::optional<Match>{Match{11, 13}}));
+    EXPECT_FALSE(c.find("xyz").has_value());
+}
+
+static DKA rawDKA(const std::string& pattern)
+{
+    regex r(pattern);
+    r.tk.Tokenize(pattern);
+    r.TokenToTree();
+    r.dka.TreeToDKA(r.tr);
+    return r.dka;
+}
+
+static void forEachWord(const std::string& alphabet, size_t max_len,
+                        const std::function<void(const std::string&)>& f)
+{
+    std::vector<std::string> layer{""};
+    f("");
+    for (size_t len = 1; len <= max_len; ++len) {
+        std::vector<std::string> next;
+        for (auto& w : layer)
+            for (char c : alphabet) {
+                next.push_back(w + c);
+                f(next.back());
+            }
+        layer = std::move(next);
+    }
+}
+
+TEST(Minimize, HopcroftAgreesWithMoore)
+{
+    for (const char* p : {"(a|a|a)(b|b)$", "(ab){2,}$", "a(b|c)*c$", "(a|b)*abb$",
+                          "((a|b)c(a|b))*$", "a{2,4}b?$", "x.x$", "(c|b+)a*$"}) {
+        DKA h = rawDKA(p);
+        DKA m = rawDKA(p);
+        DKA raw = rawDKA(p);
+        h.minimize(MinimizeAlgo::Hopcroft);
+        m.minimize(MinimizeAlgo::Moore);
+
+        EXPECT_EQ(h.states.size(), m.states.size()) << p;
+        forEachWord("abcx", 6, [&](const std::string& w) {
+            EXPECT_EQ(h.match(w), raw.match(w)) << p << " on " << w;
+            EXPECT_EQ(m.match(w), raw.match(w)) << p << " on " << w;
+        });
+    }
+}
+
+TEST(Minimize, HopcroftOutputIsDeterministic)
+{
+    DKA d = rawDKA("(a|a|a)(b|b)$");
+    d.minimize();
+    ASSERT_EQ(d.states.size(), 3u);
+    EXPECT_EQ(d.start_state, 0u);
+    for (const auto& st : d.states) {
+        std::vector<std::pair<unsigned char, unsigned char>> ranges;
+        for (const auto& tr : st.transitions)
+            ranges.emplace_back(tr.from, tr.to);
+        std::sort(ranges.begin(), ranges.end());
+        for (size_t i = 1; i < ranges.size(); ++i)
+            EXPECT_LT(ranges[i - 1].second, ranges[i].first);
+    }
+}
+
+TEST(Minimize, EmptyLanguage)
+{
+    DKA d;
+    d.addState();
+    d.addState(true);
+    d.addTransition(1, 'a', 'a', 0);
+    d.minimize();
+    ASSERT_EQ(d.states.size(), 1u);
+    EXPECT_FALSE(d.states[0].is_final);
+    EXPECT_TRUE(d.states[0].transitions.empty());
+}
+
+TEST(NFA, SharedFirstByteAlternation)
+{
+    regex r1("(ab|ac)$");  r1.compile();
+    expect_matches(r1, {"ab", "ac"}, {"a", "aa", "abc"});
+
+    regex r2("(c|(ab)*)d$");  r2.compile();
+    expect_matches(r2, {"cd", "d", "abd", "ababd"}, {"abcd", "cabd", "ab"});
+
+    regex r3("(a|ab)(c|bcd)$");  r3.compile();
+    expect_matches(r3, {"ac", "abcd", "abc", "abbcd"}, {"ab", "abd", "abbc"});
+}
+
+TEST(NFA, TreeToDKAIsDeterministic)
+{
+    DKA d = rawDKA("(abc|abd|a.e)*$");
+    for (const auto& st : d.states) {
+        std::vector<std::pair<unsigned char, unsigned char>> ranges;
+        for (const auto& tr : st.transitions)
+            ranges.emplace_back(tr.from, tr.to);
+        std::sort(ranges.begin(), ranges.end());
+        for (size_t i = 1; i < ranges.size(); ++i)
+            EXPECT_LT(ranges[i - 1].second, ranges[i].first);
+    }
+}
+
+static LazyDKA lazyFor(const std::string& pattern, size_t max_states = LazyDKA::DEFAULT_MAX_STATES)
+{
+    regex r(pattern);
+    r.tk.Tokenize(pattern + "$");
+    r.TokenToTree();
+    return LazyDKA(std::make_shared<const NFA>(NFA::fromTree(r.tr)), max_states);
+}
+
+TEST(LazyDKA, AgreesWithEagerAutomaton)
+{
+    for (const char* p : {"(ab|ac)", "(a|b)*abb", "a{2,4}b?", "(c|(ab)*)d", "x.x", "(M+(e+)?p+|(h+)?i)"}) {
+        regex r(p);  r.compile();
+        LazyDKA lazy = lazyFor(p);
+        forEachWord("abcdx", 5, [&](const std::string& w) {
+            EXPECT_EQ(lazy.match(w), r.match(w)) << p << " on " << w;
+        });
+    }
+}
+
+TEST(LazyDKA, CreatesStatesOnDemand)
+{
+    LazyDKA lazy = lazyFor("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)");
+    EXPECT_EQ(lazy.cachedStates(), 0u);
+    EXPECT_TRUE(lazy.match("aaaaaaa"));
+    EXPECT_LE(lazy.cachedStates(), 8u);
+}
+
+TEST(LazyDKA, BoundedCacheStillMatches)
+{
+    // the full DFA for this pattern has 2^9 states
+    LazyDKA lazy = lazyFor("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)", 16);
+    std::string s;
+    for (int i = 0; i < 600; ++i)
+        s.push_back((i * 7 + i / 3) % 5 < 2 ? 'a' : 'b');
+    bool expected = s[s.size() - 9] == 'a';
+    EXPECT_EQ(lazy.match(s), expected);
+    EXPECT_TRUE(lazy.match(s + "abbbbbbbb"));
+    EXPECT_FALSE(lazy.match(s + "bbbbbbbbb"));
+    EXPECT_LE(lazy.cachedStates(), 16u);
+    EXPECT_GT(lazy.flushes(), 0u);
+}
+
+static RequiredLiteral literalFor(const std::string& pattern)
+{
+    regex r(pattern);
+    r.tk.Tokenize(pattern + "$");
+    r.TokenToTree();
+    return requiredLiteral(r.tr);
+}
+
+TEST(Prefilter, RequiredLiteral)
+{
+    EXPECT_EQ(literalFor("ed2k://.*").text, "ed2k://");
+    EXPECT_EQ(literalFor("ed2k://.*").max_offset, 0u);
+    EXPECT_EQ(literalFor(".*error.*").text, "error");
+    EXPECT_EQ(literalFor(".*error.*").max_offset, std::string::npos);
+    EXPECT_EQ(literalFor("..error").max_offset, 2u);
+    EXPECT_EQ(literalFor("(abc|abd)").text, "ab");
+    EXPECT_EQ(literalFor("(xabc|yzabc)").text, "abc");
+    EXPECT_EQ(literalFor("a{3}").text, "aaa");
+    EXPECT_EQ(literalFor("x+yz").text, "xyz");
+    EXPECT_TRUE(literalFor("x*").text.empty());
+    EXPECT_TRUE(literalFor("(a|b)c?").text.empty());
+}
+
+TEST(Prefilter, FindLiteralAgreesWithStringFind)
+{
+    std::string hay;
+    for (int i = 0; i < 2000; ++i)
+        hay.push_back("abcab"[(i * 31 + i / 7) % 5]);
+    for (const char* needle : {"a", "ab", "cab", "abcabc", "bcabcab", "zz", "abcabcabcabcabcabcabcabcabcabcabcabc"})
+        for (size_t from : {0u, 1u, 17u, 31u, 33u, 1990u, 2000u, 2005u})
+            EXPECT_EQ(findLiteral(hay, needle, from), std::string_view(hay).find(needle, from))
+                << needle << " from " << from;
+    // match straddling the end of a 32 byte block
+    std::string tail(63, 'x');
+    tail += "needle";
+    EXPECT_EQ(findLiteral(tail, "needle"), 63u);
+}
+
+TEST(Prefilter, SearchResultsUnchanged)
+{
+    std::string text;
+    for (int i = 0; i < 500; ++i)
+        text += (i % 7 == 0) ? "ed2k://x " : (i % 11 == 0 ? "error " : "abd ");
+    for (const char* p : {"ed2k://.", ".error", "(abc|abd)", "a{3}", "x+", "b.d", "..error"}) {
+        regex r(p);  r.compile();
+        ASSERT_TRUE(r.compiled.prefilter().active()) << p;
+        CompiledDKA plain(r.dka);
+        std::vector<Match> expected(plain.matches(text).begin(), plain.matches(text).end());
+        std::vector<Match> actual(r.compiled.matches(text).begin(), r.compiled.matches(text).end());
+        EXPECT_EQ(actual, expected) << p;
+    }
+}
+
+TEST(RegexCache, HitsMissesAndSharing)
+{
+    RegexCache cache(8);
+    auto a = cache.get("(ab|ac)");
+    auto b = cache.get("(ab|ac)$");
+    EXPECT_EQ(a, b);
+    EXPECT_TRUE(a->match("ac"));
+    auto c = cache.get("(ab|ac)", CompileOptions{ MinimizeAlgo::Moore });
+    EXPECT_NE(a, c);
+    RegexCache::Stats st = cache.stats();
+    EXPECT_EQ(st.hits, 1u);
+    EXPECT_EQ(st.misses, 2u);
+    EXPECT_EQ(st.evictions, 0u);
+
+    regex r("(ab|ac)");
+    r.compile(cache);
+    EXPECT_TRUE(r.match("ab"));
+    EXPECT_FALSE(r.match("ad"));
+    EXPECT_EQ(cache.stats().hits, 2u);
+}
+
+TEST(RegexCache, EvictsLeastRecentlyUsed)
+{
+    RegexCache cache(2);
+    auto x = cache.get("x");
+    cache.get("y");
+    cache.get("x");      // y is now the oldest
+    cache.get("z");
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.stats().evictions, 1u);
+    cache.get("x");
+    EXPECT_EQ(cache.stats().misses, 3u);
+    cache.get("y");
+    EXPECT_EQ(cache.stats().misses, 4u);
+    // evicted automata stay usable
+    cache.clear();
+    EXPECT_TRUE(x->match("x"));
+}
+
+TEST(RegexCache, BadPatternIsNotCached)
+{
+    RegexCache cache;
+    EXPECT_THROW(cache.get("(ab"), std::logic_error);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(RegexCache, ConcurrentLookups)
+{
+    RegexCache cache(4);
+    const char* patterns[] = {"(ab|ac)", "a+b", "x.x", "(c|(ab)*)d", "a{2,4}", "q?r"};
+    std::vector<std::thread> pool;
+    std::atomic<int> wrong{0};
+    for (int t = 0; t < 4; ++t)
+        pool.emplace_back([&, t] {
+            for (int i = 0; i < 200; ++i) {
+                size_t k = (i + t) % 6;
+                auto dka = cache.get(patterns[k]);
+                // "aab" is matched by a+b only
+                if (dka->match("aab") != (k == 1))
+                    ++wrong;
+            }
+        });
+    for (auto& th : pool) th.join();
+    EXPECT_EQ(wrong.load(), 0);
+    RegexCache::Stats st = cache.stats();
+    EXPECT_EQ(st.hits + st.misses, 800u);
+    EXPECT_LE(cache.size(), 4u);
+}
+
+TEST(Serialize, RoundTripThroughFile)
+{
+    const std::string path = ::testing::TempDir() + "roundtrip.dka";
+    for (const char* p : {"(ab|ac)", "(a|b)*abb", "ed2k://.*", "(c|(ab)*)d", "x*"}) {
+        regex r(p);  r.compile();
+        r.compiled.save(path);
+        CompiledDKA loaded = CompiledDKA::load(path);
+        EXPECT_EQ(loaded.stateCount(), r.compiled.stateCount()) << p;
+        EXPECT_EQ(loaded.prefilter().literal(), r.compiled.prefilter().literal()) << p;
+        forEachWord("abcdx", 5, [&](const std::string& w) {
+            EXPECT_EQ(loaded.match(w), r.compiled.match(w)) << p << " on " << w;
+        });
+        std::string text = "xxabbed2k://a cd abd";
+        EXPECT_EQ(loaded.count(text), r.compiled.count(text)) << p;
+    }
+    std::remove(path.c_str());
+}
+
+TEST(Serialize, ImageIsUsedInPlace)
+{
+    regex r("(a|b)*abb");  r.compile();
+    auto image = std::make_shared<std::string>(r.compiled.serialize());
+    CompiledDKA view = CompiledDKA::fromImage(image->data(), image->size(), image);
+    image.reset();   // the view keeps the buffer alive
+    EXPECT_TRUE(view.match("babb"));
+    EXPECT_FALSE(view.match("abab"));
+    EXPECT_EQ(r.compiled.serialize(), view.serialize());
+}
+
+TEST(Serialize, RejectsBadImages)
+{
+    regex r("ab");  r.compile();
+    std::string image = r.compiled.serialize();
+    EXPECT_THROW(CompiledDKA::fromImage(image.data(), 10), std::runtime_error);
+    EXPECT_THROW(CompiledDKA::fromImage(image.data(), image.size() - 1), std::runtime_error);
+    std::string wrong = image;
+    wrong[0] = 'X';
+    EXPECT_THROW(CompiledDKA::fromImage(wrong.data(), wrong.size()), std::runtime_error);
+    EXPECT_THROW(CompiledDKA::load("/nonexistent/file.dka"), std::runtime_error);
+
+    // damaged class map and cells, the header intact
+    const size_t classmap_at = 80;
+    uint64_t table_at;
+    std::memcpy(&table_at, image.data() + 48, sizeof table_at);
+    wrong = image;
+    wrong[classmap_at + 'a'] = static_cast<char>(r.compiled.stride());
+    EXPECT_THROW(CompiledDKA::fromImage(wrong.data(), wrong.size()), std::runtime_error);
+    for (uint32_t cell : {uint32_t(r.compiled.stride() * r.compiled.stateCount()), uint32_t(1)}) {
+        wrong = image;
+        std::memcpy(wrong.data() + table_at + 4 * r.compiled.stride(), &cell, sizeof cell);
+        EXPECT_THROW(CompiledDKA::fromImage(wrong.data(), wrong.size()), std::runtime_error) << cell;
+    }
+}
+
+TEST(Parallel, MatchAgreesWithSequential)
+{
+    std::string big;
+    for (size_t i = 0; big.size() < 8 * CompiledDKA::MIN_PARALLEL_CHUNK; ++i)
+        big.push_back("ab"[(i * 7 + i / 5) % 3 == 0]);
+    for (const char* p : {"(a|b)*abb", "(a|b)*a(a|b)(a|b)", "(ab|ba|aa|bb)*", "(a|b)*", "a.*b", "(ab)*"}) {
+        regex r(p);  r.compile();
+        for (const std::string& s : {big, big + "abb", big + "a", "b" + big + "ab"})
+            for (size_t threads : {2u, 3u, 8u})
+                EXPECT_EQ(r.compiled.matchParallel(s, threads), r.compiled.match(s))
+                    << p << " threads " << threads << " len " << s.size();
+    }
+}
+
+TEST(Parallel, FindAgreesWithSequential)
+{
+    std::string big(6 * CompiledDKA::MIN_PARALLEL_CHUNK, 'x');
+    regex r("ab+c");  r.compile();
+    EXPECT_EQ(r.compiled.findParallel(big, 4), std::nullopt);
+    for (size_t pos : {size_t(0), big.size() / 4 - 2, big.size() / 2, big.size() - 4}) {
+        std::string s = big;
+        s.replace(pos, 4, "abbc");
+        s.replace(s.size() - 3, 3, "abc");
+        EXPECT_EQ(r.compiled.findParallel(s, 4), r.compiled.find(s)) << pos;
+    }
+
+    // without a prefilter both go through the reverse automaton; trying
+    // every begin would read the run of a's to its end from each one
+    CompileOptions plain;
+    plain.prefilter = false;
+    for (const char* p : {"ab+c", "a*(b|c)", "(a|x)*abb", "(a*(b|c))?"}) {
+        regex q(p);  q.compile(plain);
+        std::string run(4 * CompiledDKA::MIN_PARALLEL_CHUNK, 'a');
+        EXPECT_EQ(q.compiled.findParallel(run, 4), q.compiled.find(run)) << p;
+        for (size_t pos : {size_t(1), run.size() / 4, run.size() / 4 + 1, run.size() - 3}) {
+            std::string s = run;
+            s.replace(pos, 3, "abb");
+            s.replace(s.size() / 2, 3, "xbc");
+            EXPECT_EQ(q.compiled.findParallel(s, 4), q.compiled.find(s)) << p << " at " << pos;
+        }
+    }
+}
+
+TEST(RegexSet, ReportsEveryMatchingPattern)
+{
+    RegexSet set({ "(ab|ac)", "a.", "a+b", "x*", "(c|(ab)*)d" });
+    set.compile();
+    using Ids = std::vector<uint32_t>;
+    EXPECT_EQ(set.matches("ab"), (Ids{ 0, 1, 2 }));
+    EXPECT_EQ(set.matches("ac"), (Ids{ 0, 1 }));
+    EXPECT_EQ(set.matches("aab"), (Ids{ 2 }));
+    EXPECT_EQ(set.matches(""), (Ids{ 3 }));
+    EXPECT_EQ(set.matches("ababd"), (Ids{ 4 }));
+    EXPECT_EQ(set.matches("zz"), Ids{});
+    EXPECT_TRUE(set.isMatch("xxx"));
+    EXPECT_FALSE(set.isMatch("abcd"));
+}
+
+TEST(RegexSet, AgreesWithSeparatePatterns)
+{
+    std::vector<std::string> list = { "(a|b)*abb", "a{2,4}b?", "(c|(ab)*)d", "x.x", "b*", "(ab|ac)" };
+    std::vector<regex> single;
+    for (const auto& p : list) {
+        single.emplace_back(p);
+        single.back().compile();
+    }
+    for (MinimizeAlgo algo : { MinimizeAlgo::Hopcroft, MinimizeAlgo::Moore }) {
+        RegexSet set(list);
+        set.compile(CompileOptions{ algo });
+        forEachWord("abcdx", 5, [&](const std::string& w) {
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < single.size(); ++i)
+                if (single[i].match(w)) expected.push_back(i);
+            EXPECT_EQ(set.matches(w), expected) << w;
+        });
+    }
+}
+
+TEST(RegexSet, MinimizeKeepsPatternsApart)
+{
+    // same language twice: one final state with both ids, not two
+    RegexSet same({ "ab", "ab" });
+    same.compile();
+    EXPECT_EQ(same.dka().states.size(), 3u);
+    EXPECT_EQ(same.matches("ab"), (std::vector<uint32_t>{ 0, 1 }));
+
+    // a and b end in states that would merge without the tags
+    RegexSet diff({ "a", "b" });
+    diff.compile();
+    EXPECT_EQ(diff.dka().states.size(), 3u);
+    EXPECT_EQ(diff.matches("b"), (std::vector<uint32_t>{ 1 }));
+}
+
+TEST(RegexSet, PatternIdsSurviveSerialization)
+{
+    RegexSet set({ "a+", "a{2}", "b" });
+    set.compile();
+    std::string image = set.compiled().serialize();
+    CompiledDKA view = CompiledDKA::fromImage(image.data(), image.size());
+    CompiledDKA::StateId s = view.step(view.step(view.start(), 'a'), 'a');
+    auto ids = view.patterns(s);
+    EXPECT_EQ(std::vector<uint32_t>(ids.begin(), ids.end()), (std::vector<uint32_t>{ 0, 1 }));
+}
+
+static NFA nfaFor(const std::string& pattern, size_t unroll_limit)
+{
+    regex r(pattern);
+    r.parse();
+    return NFA::fromTree(r.tr, unroll_limit);
+}
+
+TEST(CountedRepeat, AgreesWithUnrolling)
+{
+    for (const char* p : {"a{2,4}b?", "(ab|a){1,3}", "(a|b){3}c", "a{2,}b", "(a?){2,3}", "((ab){1,2}c){2}", "a*(a{2}|b)"}) {
+        regex r(p);  r.compile();
+        auto counted = std::make_shared<const NFA>(nfaFor(p, 0));
+        EXPECT_FALSE(counted->counters.empty()) << p;
+        LazyDKA lazy(counted);
+        DKA eager = DKA::fromNFA(*counted);
+        forEachWord("abc", 7, [&](const std::string& w) {
+            EXPECT_EQ(lazy.match(w), r.match(w)) << p << " on " << w;
+            EXPECT_EQ(eager.match(w), r.match(w)) << p << " on " << w;
+        });
+    }
+}
+
+TEST(CountedRepeat, LargeBoundsStaySmall)
+{
+    NFA nfa = nfaFor("(ab|cd){1000,5000}", NFA::DEFAULT_UNROLL_LIMIT);
+    EXPECT_LT(nfa.states.size(), 20u);
+    EXPECT_EQ(nfa.counters.size(), 1u);
+
+    LazyDKA lazy(std::make_shared<const NFA>(std::move(nfa)));
+    auto pairs = [](size_t n) {
+        std::string s;
+        for (size_t i = 0; i < n; ++i) s += i % 3 ? "ab" : "cd";
+        return s;
+    };
+    EXPECT_FALSE(lazy.match(pairs(999)));
+    EXPECT_TRUE(lazy.match(pairs(1000)));
+    EXPECT_TRUE(lazy.match(pairs(5000)));
+    EXPECT_FALSE(lazy.match(pairs(5001)));
+    EXPECT_FALSE(lazy.match(pairs(2000) + "a"));
+}
+
+TEST(CountedRepeat, UnrollLimitOption)
+{
+    // the eager path accepts the same language either way
+    CompileOptions unrolled, counted;
+    unrolled.unroll_limit = 1000;
+    counted.unroll_limit = 2;
+    regex a("x(ab){3,5}y"), b("x(ab){3,5}y");
+    a.compile(unrolled);
+    b.compile(counted);
+    EXPECT_EQ(a.dka.states.size(), b.dka.states.size());
+    forEachWord("abxy", 6, [&](const std::string& w) {
+        EXPECT_EQ(a.match(w), b.match(w)) << w;
+    });
+    EXPECT_TRUE(b.match("xabababy"));
+}
+
+TEST(RegexArena, HashConsesEqualSubtrees)
+{
+    regex r("(ab|cd)x(ab|cd)y(ab|cd)");
+    r.parse();
+    ASSERT_TRUE(r.tr.arena);
+    // a b c d x y, ab cd, (ab|cd), the root concat and End
+    EXPECT_LE(r.tr.arena->size(), 12u);
+
+    NodePtr root = r.tr.getRoot();
+    auto& kids = std::get<Concat>(*root).children;
+    ASSERT_EQ(kids.size(), 6u);
+    EXPECT_EQ(kids[0], kids[2]);
+    EXPECT_EQ(kids[0], kids[4]);
+}
+
+TEST(RegexArena, ImportsPointerTrees)
+{
+    RegexTree tree;
+    Concat c;
+    c.children.push_back(std::make_shared<Node>(Literal{ 'a' }));
+    c.children.push_back(std::make_shared<Node>(Literal{ 'a' }));
+    c.children.push_back(std::make_shared<Node>(End{}));
+    tree.makeRoot(std::make_shared<Node>(std::move(c)));
+
+    ArenaRef ref = arenaOf(tree);
+    EXPECT_EQ(ref.arena->size(), 3u);
+    auto kids = ref.arena->children(ref.root);
+    ASSERT_EQ(kids.size(), 3u);
+    EXPECT_EQ(kids[0], kids[1]);
+
+    DKA d = DKA::fromNFA(NFA::fromTree(tree));
+    EXPECT_TRUE(d.match("aa"));
+    EXPECT_FALSE(d.match("a"));
+}
+
+TEST(RegexArena, TreeIsACopy)
+{
+    RegexTree tree;
+    auto root = std::make_shared<Node>(Concat{});
+    tree.makeNode<Literal>(root, 'a');
+    tree.makeNode<End>(root);
+    tree.makeRoot(root);
+    tree.makeNode<Literal>(root, 'b');   // after makeRoot: not part of the tree
+
+    NodePtr copy = tree.getRoot();
+    EXPECT_NE(copy, root);
+    EXPECT_EQ(std::get<Concat>(*copy).children.size(), 2u);
+    std::get<Concat>(*copy).children.clear();
+    EXPECT_EQ(std::get<Concat>(*tree.getRoot()).children.size(), 2u);
+    EXPECT_TRUE(DKA::fromNFA(NFA::fromTree(tree)).match("a"));
+    EXPECT_FALSE(RegexTree().getRoot());
+}
+
+TEST(RegexArena, LongAlternationOfLiterals)
+{
+    std::string pattern;
+    std::vector<std::string> words;
+    for (int i = 0; i < 3000; ++i) {
+        std::string w = "w" + std::to_string(i * 7919 % 100000);
+        words.push_back(w);
+        pattern += (i ? "|" : "") + w;
+    }
+    regex r("(" + pattern + ")");
+    r.compile();
+    // one node per distinct character and per word, plus the alternations
+    EXPECT_LT(r.tr.arena->size(), 2 * words.size() + 20);
+    for (int i = 0; i < 3000; i += 97)
+        EXPECT_TRUE(r.match(words[i])) << words[i];
+    EXPECT_FALSE(r.match("w"));
+    EXPECT_FALSE(r.match("x1"));
+}
+
+static size_t errorOffset(const std::string& pattern)
+{
+    regex r(pattern);
+    try {
+        r.compile();
+    } catch (const ParseError& e) {
+        return e.offset();
+    }
+    return std::string::npos;
+}
+
+TEST(ParserErrors, OffsetsPointAtTheProblem)
+{
+    EXPECT_EQ(errorOffset("(ab"), 4u);       // end of "(ab$", where the ")" is missing
+    EXPECT_EQ(errorOffset("ab)c"), 2u);
+    EXPECT_EQ(errorOffset("a||b"), 2u);
+    EXPECT_EQ(errorOffset("ab{3,2}"), 2u);
+    EXPECT_EQ(errorOffset("x*+"), 2u);
+    EXPECT_EQ(errorOffset("(a|b)c"), std::string::npos);
+}
+
+TEST(ParserErrors, ParserIsReusable)
+{
+    regex r("(ab|cd)+e");
+    r.compile();
+    const RegexArena* arena = r.tr.arena.get();
+    const TokenVariant* tokens = r.tk.Tokens.data();
+    r.compile();
+    EXPECT_EQ(r.tr.arena.get(), arena);
+    EXPECT_EQ(r.tk.Tokens.data(), tokens);
+    EXPECT_TRUE(r.match("abcde"));
+
+    // a tree still referenced elsewhere is left alone
+    RegexTree kept = r.tr;
+    r.compile();
+    EXPECT_NE(r.tr.arena.get(), kept.arena.get());
+    EXPECT_TRUE(DKA::fromNFA(NFA::fromTree(kept)).match("cde"));
+}
+
+// splits text at the given points and feeds the pieces one by one
+static std::vector<Match> streamed(Matcher& m, const std::string& text, const std::vector<size_t>& cuts)
+{
+    std::vector<Match> got;
+    auto push = [&got](const Match& x) { got.push_back(x); };
+    size_t at = 0;
+    for (size_t cut : cuts) {
+        m.feed(std::string_view(text).substr(at, cut - at), push);
+        at = cut;
+    }
+    m.feed(std::string_view(text).substr(at), push);
+    m.finish(push);
+    return got;
+}
+
+TEST(Matcher, AgreesWithFindAllAcrossChunks)
+{
+    uint32_t seed = 14;
+    auto rng = [&seed] { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+    for (const char* p : {"ab", "(a|b)*c", "a*", "(ab|a)(bc|c)?", "x.*y", "(a|ab)(c|bcd)", "b?", "(aa|b)*a",
+                          "a{2,3}", "(abc|b)"}) {
+        regex r(p);  r.compile();
+        Matcher m(r.compiled);
+        for (int round = 0; round < 200; ++round) {
+            std::string text;
+            for (size_t n = rng() % 40; n > 0; --n) text.push_back("abcxy"[rng() % 5]);
+            std::vector<Match> want;
+            r.compiled.forEachMatch(text, [&want](const Match& x) { want.push_back(x); });
+
+            std::vector<size_t> cuts;
+            for (size_t n = text.empty() ? 0 : rng() % 5; n > 0; --n) cuts.push_back(rng() % (text.size() + 1));
+            std::sort(cuts.begin(), cuts.end());
+            EXPECT_EQ(streamed(m, text, cuts), want) << p << " on " << text;
+
+            std::vector<size_t> bytes;
+            for (size_t i = 1; i < text.size(); ++i) bytes.push_back(i);
+            EXPECT_EQ(streamed(m, text, bytes), want) << p << " bytewise on " << text;
+        }
+    }
+}
+
+TEST(Matcher, PrunedBeginsKeepMatches)
+{
+    uint32_t seed = 21;
+    auto rng = [&seed] { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+    for (const char* p : {"a(a|b)*c", "x.*y|a*b", "(a|b)*c|b.*x", "a.*a", "(ab|a)(bc|c)?", "a*"}) {
+        regex r(p);  r.compile();
+        Matcher m(r.compiled);
+        for (int round = 0; round < 20; ++round) {
+            std::string text;
+            for (size_t n = 2000 + rng() % 2000; n > 0; --n) text.push_back("aaaabbcxy"[rng() % 9]);
+            std::vector<Match> want;
+            r.compiled.forEachMatch(text, [&want](const Match& x) { want.push_back(x); });
+            std::vector<size_t> cuts;
+            for (size_t n = rng() % 20; n > 0; --n) cuts.push_back(rng() % (text.size() + 1));
+            std::sort(cuts.begin(), cuts.end());
+            EXPECT_EQ(streamed(m, text, cuts), want) << p << " round " << round;
+        }
+    }
+}
+
+TEST(Matcher, OffsetsAreAbsolute)
+{
+    regex r("abc");  r.compile();
+    Matcher m(r.compiled);
+    std::vector<Match> got;
+    auto push = [&got](const Match& x) { got.push_back(x); };
+    m.feed("xxa", push);
+    m.feed("b", push);
+    EXPECT_TRUE(got.empty());
+    m.feed("cxxxab", push);
+    m.feed("c", push);
+    EXPECT_EQ(m.offset(), 11u);
+    m.finish(push);
+    EXPECT_EQ(got, (std::vector<Match>{{2, 5}, {8, 11}}));
+    EXPECT_EQ(m.offset(), 0u);
+}
+
+TEST(Matcher, SnapshotAndFullMatch)
+{
+    regex r("(ab)*");  r.compile();
+    Matcher m(r.compiled);
+    auto none = [](const Match&) {};
+    m.feed("aba", none);
+    EXPECT_FALSE(m.fullMatch());
+    Matcher::Snapshot snap = m.snapshot();
+    m.feed("b", none);
+    EXPECT_TRUE(m.fullMatch());
+
+    std::vector<Match> got;
+    m.restore(snap);
+    m.feed("bx", [&got](const Match& x) { got.push_back(x); });
+    EXPECT_FALSE(m.fullMatch());
+    EXPECT_EQ(got, (std::vector<Match>{{0, 4}, {4, 4}}));
+    m.reset();
+    EXPECT_TRUE(m.fullMatch());
+    EXPECT_EQ(m.offset(), 0u);
+}
+
+TEST(Matcher, StateStaysSmallOnLongStreams)
+{
+    regex r("(x.*y|a.*b)");  r.compile();
+    Matcher m(r.compiled);
+    size_t found = 0;
+    std::string block(1000, 'a');
+    for (int i = 0; i < 100; ++i)
+        m.feed(block, [&found](const Match&) { ++found; });
+    EXPECT_EQ(found, 0u);
+    EXPECT_LE(m.pending(), r.compiled.stateCount());
+    EXPECT_LE(m.retained(), 64u);
+    m.feed("b", [&found](const Match& x) { EXPECT_EQ(x, (Match{0, 100001})); ++found; });
+    m.finish([&found](const Match&) { ++found; });
+    EXPECT_EQ(found, 1u);
+}
+
+namespace generated {
+    bool mep_filter(std::string_view) noexcept;
+    bool dense_filter(std::string_view) noexcept;
+#ifdef REGEX_COMPUTED_GOTO
+    bool threaded_filter(std::string_view) noexcept;
+#endif
+}
+
+TEST(CodeGen, GeneratedFiltersAgreeWithTheTable)
+{
+    regex mep("(M+(e+)?p+|(h+)?i)");  mep.compile();
+    forEachWord("Mephi", 6, [&](const std::string& w) {
+        EXPECT_EQ(generated::mep_filter(w), mep.match(w)) << w;
+    });
+    regex dense("(a|c|e|g|i)(b|d|f)*(x|yz)");  dense.compile();
+    forEachWord("abdfxyz", 5, [&](const std::string& w) {
+        EXPECT_EQ(generated::dense_filter(w), dense.match(w)) << w;
+#ifdef REGEX_COMPUTED_GOTO
+        EXPECT_EQ(generated::threaded_filter(w), dense.match(w)) << w;
+#endif
+    });
+    EXPECT_FALSE(generated::mep_filter(std::string_view("M\0p", 3)));
+}
+
+TEST(CodeGen, RangesAndSwitches)
+{
+    regex r("(a|c|e|g|i)(b|d|f)*(x|yz)");  r.compile();
+    std::string code = generateCpp(r.compiled, CodeGenOptions{ .function = "f", .name_space = "a::b" });
+    EXPECT_NE(code.find("namespace a::b {"), std::string::npos);
+    EXPECT_NE(code.find("bool f(std::string_view text) noexcept"), std::string::npos);
+    EXPECT_NE(code.find("switch (*p++)"), std::string::npos);      // five letters from the start
+    EXPECT_NE(code.find("if (c == 122)"), std::string::npos);      // 'z' after 'y'
+
+    regex dot("a.*");  dot.compile();
+    EXPECT_NE(generateCpp(dot.compiled).find("if (c - 32u <= 94u)"), std::string::npos);
+    EXPECT_THROW(generateCpp(dot.compiled, CodeGenOptions{ .function = "1x" }), std::invalid_argument);
+    EXPECT_THROW(generateCpp(dot.compiled, CodeGenOptions{ .name_space = "a:b" }), std::invalid_argument);
+}
+
+using MepRule = ct_regex<"(M+(e+)?p+|(h+)?i)">;
+static_assert(MepRule::match("MMep"));
+static_assert(MepRule::match("hhi"));
+static_assert(!MepRule::match("Mhi"));
+static_assert(!MepRule::match(""));
+
+template<ct::fixed_string Pattern>
+static void expectSameAsRuntime(const std::string& alphabet, size_t max_len)
+{
+    regex r(std::string(Pattern.view()));
+    r.compile();
+    forEachWord(alphabet, max_len, [&](const std::string& w) {
+        EXPECT_EQ(ct_regex<Pattern>::match(w), r.match(w)) << Pattern.view() << " on " << w;
+    });
+    EXPECT_EQ(ct_regex<Pattern>::stateCount(), r.compiled.stateCount()) << Pattern.view();
+}
+
+TEST(CtRegex, AgreesWithRuntimePipeline)
+{
+    expectSameAsRuntime<"(M+(e+)?p+|(h+)?i)">("Mephi", 6);
+    expectSameAsRuntime<"(a|b)*abb">("ab", 8);
+    expectSameAsRuntime<"a{2,3}(b{,2}|c{2,})">("abc", 7);
+    expectSameAsRuntime<"(ab|a)(bc|c)?">("abc", 6);
+    expectSameAsRuntime<"a.&.b*$">("ab. ", 5);
+    expectSameAsRuntime<"x|y">("xy", 3);
+    expectSameAsRuntime<"(x|y)">("xy", 3);
+    expectSameAsRuntime<"(a*)*b?">("ab", 6);
+}
+
+TEST(Product, LazyAndMaterializedAgree)
+{
+    const std::vector<std::pair<const char*, const char*>> pairs = {
+        {"(a|b)*abb", "(a|b)*a(a|b)"}, {"a+", "aa"}, {"(ab|ba)*", "(a|b)*bb(a|b)*"},
+        {"a.*", "(a|c)*"}, {"(a|b|c){2,4}", ".b.*"}, {"x", "(a|b)*"}};
+    for (auto [p, q] : pairs) {
+        regex a(p);  a.compile();
+        regex b(q);  b.compile();
+        DKA both = a.dka.intersect(b.dka);
+        DKA diff = a.dka - b.dka;
+        DKA via_complement = a.dka.intersect(b.dka.complement());
+        forEachWord("abcx", 6, [&](const std::string& w) {
+            bool in_a = a.match(w), in_b = b.match(w);
+            EXPECT_EQ(both.match(w), in_a && in_b) << p << " & " << q << " on " << w;
+            EXPECT_EQ(a.dka.matchIntersection(b.dka, w), in_a && in_b) << p << " & " << q << " on " << w;
+            EXPECT_EQ(diff.match(w), in_a && !in_b) << p << " - " << q << " on " << w;
+            EXPECT_EQ(a.dka.matchDifference(b.dka, w), in_a && !in_b) << p << " - " << q << " on " << w;
+            EXPECT_EQ(via_complement.match(w), diff.match(w)) << p << " - " << q << " on " << w;
+        });
+    }
+}
+
+TEST(Product, DifferenceKeepsTheComplementAlphabet)
+{
+    // complement() takes every byte, so both forms accept a tab
+    regex a("a(&\t|b)");  a.compile();
+    regex b("ab");        b.compile();
+    DKA diff = a.dka - b.dka;
+    EXPECT_TRUE(diff.match("a\t"));
+    EXPECT_TRUE(a.dka.intersect(b.dka.complement()).match("a\t"));
+    EXPECT_TRUE(a.dka.matchDifference(b.dka, "a\t"));
+    EXPECT_FALSE(diff.match("ab"));
+
+    // a pair the eager version reached through ~95 sink transitions
+    regex any(".*");  any.compile();
+    regex none("z");  none.compile();
+    DKA rest = any.dka - none.dka;
+    EXPECT_LE(rest.states.size(), 3u);
+    EXPECT_TRUE(rest.match("hello"));
+    EXPECT_FALSE(rest.match("z"));
+}
+
+TEST(ToRegex, RoundTripsThroughTheParser)
+{
+    for (const char* p : {"a(b|c)", "(a|b)*abb", "(ab|ba)*", "a+b?c*", "(a|b){2,3}", "((a|b)*c(a|bb)*)*", "a.b",
+                          "&*&(x&)", "(a|ab)(c|bcd)", "[a-c]*(d|[^ab])", "(ab|cd)", "((a|b)c*|d)"}) {
+        regex r(p);  r.compile();
+        std::string back = r.dka.to_regex();
+        ASSERT_FALSE(back.empty()) << p;
+        regex again(back);
+        ASSERT_NO_THROW(again.compile()) << p << " -> " << back;
+        forEachWord("abcd*()x", 5, [&](const std::string& w) {
+            EXPECT_EQ(again.match(w), r.match(w)) << p << " -> " << back << " on " << w;
+        });
+    }
+}
+
+TEST(ToRegex, KeepsRangesAndScales)
+{
+    DKA digits;
+    size_t s = digits.addState(), f = digits.addState(true);
+    digits.start_state = s;
+    digits.addTransition(s, '0', '9', f);
+    digits.addTransition(f, '0', '9', f);
+    digits.addTransition(f, 'a', 'f', f);
+    EXPECT_EQ(digits.to_regex(), "[0-9][0-9a-f]*");
+
+    // a 300 word alternation; the old version gave up with "#LONG#"
+    std::string pattern = "(";
+    std::vector<std::string> words;
+    for (int i = 0; i < 300; ++i) {
+        std::string w;
+        for (int x = i * 37 % 1024; w.size() < 6; x /= 4) w.push_back("aceg"[x % 4]);
+        words.push_back(w);
+        pattern += (i ? "|" : "") + w;
+    }
+    pattern += ")";
+    regex r(pattern);  r.compile();
+    std::string back = r.dka.to_regex();
+    EXPECT_LT(back.size(), pattern.size());   // shared prefixes and suffixes factored
+    regex again(back);  again.compile();
+    for (const std::string& w : words) EXPECT_TRUE(again.match(w)) << w;
+    forEachWord("aceg", 6, [&](const std::string& w) {
+        EXPECT_EQ(again.match(w), r.match(w)) << w;
+    });
+}
+
+static bool inSequences(const std::vector<Utf8Sequence>& seqs, const std::string& s)
+{
+    size_t hits = 0;
+    for (const Utf8Sequence& seq : seqs) {
+        bool ok = seq.length == s.size();
+        for (size_t i = 0; ok && i < s.size(); ++i)
+            ok = static_cast<unsigned char>(s[i]) >= seq.bytes[i].first &&
+                 static_cast<unsigned char>(s[i]) <= seq.bytes[i].second;
+        hits += ok;
+    }
+    EXPECT_LE(hits, 1u) << "sequences overlap";
+    return hits == 1;
+}
+
+TEST(Utf8, SequencesCoverExactlyTheRange)
+{
+    const std::pair<char32_t, char32_t> ranges[] = {
+        {'A', 'Z'}, {0x3B1, 0x3C9}, {0x7FF, 0x800}, {0xD000, 0xE0FF}, {0x80, MAX_CODE_POINT}, {0, MAX_CODE_POINT}};
+    for (auto [from, to] : ranges) {
+        std::vector<Utf8Sequence> seqs = utf8Sequences(from, to);
+        for (char32_t cp = 0; cp <= MAX_CODE_POINT; cp += (cp < 0x1000 ? 1 : 97)) {
+            if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+            std::string s;
+            appendUtf8(s, cp);
+            EXPECT_EQ(utf8Length(s), s.size());
+            ASSERT_EQ(inSequences(seqs, s), cp >= from && cp <= to) << std::hex << static_cast<uint32_t>(cp);
+        }
+    }
+    // overlong, surrogate, past U+10FFFF, stray continuation, truncated
+    std::vector<Utf8Sequence> all = utf8Sequences(0, MAX_CODE_POINT);
+    for (std::string bad : {"\xC0\x80", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\x80", "\xE2\x82"}) {
+        EXPECT_FALSE(inSequences(all, bad)) << bad;
+        EXPECT_EQ(utf8Length(bad), 0u) << bad;
+    }
+}
+
+TEST(Utf8, DotReadsWholeCodePoints)
+{
+    CompileOptions utf8;
+    utf8.encoding = Encoding::Utf8;
+    regex three(".{3}");  three.compile(utf8);
+    EXPECT_TRUE(three.match("a\xC3\xA9\xE2\x82\xAC"));        // aé€
+    EXPECT_TRUE(three.match("\xF0\x9F\x98\x80xy"));          // 😀xy
+    EXPECT_FALSE(three.match("a\xC3\xA9\xE2\x82"));          // cut inside €
+    EXPECT_FALSE(three.match("ab\xC0\x80"));                  // overlong NUL
+    EXPECT_FALSE(three.match("a\nb"));
+
+    // an unescaped multibyte character is one atom in every encoding
+    regex repeated("\xC3\xA9+");  repeated.compile();
+    EXPECT_TRUE(repeated.match("\xC3\xA9\xC3\xA9"));
+    EXPECT_FALSE(repeated.match("\xC3\xA9\xA9"));
+
+    // a '.' may be 4 bytes wide: the prefilter's offset has to allow it
+    regex tail(".{2}abc");  tail.compile(utf8);
+    EXPECT_EQ(tail.findAll("\xE2\x82\xAC\xE2\x82\xAC" "abc \xF0\x9F\x98\x80" "zabc"),
+              (Spans{{0, 9}, {10, 18}}));
+
+    CompileOptions bytes;
+    bytes.encoding = Encoding::Bytes;
+    regex raw("a.b");  raw.compile(bytes);
+    regex ascii("a.b");  ascii.compile();
+    for (int c = 0; c < 256; ++c) {
+        std::string s = {'a', static_cast<char>(c), 'b'};
+        EXPECT_EQ(raw.match(s), c != '\n') << c;
+        EXPECT_EQ(ascii.match(s), c >= ' ' && c <= '~') << c;
+    }
+    regex escaped("&\xFF&\x80");  escaped.compile();
+    EXPECT_TRUE(escaped.match("\xFF\x80"));
+}
+
+// leftmost start, then the longest end, straight from the definition
+static std::optional<Match> bruteFind(const DKA& d, const std::string& text, size_t from)
+{
+    for (size_t b = from; b <= text.size(); ++b)
+        for (size_t e = text.size() + 1; e-- > b;)
+            if (d.match(text.substr(b, e - b))) return Match{b, e};
+    return std::nullopt;
+}
+
+TEST(Reverse, ReversedLanguage)
+{
+    regex r("(abc|abd)x*");  r.compile();
+    std::optional<DKA> back = r.dka.reversed();
+    ASSERT_TRUE(back.has_value());
+    for (const char* w : {"cba", "dba", "xxcba"}) EXPECT_TRUE(back->match(w)) << w;
+    for (const char* w : {"abc", "cbax", "ba"}) EXPECT_FALSE(back->match(w)) << w;
+    EXPECT_FALSE(r.dka.reversed(true, 2).has_value());
+}
+
+TEST(Reverse, SpansAgreeWithTheDefinition)
+{
+    const char* patterns[] = {"ab+", "(abcd|c)", "(ab|bcde)", "a*(b|c)", "(a|b)*abb", "(x|xy)(z|yz)", "b.{0,3}a",
+                              "(a*(b|c))?", "(ab|xyz)*"};
+    uint32_t seed = 7;
+    for (const char* p : patterns) {
+        CompileOptions plain;
+        plain.prefilter = false;
+        regex r(p);  r.compile(plain);
+        ASSERT_TRUE(r.compiled.scansBackwards()) << p;
+        for (int round = 0; round < 40; ++round) {
+            std::string text;
+            for (int i = 0; i < 24; ++i) {
+                seed = seed * 1103515245 + 12345;
+                text.push_back("abcdxyz"[(seed >> 16) % 7]);
+            }
+            Spans expected;
+            for (size_t pos = 0; pos <= text.size();) {
+                auto m = bruteFind(r.dka, text, pos);
+                if (!m) break;
+                expected.emplace_back(m->begin, m->end);
+                pos = m->end == m->begin ? m->end + 1 : m->end;
+            }
+            EXPECT_EQ(r.findAll(text), expected) << p << " on " << text;
+            auto first = r.compiled.find(text, 5);
+            EXPECT_EQ(first, bruteFind(r.dka, text, 5)) << p << " on " << text;
+        }
+    }
+}
+
+TEST(Reverse, HostileInputStaysLinear)
+{
+    // trying every begin would walk to the end of the text from each one
+    regex r("a*(b|c)");  r.compile();
+    ASSERT_TRUE(r.compiled.scansBackwards());
+    const size_t states = r.compiled.reverse()->stateCount();
+    EXPECT_LE(states, 4u);
+
+    std::string text(1 << 20, 'a');
+    EXPECT_FALSE(r.compiled.find(text).has_value());
+    EXPECT_EQ(r.compiled.count(text), 0u);
+    text.back() = 'c';
+    EXPECT_EQ(r.compiled.find(text), (Match{0, text.size()}));
+
+    std::string pairs;
+    for (int i = 0; i < 100000; ++i) pairs += i % 2 ? "ab" : "cc";
+    EXPECT_EQ(r.compiled.count(pairs), 150000u);
+    size_t n = 0;
+    for (const Match& m : r.compiled.matches(pairs)) n += m.end - m.begin == 2;
+    EXPECT_EQ(n, 50000u);
+
+    // nullable: every position starts a match, and the scans from the
+    // positions inside the run of a's join the first one
+    regex opt("(a*(b|c))?");  opt.compile();
+    ASSERT_TRUE(opt.compiled.scansBackwards());
+    std::string run(1 << 18, 'a');
+    EXPECT_EQ(opt.compiled.count(run), run.size() + 1);
+    run.back() = 'b';
+    EXPECT_EQ(opt.compiled.count(run), 2u);
+    run.back() = 'a';
+    run[run.size() / 2] = 'c';
+    EXPECT_EQ(opt.compiled.count(run), run.size() / 2 + 1);
+
+    // the image holds the reverse automaton, loading does not rebuild it
+    std::string image = r.compiled.serialize();
+    CompiledDKA loaded = CompiledDKA::fromImage(image.data(), image.size());
+    ASSERT_NE(loaded.reverse(), nullptr);
+    EXPECT_EQ(loaded.reverse()->stateCount(), states);
+    EXPECT_EQ(loaded.serialize(), image);
+}
+
+TEST(Reverse, JoinedScansAgreeWithSeparateFinds)
+{
+    uint32_t seed = 11;
+    for (const char* p : {"(a|b)*c", "(a*(b|c))?", "(ab|a)*b?", "a(a|b)*c", "((a|b)(a|b))*c?"}) {
+        regex r(p);  r.compile();
+        for (int round = 0; round < 20; ++round) {
+            std::string text;
+            for (int i = 0; i < 3000; ++i) {
+                seed = seed * 1103515245 + 12345;
+                text.push_back("aaaaaaab c"[(seed >> 16) % (round % 2 ? 10 : 8)]);
+            }
+            Spans expected;
+            for (size_t pos = 0; pos <= text.size();) {
+                auto m = r.compiled.find(text, pos);
+                if (!m) break;
+                expected.emplace_back(m->begin, m->end);
+                pos = m->end == m->begin ? m->end + 1 : m->end;
+            }
+            EXPECT_EQ(r.findAll(text), expected) << p << " round " << round;
+        }
+    }
+}
+
+TEST(Reverse, BuiltOnceOnDemandWithinLimits)
+{
+    regex r("(abc|abd)x*");  r.compile();
+    CompiledDKA copy = r.compiled;
+    ASSERT_NE(copy.reverse(), nullptr);
+    EXPECT_EQ(copy.reverse(), r.compiled.reverse());
+
+    // the predecessor sets of a long chain grow with it: over the work
+    // limit long before the state limit, searches try every begin instead
+    CompileOptions plain;
+    plain.prefilter = false;
+    regex chain("ax{4000}");  chain.compile(plain);
+    EXPECT_TRUE(chain.match("a" + std::string(4000, 'x')));
+    EXPECT_EQ(chain.compiled.reverse(), nullptr);
+    EXPECT_FALSE(chain.compiled.scansBackwards());
+    std::string text = "xa" + std::string(4000, 'x') + "a";
+    EXPECT_EQ(chain.compiled.find(text), (Match{1, 4002}));
+    std::string image = chain.compiled.serialize();
+    EXPECT_EQ(CompiledDKA::fromImage(image.data(), image.size()).reverse(), nullptr);
+}
+
+TEST(Captures, NamedGroupsBoundTheirPart)
+{
+    regex r("(<key>(a|b)+)=(<val>.*)");  r.compile();
+    ASSERT_EQ(r.groupCount(), 2u);
+    EXPECT_EQ(r.groupNames(), (std::vector<std::string>{"key", "val"}));
+    using G = std::vector<size_t>;
+    EXPECT_EQ(r.captures(" ab=xy"), (std::vector<G>{{1, 6, 1, 3, 4, 6}}));
+
+    regex again("(<d>a|b)+");  again.compile();
+    EXPECT_EQ(again.captures("abba"), (std::vector<G>{{0, 4, 3, 4}}));
+    EXPECT_EQ(again.captures("xaxb"), (std::vector<G>{{1, 2, 1, 2}, {3, 4, 3, 4}}));
+
+    // plain parens do not count, groups are numbered by their '('
+    regex nested("((<o>x(<i>y)?)|z)w");  nested.compile();
+    const size_t N = TaggedDKA::NPOS;
+    EXPECT_EQ(nested.captures("xw zw xyw"),
+              (std::vector<G>{{0, 2, 0, 1, N, N}, {3, 5, N, N, N, N}, {6, 9, 6, 8, 7, 8}}));
+}
+
+TEST(Captures, EarlierAlternativesAndLongerRepeatsWin)
+{
+    using G = std::vector<size_t>;
+    regex stars("(<a>x*)(<b>x*)");  stars.compile();
+    EXPECT_EQ(stars.captures("xxx"), (std::vector<G>{{0, 3, 0, 3, 3, 3}, {3, 3, 3, 3, 3, 3}}));
+
+    regex alt("(<a>(x|xy))(<b>y?)z");  alt.compile();
+    EXPECT_EQ(alt.captures("xyz"), (std::vector<G>{{0, 3, 0, 1, 1, 2}}));
+
+    // a later iteration that skips the group keeps the earlier bounds
+    regex keep("((<a>a)|b)+");  keep.compile();
+    EXPECT_EQ(keep.captures("ab"), (std::vector<G>{{0, 2, 0, 1}}));
+
+    // the greedy star leaves one b, on any input
+    regex split("(<a>(a|b)*)(<b>b+)");  split.compile();
+    uint32_t seed = 3;
+    for (int round = 0; round < 50; ++round) {
+        std::string text;
+        for (int i = 0; i < 16; ++i) {
+            seed = seed * 1103515245 + 12345;
+            text.push_back("abc"[(seed >> 16) % 3]);
+        }
+        auto spans = split.findAll(text);
+        size_t n = 0;
+        split.forEachCapture(text, [&](std::span<const size_t> g) {
+            ASSERT_LT(n, spans.size());
+            EXPECT_EQ(g[0], spans[n].first);
+            EXPECT_EQ(g[1], spans[n].second);
+            EXPECT_EQ(g[2], g[0]);
+            EXPECT_EQ(g[3], g[1] - 1);
+            EXPECT_EQ(g[4], g[1] - 1);
+            EXPECT_EQ(g[5], g[1]);
+            ++n;
+        });
+        EXPECT_EQ(n, spans.size()) << text;
+    }
+}
+
+TEST(Captures, ErrorsAndOptions)
+{
+    for (const char* p : {"(<a>x)(<a>y)", "(<a>x", "(<9>x)"}) {
+        regex r(p);
+        EXPECT_THROW(r.compile(), ParseError) << p;
+    }
+
+    CompileOptions utf8;
+    utf8.encoding = Encoding::Utf8;
+    regex r("(<c>.)(<rest>.*)");  r.compile(utf8);
+    auto caps = r.captures("\xD0\xB4\xD0\xB0!");
+    ASSERT_EQ(caps.size(), 1u);
+    EXPECT_EQ(caps[0], (std::vector<size_t>{0, 5, 0, 2, 2, 5}));
+
+    // counters carry no tags: the matcher compiles, captures need the
+    // repeat unrolled
+    regex counted("(<a>x){100}y");  counted.compile();
+    EXPECT_TRUE(counted.match(std::string(100, 'x') + "y"));
+    EXPECT_EQ(counted.tagged(), nullptr);
+    EXPECT_THROW(counted.captures("xy"), std::runtime_error);
+    CompileOptions unrolled;
+    unrolled.unroll_limit = 128;
+    counted.compile(unrolled);
+    ASSERT_NE(counted.tagged(), nullptr);
+    EXPECT_EQ(counted.captures(std::string(100, 'x') + "y"), (std::vector<std::vector<size_t>>{{0, 101, 99, 100}}));
+
+    // groups next to a counted repeat: tag states are not counters
+    regex mixed("(<a>x)(<b>y)(<c>w)(<d>v)z{100}");  mixed.compile();
+    EXPECT_TRUE(mixed.match("xywv" + std::string(100, 'z')));
+    EXPECT_FALSE(mixed.match("xywv" + std::string(99, 'z')));
+
+    // the cache keeps only the matcher
+    RegexCache cache;
+    regex cached("(<c>a)b");  cached.compile(cache);
+    EXPECT_EQ(cached.groupCount(), 0u);
+    EXPECT_EQ(cached.captures("xab"), (std::vector<std::vector<size_t>>{{1, 3}}));
+
+    // reused after a full compile: nothing of the old automaton is left
+    regex reused("(<c>a)b");  reused.compile();
+    ASSERT_EQ(reused.groupCount(), 1u);
+    reused.compile(cache);
+    EXPECT_EQ(reused.groupCount(), 0u);
+    EXPECT_EQ(reused.tagged(), nullptr);
+    EXPECT_TRUE(reused.dka.states.empty());
+    EXPECT_EQ(reused.captures("xab"), (std::vector<std::vector<size_t>>{{1, 3}}));
+}
+
+TEST(Classes, MatchLikeTheAlternationWithFewerStates)
+{
+    regex cls("[0-9a-f]{32}");  cls.compile();
+    regex alt("(0|1|2|3|4|5|6|7|8|9|a|b|c|d|e|f){32}");  alt.compile();
+    EXPECT_EQ(cls.dka.states.size(), alt.dka.states.size());
+    std::string hash(32, '7');
+    EXPECT_TRUE(cls.match(hash));
+    hash[5] = 'g';
+    EXPECT_FALSE(cls.match(hash));
+    // the NFA gets one Range state per range instead of one per byte
+    EXPECT_LT(10 * NFA::fromTree(cls.tr).states.size(), NFA::fromTree(alt.tr).states.size());
+
+    for (auto [p, q] : {std::pair{"[a-c]x*", "(a|b|c)x*"}, {"[^a-b]+", "(c|x|&*|&[|-|&&)+"},
+                        {"&d&s&w", "(0|1|2|3|4|5|6|7|8|9) [0-9A-Z_a-z]"}, {"[\\-&]+", "(-|&&)+"},
+                        {"(&D|&S)a", "[^0-9]a"}}) {
+        regex r(p);  r.compile();
+        regex s(q);  s.compile();
+        forEachWord("abcx*[-&", 4, [&](const std::string& w) {
+            EXPECT_EQ(r.match(w), s.match(w)) << p << " vs " << q << " on " << w;
+        });
+    }
+
+    // classes are atoms for the prefilter too
+    regex id("user_[0-9]+");  id.compile();
+    EXPECT_EQ(requiredLiteral(id.tr).text, "user_");
+}
+
+TEST(Classes, CodePointRangesAndNegation)
+{
+    CompileOptions utf8;
+    utf8.encoding = Encoding::Utf8;
+    regex cyr("[а-яё]+");  cyr.compile(utf8);
+    EXPECT_TRUE(cyr.match("ёжик"));
+    EXPECT_FALSE(cyr.match("ёж1к"));
+    EXPECT_FALSE(cyr.match("\xD0"));
+
+    // [^...] reads what '.' reads
+    regex other("[^а]");  other.compile(utf8);
+    EXPECT_TRUE(other.match("б"));
+    EXPECT_TRUE(other.match("\xF0\x9F\x98\x80"));
+    EXPECT_FALSE(other.match("а"));
+    EXPECT_FALSE(other.match("\n"));
+    regex ascii("[^a]");  ascii.compile();
+    EXPECT_TRUE(ascii.match("b"));
+    EXPECT_FALSE(ascii.match("\t"));
+    EXPECT_FALSE(ascii.match("\xD0\xB0"));
+
+    // bytes that are not UTF-8 stay bytes, as to_regex writes them
+    CompileOptions bytes;
+    bytes.encoding = Encoding::Bytes;
+    regex raw("[\x80-\xBF]+");  raw.compile(bytes);
+    EXPECT_TRUE(raw.match("\x80\xBF\x90"));
+    EXPECT_FALSE(raw.match("\xC0"));
+    std::string back = raw.dka.to_regex();
+    regex again(back);  again.compile(bytes);
+    EXPECT_TRUE(again.match("\x80\xBF\x90")) << back;
+
+    DKA digits;
+    size_t s = digits.addState(), f = digits.addState(true);
+    digits.start_state = s;
+    digits.addTransition(s, '0', '9', f);
+    digits.addTransition(f, '-', '-', f);
+    digits.addTransition(f, '[', '^', f);
+    regex round(digits.to_regex());  round.compile();
+    forEachWord("09-[\\]^a", 4, [&](const std::string& w) {
+        EXPECT_EQ(round.match(w), digits.match(w)) << w;
+    });
+
+    using Rule = ct_regex<"[a-c&]x&d[^b]">;
+    static_assert(Rule::match("&x1a") && !Rule::match("&x1b"));
+    for (const char* p : {"a[b", "a[]", "[z-a]"}) {
+        regex bad(p);
+        EXPECT_THROW(bad.compile(), ParseError) << p;
+    }
+}
+
+TEST(ThreadPool, EverySliceOnceWithUnevenWork)
+{
+    ThreadPool pool(3);
+    ASSERT_EQ(pool.concurrency(), 4u);
+    for (size_t n : {0u, 1u, 100u, 1000u, 12345u}) {
+        std::vector<std::atomic<int>> seen(n);
+        pool.parallelFor(n, 16, [&](size_t b, size_t e) {
+            EXPECT_EQ(b % 16, 0u);
+            EXPECT_LE(e - b, 16u);
+            // the first share is much slower, the others have to steal from it
+            if (b < n / 4) std::this_thread::sleep_for(std::chrono::microseconds(200));
+            for (size_t i = b; i < e; ++i) ++seen[i];
+        });
+        for (size_t i = 0; i < n; ++i) ASSERT_EQ(seen[i].load(), 1) << n << " at " << i;
+    }
+    EXPECT_THROW(pool.parallelFor(1000, 10, [](size_t b, size_t) {
+        if (b == 500) throw std::runtime_error("slice failed");
+    }), std::runtime_error);
+    std::atomic<size_t> total{0};
+    pool.parallelFor(1000, 10, [&](size_t b, size_t e) { total += e - b; });
+    EXPECT_EQ(total.load(), 1000u);
+}
+
+TEST(SharedRegex, BatchAgreesWithMatch)
+{
+    auto re = SharedRegex::compile("[0-9a-f]{8}(-[0-9a-f]{4}){3}");
+    std::vector<std::string> storage;
+    uint32_t seed = 11;
+    for (int i = 0; i < 20000; ++i) {
+        std::string s;
+        for (int k = 0; k < 23; ++k) {
+            seed = seed * 1103515245 + 12345;
+            s.push_back(k % 5 == 3 && k > 7 ? '-' : "0123456789abcdef"[(seed >> 16) % 16]);
+        }
+        s[8] = '-';
+        if (i % 3 == 0) s[(seed >> 8) % s.size()] = 'x';
+        storage.push_back(s);
+    }
+    std::vector<std::string_view> inputs(storage.begin(), storage.end());
+    ThreadPool pool(4);
+    MatchBits bits = re->matchAll(inputs, pool);
+    ASSERT_EQ(bits.size(), inputs.size());
+    size_t expected = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ASSERT_EQ(bits[i], re->match(inputs[i])) << inputs[i];
+        expected += bits[i];
+    }
+    EXPECT_EQ(bits.count(), expected);
+    EXPECT_GT(expected, 0u);
+    EXPECT_LT(expected, inputs.size());
+    EXPECT_EQ(re->matchAll({}, pool).size(), 0u);
+}
+
+TEST(SharedRegex, MatchersPerThread)
+{
+    auto re = SharedRegex::compile("(<key>&w+)=(<val>&d+)");
+    ASSERT_EQ(re->groupNames().size(), 2u);
+    const std::string text = "a=1 bb=22 ccc=333 x=y";
+    std::vector<std::thread> threads;
+    std::atomic<int> failures{0};
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            RegexMatcher m(re);
+            for (int round = 0; round < 200; ++round) {
+                std::vector<size_t> vals;
+                for (size_t pos = 0;;) {
+                    auto g = m.capture(text, pos);
+                    if (g.empty()) break;
+                    vals.push_back(g[5] - g[4]);
+                    pos = g[1];
+                }
+                if (vals != std::vector<size_t>{1, 2, 3}) ++failures;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    EXPECT_EQ(failures.load(), 0);
+
+    regex plain("ab");
+    EXPECT_THROW(SharedRegex{plain}, std::logic_error);
+}
+
+TEST(SharedRegex, MatcherReusesStartIndex)
+{
+    auto re = SharedRegex::compile("(a|b)*c");
+    ASSERT_TRUE(re->automaton().scansBackwards());
+    std::string text;
+    for (int i = 0; i < 2000; ++i) text += i % 3 ? "xab" : "xabc";
+    std::vector<Match> want;
+    re->automaton().forEachMatch(text, [&want](const Match& x) { want.push_back(x); });
+    ASSERT_FALSE(want.empty());
+
+    RegexMatcher m(re);
+    for (int round = 0; round < 2; ++round) {
+        std::vector<Match> got;
+        for (size_t pos = 0;;) {
+            auto x = m.find(text, pos);
+            if (!x) break;
+            got.push_back(*x);
+            pos = x->end;
+        }
+        EXPECT_EQ(got, want);
+    }
+
+    // changed in place: same data and size, a new index after forget()
+    std::replace(text.begin(), text.end(), 'c', 'a');
+    m.forget();
+    EXPECT_FALSE(m.find(text, 0));
+    text.back() = 'c';
+    EXPECT_EQ(m.find(text, 0), (Match{text.size() - 2, text.size()}));
+}
@@ -72,29 +72,99 @@ TEST(TokenizerTest, CurlyRepeatForms) {
     ASSERT_EQ(t4.size(), 5);
 }
 
-// TEST(TokenizerTest, NamedGroupSimple) {
-//     Tokenizer tk;
-//     auto& tokens = tk.Tokenize("(<g>a)<g>");
-
-//     // Имя группы сейчас пока не парсится как отдельный тип
-//     // Но если реализуешь `NamedGroupStart`, `NamedGroupRef`, то это будет работать
-//     // Вот тогда это:
-//     // ( → LParen
-//     // <g> → NamedGroupStart g
-//     // a → Literal
-//     // ) → RParen
-//     // <g> → NamedGroupRef g
-
-//     // Пока что будет токенизировано как:
-//     ASSERT_GE(tokens.size(), 6);  // если реализация добавлена
-// }
-
-// TEST(TokenizerTest, MixedComplex) {
-//     Tokenizer tk;
-//     auto& tokens = tk.Tokenize("a(&+)b{1,2}(<word>x|y)<word>$");
-
-//     ASSERT_GE(tokens.size(), 14);  // зависит от реализации named-group
-//     // Тестируй вручную, если группы пока не поддерживаются
-// }
+TEST(TokenizerTest, OffsetsAndReuse) {
+    Tokenizer tk;
+    tk.Tokenize("ab{2,3}&+$");
+    ASSERT_EQ(tk.Offsets.size(), tk.Tokens.size());
+    std::vector<size_t> expected = {0, 1, 2, 2, 2, 2, 2, 7, 9};
+    EXPECT_EQ(tk.Offsets, expected);
+
+    const TokenVariant* buffer = tk.Tokens.data();
+    tk.Tokenize("x|y");
+    EXPECT_EQ(tk.Tokens.size(), 3);
+    EXPECT_EQ(tk.Tokens.data(), buffer);
+}
+
+TEST(TokenizerTest, ErrorsCarryOffsets) {
+    Tokenizer tk;
+    try {
+        tk.Tokenize("ab{x}");
+        FAIL() << "expected ParseError";
+    } catch (const ParseError& e) {
+        EXPECT_EQ(e.offset(), 2);
+    }
+    EXPECT_THROW(tk.Tokenize("ab&"), std::invalid_argument);
+}
+
+TEST(TokenizerTest, NamedGroupSimple) {
+    Tokenizer tk;
+    auto& tokens = tk.Tokenize("(<g>a)<g>");
+
+    // a name is only special right after '(', backreferences do not exist
+    ASSERT_EQ(tokens.size(), 7);
+    EXPECT_EQ(getType(tokens[0]), TokenType::LParen);
+    EXPECT_EQ(getType(tokens[1]), TokenType::GroupCreate);
+    EXPECT_EQ(getName(tokens[1]), "g");
+    EXPECT_EQ(getType(tokens[2]), TokenType::Literal);
+    EXPECT_EQ(getType(tokens[3]), TokenType::RParen);
+    EXPECT_EQ(getSymbol(tokens[4]), '<');
+    EXPECT_EQ(getSymbol(tokens[5]), 'g');
+    EXPECT_EQ(getSymbol(tokens[6]), '>');
+    std::vector<size_t> expected = {0, 1, 4, 5, 6, 7, 8};
+    EXPECT_EQ(tk.Offsets, expected);
+}
+
+TEST(TokenizerTest, MixedComplex) {
+    Tokenizer tk;
+    auto& tokens = tk.Tokenize("a(&+)b{1,2}(<word>x|y)<word>$");
+
+    ASSERT_EQ(tokens.size(), 23);
+    EXPECT_EQ(getSymbol(tokens[2]), '+');
+    EXPECT_EQ(getType(tokens[10]), TokenType::LParen);
+    EXPECT_EQ(getName(tokens[11]), "word");
+    EXPECT_EQ(getType(tokens[13]), TokenType::Pipe);
+    EXPECT_EQ(getType(tokens[22]), TokenType::End);
+}
+
+TEST(TokenizerTest, BadGroupNames) {
+    Tokenizer tk;
+    for (const char* p : { "(<>a)", "(<1a>a)", "(<a b>a)", "(<ab" }) {
+        try {
+            tk.Tokenize(p);
+            FAIL() << "expected ParseError for " << p;
+        } catch (const ParseError& e) {
+            EXPECT_EQ(e.offset(), 1) << p;
+        }
+    }
+}
+
+TEST(TokenizerTest, BracketClasses) {
+    Tokenizer tk;
+    auto& tokens = tk.Tokenize("x[^a-c\\]\\-z[:digit:]]&W");
+    ASSERT_EQ(tokens.size(), 3);
+    const auto& cls = std::get<TokenClass>(tokens[1]);
+    EXPECT_TRUE(cls.negated);
+    std::vector<ClassRange> expected = {{'-', '-'}, {'0', '9'}, {']', ']'}, {'a', 'c'}, {'z', 'z'}};
+    EXPECT_EQ(cls.ranges, expected);
+    EXPECT_EQ(tk.Offsets[1], 1);
+    const auto& word = std::get<TokenClass>(tokens[2]);
+    EXPECT_TRUE(word.negated);
+    EXPECT_EQ(word.ranges.size(), 4);
+
+    // UTF-8 characters are code points, other high bytes stay bytes
+    auto& utf = tk.Tokenize("[\xD0\xB0-\xD1\x8F\xFF]");
+    ASSERT_EQ(utf.size(), 1);
+    expected = {{0x430, 0x44F}, {RAW_BYTE + 0xFF, RAW_BYTE + 0xFF}};
+    EXPECT_EQ(std::get<TokenClass>(utf[0]).ranges, expected);
+
+    for (const char* p : { "a[bc", "a[]", "a[z-a]", "a[\\q]", "a[[:foo:]]", "a[a-\\d]" }) {
+        try {
+            tk.Tokenize(p);
+            FAIL() << "expected ParseError for " << p;
+        } catch (const ParseError& e) {
+            EXPECT_GE(e.offset(), 1) << p;
+        }
+    }
+}
 
 } // namespace